@@ -114,6 +114,24 @@ void panicF(const char * format, ...);
 // Printf to console and debug output.
 void debugF(const char * format, ...);
 
+// ========================================================
+// Memory reporting
+// ========================================================
+
+// Bytes held by an object in system memory and in GPU resources
+struct MemoryUsage
+{
+	u64 cpuBytes = 0;
+	u64 gpuBytes = 0;
+
+	MemoryUsage& operator+=(const MemoryUsage& other)
+	{
+		cpuBytes += other.cpuBytes;
+		gpuBytes += other.gpuBytes;
+		return *this;
+	}
+};
+
 
 // ========================================================
 // Frequently used maths
@@ -227,6 +245,11 @@ struct Camera
 
 	bool pointInFrustum(const v3& v) const;
 
+	bool sphereInFrustum(const v3& centre, const float radius) const;
+
+	// Fraction of the viewport height a sphere covers, 1 if the eye is inside it
+	float projectedSize(const v3& centre, const float radius) const;
+
 	static v3 rotateAroundAxis(const v3 & vec, const v3 & axis, const float angle);
 };
 
@@ -322,9 +345,22 @@ void update_dynamic_structured_buffer(ID3D11DeviceContext* pContext, ID3D11Buffe
 template <typename Element>
 void zero_dynamic_structured_buffer(ID3D11DeviceContext* pContext, ID3D11Buffer* pBuffer, const u32 numElements)
 {
-	Element* pEmptyArray = static_cast<Element*>(std::calloc(numElements, sizeof(Element)));
-	update_dynamic_structured_buffer<Element>(pContext, pBuffer, pEmptyArray, numElements);
-	std::free(pEmptyArray);
+	// Zero the mapped memory directly rather than uploading a zeroed copy
+	D3D11_MAPPED_SUBRESOURCE mappedSubresource;
+	ZeroMemory(&mappedSubresource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+
+	if (!FAILED(pContext->Map(pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubresource)))
+	{
+		memset(mappedSubresource.pData, 0, numElements * sizeof(Element));
+		pContext->Unmap(pBuffer, 0);
+	}
+}
+
+// Default usage buffers can't be mapped, so they are cleared through a UAV on the GPU
+inline void zero_default_structured_buffer(ID3D11DeviceContext* pContext, ID3D11UnorderedAccessView* pBufferUAV)
+{
+	const UINT kZeros[4] = { 0, 0, 0, 0 };
+	pContext->ClearUnorderedAccessViewUint(pBufferUAV, kZeros);
 }
 
 template<typename Element>
@@ -0,0 +1,74 @@
+#include "FrameArena.h"
+
+#include <cstdarg>
+#include <new>
+
+FrameArena::~FrameArena()
+{
+	while (m_pFirst)
+	{
+		Block* pNext = m_pFirst->pNext;
+		::operator delete(m_pFirst);
+		m_pFirst = pNext;
+	}
+}
+
+FrameArena::Block* FrameArena::new_block(size_t minBytes)
+{
+	const size_t kSize = std::max(m_blockSize, minBytes);
+	Block* pBlock = static_cast<Block*>(::operator new(sizeof(Block) + kSize));
+	pBlock->pNext = nullptr;
+	pBlock->size = kSize;
+	pBlock->used = 0;
+	m_capacity += kSize;
+	return pBlock;
+}
+
+void* FrameArena::alloc(size_t bytes, size_t alignment)
+{
+	ASSERT(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	ASSERT(alignment <= alignof(std::max_align_t));
+
+	if (!m_pCurrent)
+		m_pFirst = m_pCurrent = new_block(bytes);
+
+	for (;;)
+	{
+		const size_t kOffset = (m_pCurrent->used + alignment - 1) & ~(alignment - 1);
+		if (kOffset + bytes <= m_pCurrent->size)
+		{
+			m_bytesUsed += kOffset + bytes - m_pCurrent->used;
+			m_highWaterMark = std::max(m_highWaterMark, m_bytesUsed);
+			m_pCurrent->used = kOffset + bytes;
+			return m_pCurrent->data() + kOffset;
+		}
+
+		// Move on to the next retained block, or grow the chain if this was the last
+		if (!m_pCurrent->pNext)
+			m_pCurrent->pNext = new_block(bytes);
+		m_pCurrent = m_pCurrent->pNext;
+	}
+}
+
+const char* FrameArena::format(const char* pFormat, ...)
+{
+	va_list args;
+	va_start(args, pFormat);
+	va_list argsCopy;
+	va_copy(argsCopy, args);
+	const int kLength = vsnprintf(nullptr, 0, pFormat, args);
+	va_end(args);
+
+	char* pString = static_cast<char*>(alloc(std::max(kLength, 0) + 1, 1));
+	vsnprintf(pString, std::max(kLength, 0) + 1, pFormat, argsCopy);
+	va_end(argsCopy);
+	return pString;
+}
+
+void FrameArena::reset()
+{
+	for (Block* pBlock = m_pFirst; pBlock; pBlock = pBlock->pNext)
+		pBlock->used = 0;
+	m_pCurrent = m_pFirst;
+	m_bytesUsed = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+#include <type_traits>
+
+// ========================================================
+// class FrameArena
+// Linear allocator for data that only lives for one frame.
+// Allocations are bumped out of a chain of blocks and all
+// released together by reset(). Blocks are kept across resets,
+// so once the arena has grown to a frame's high-water mark it
+// never goes back to the heap.
+// ========================================================
+
+class FrameArena final
+{
+public:
+	static constexpr size_t kDefaultBlockSize = 64 * 1024;
+
+	explicit FrameArena(size_t blockSize = kDefaultBlockSize) : m_blockSize(blockSize) {}
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+	~FrameArena();
+
+	// Uninitialised memory, valid until the next reset()
+	void* alloc(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Array of kCount elements. No destructors are run, so only trivial types are allowed.
+	template<typename T>
+	T* alloc_array(const u32 kCount)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "FrameArena never runs destructors");
+		return static_cast<T*>(alloc(sizeof(T) * kCount, alignof(T)));
+	}
+
+	// printf into the arena, for labels and other strings that are rebuilt every frame
+	const char* format(const char* pFormat, ...);
+
+	// Release everything allocated since the last reset, keeping the blocks
+	void reset();
+
+	size_t bytes_used() const { return m_bytesUsed; }
+	size_t high_water_mark() const { return m_highWaterMark; }
+	size_t capacity() const { return m_capacity; }
+
+private:
+	struct Block
+	{
+		Block* pNext;
+		size_t size;	// Usable bytes following the header
+		size_t used;
+		u8* data() { return reinterpret_cast<u8*>(this + 1); }
+	};
+
+	Block* new_block(size_t minBytes);
+
+	size_t m_blockSize;
+	Block* m_pFirst = nullptr;
+	Block* m_pCurrent = nullptr;
+	size_t m_bytesUsed = 0;
+	size_t m_highWaterMark = 0;
+	size_t m_capacity = 0;
+};
@@ -1514,6 +1514,29 @@ bool Camera::pointInFrustum(const v3& v) const
 	}
 	return true;
 }
+
+bool Camera::sphereInFrustum(const v3& centre, const float radius) const
+{
+	v4 t(centre.x, centre.y, centre.z, 1.0f);
+	for (int i = 0; i < 6; ++i)
+	{
+		// The planes are normalized as 4D vectors, so scale the radius by the length of the normal
+		const float kNormalLength = v3(planes[i].x, planes[i].y, planes[i].z).Length();
+		if (planes[i].Dot(t) <= -radius * kNormalLength)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+float Camera::projectedSize(const v3& centre, const float radius) const
+{
+	const float kDistance = v3::Distance(eye, centre);
+	if (kDistance <= radius)
+		return 1.0f;
+	return std::min(1.0f, radius / (kDistance * std::tan(fovY * 0.5f)));
+}
 // ========================================================
 
 v3 Camera::rotateAroundAxis(const v3 & vec, const v3 & axis, const float angle)
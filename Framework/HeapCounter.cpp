@@ -0,0 +1,77 @@
+#include "HeapCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Constant initialised, so counting works for allocations made by other static constructors
+static std::atomic<u64> s_allocations{ 0 };
+static std::atomic<u64> s_bytes{ 0 };
+
+HeapCounts heap_counts()
+{
+	HeapCounts counts;
+	counts.allocations = s_allocations.load(std::memory_order_relaxed);
+	counts.bytes = s_bytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+static void* counted_malloc(size_t bytes)
+{
+	s_allocations.fetch_add(1, std::memory_order_relaxed);
+	s_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	return std::malloc(bytes ? bytes : 1);
+}
+
+void* operator new(size_t bytes)
+{
+	void* p = counted_malloc(bytes);
+	if (!p)
+		panicF("operator new : out of memory allocating %zu bytes", bytes);
+	return p;
+}
+
+void* operator new[](size_t bytes)
+{
+	return ::operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+	return counted_malloc(bytes);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+	return counted_malloc(bytes);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
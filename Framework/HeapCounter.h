@@ -0,0 +1,28 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+//================================================================================
+// Heap allocation counter
+// The global operator new and delete are replaced with versions that count
+// every allocation, so code that must not allocate (the per-frame update once
+// it has warmed up) can check that it doesn't. Counts are process-wide and
+// include every thread.
+//================================================================================
+
+struct HeapCounts
+{
+	u64 allocations = 0;	// Calls to operator new
+	u64 bytes = 0;			// Bytes requested by those calls
+};
+
+HeapCounts heap_counts();
+
+// Allocations made between two snapshots
+inline HeapCounts operator-(const HeapCounts& lhs, const HeapCounts& rhs)
+{
+	HeapCounts counts;
+	counts.allocations = lhs.allocations - rhs.allocations;
+	counts.bytes = lhs.bytes - rhs.bytes;
+	return counts;
+}
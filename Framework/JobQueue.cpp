@@ -0,0 +1,308 @@
+#include "JobQueue.h"
+
+// Index of the pool worker running on this thread, so pushes from inside a job go to its own ring
+static thread_local const JobQueue* s_pWorkerQueue = nullptr;
+static thread_local u32 s_workerIndex = 0;
+
+JobQueue::~JobQueue()
+{
+	if (workers.empty())
+		return;
+
+	waitAll();
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		terminating = true;
+	}
+	condition.notify_all();
+	for (auto& worker : workers)
+		worker->thread.join();
+}
+
+void JobQueue::launch(u32 numWorkers)
+{
+	ASSERT(workers.empty()); // Not already launched!
+
+	if (numWorkers == 0)
+		numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	// Share the workers out between the NUMA nodes in contiguous blocks
+	const u32 kNodes = std::max(1u, std::min(numa_node_count(), numWorkers));
+	nodeWorkers.assign(kNodes, std::vector<u32>());
+	workers.reserve(numWorkers);
+	for (u32 i = 0; i < numWorkers; ++i)
+	{
+		workers.emplace_back(new Worker);
+		workers[i]->node = i * kNodes / numWorkers;
+		nodeWorkers[workers[i]->node].push_back(i);
+	}
+
+	// Steal from the same node first, where the data is likely to be local
+	for (u32 i = 0; i < numWorkers; ++i)
+	{
+		Worker& worker = *workers[i];
+		worker.stealOrder.push_back(i);
+		for (u32 j : nodeWorkers[worker.node])
+		{
+			if (j != i)
+				worker.stealOrder.push_back(j);
+		}
+		for (u32 j = 0; j < numWorkers; ++j)
+		{
+			if (workers[j]->node != worker.node)
+				worker.stealOrder.push_back(j);
+		}
+	}
+
+	// Every ring has to exist before any worker starts stealing
+	for (u32 i = 0; i < numWorkers; ++i)
+		workers[i]->thread = std::thread(&JobQueue::workerLoop, this, i);
+}
+
+void JobQueue::pushJob(Job job, JobHandle* pHandle)
+{
+	if (workers.empty())
+	{
+		job();
+		return;
+	}
+
+	if (pHandle)
+		pHandle->pending.fetch_add(1, std::memory_order_relaxed);
+	inFlight.fetch_add(1, std::memory_order_relaxed);
+
+	enqueue(pushTarget(kAnyNumaNode), job, pHandle);
+	wakeWorkers(1);
+}
+
+void JobQueue::pushJobs(Job* pJobs, const u32 kCount, JobHandle* pHandle, const s32 kNode)
+{
+	if (workers.empty())
+	{
+		for (u32 i = 0; i < kCount; ++i)
+		{
+			pJobs[i]();
+			pJobs[i].reset();
+		}
+		return;
+	}
+
+	if (pHandle)
+		pHandle->pending.fetch_add(kCount, std::memory_order_relaxed);
+	inFlight.fetch_add(kCount, std::memory_order_relaxed);
+
+	// Spread the batch across the rings so every worker has something to start on
+	if (kNode != kAnyNumaNode && static_cast<u32>(kNode) < numNodes())
+	{
+		const std::vector<u32>& nodeRings = nodeWorkers[kNode];
+		const u32 kFirstTarget = pushTarget(kNode);
+		for (u32 i = 0; i < kCount; ++i)
+			enqueue(nodeRings[(kFirstTarget + i) % nodeRings.size()], pJobs[i], pHandle);
+	}
+	else
+	{
+		const u32 kFirstTarget = pushTarget(kAnyNumaNode);
+		for (u32 i = 0; i < kCount; ++i)
+			enqueue((kFirstTarget + i) % numWorkers(), pJobs[i], pHandle);
+	}
+	wakeWorkers(kCount);
+}
+
+u32 JobQueue::pushTarget(const s32 kNode)
+{
+	// With a node, the result indexes that node's workers rather than all of them
+	if (kNode != kAnyNumaNode)
+		return nextWorker.fetch_add(1, std::memory_order_relaxed) % nodeWorkers[kNode].size();
+	return (s_pWorkerQueue == this) ? s_workerIndex : nextWorker.fetch_add(1, std::memory_order_relaxed) % numWorkers();
+}
+
+void JobQueue::enqueue(u32 target, Job& job, JobHandle* pHandle)
+{
+	// Counted before it lands in a ring so a worker going to sleep can't miss it
+	queued.fetch_add(1, std::memory_order_release);
+
+	const u32 kNumWorkers = numWorkers();
+	for (u32 i = 0; i < kNumWorkers; ++i)
+	{
+		if (workers[(target + i) % kNumWorkers]->ring.tryPush(job, pHandle))
+			return;
+	}
+
+	// Every ring is full, so the pushing thread does the work itself
+	queued.fetch_sub(1, std::memory_order_relaxed);
+	run(job, pHandle);
+}
+
+void JobQueue::wakeWorkers(const u32 kCount)
+{
+	// Taking the lock orders this wake against a worker that is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	if (kCount > 1)
+		condition.notify_all();
+	else
+		condition.notify_one();
+}
+
+void JobQueue::wait(JobHandle& handle)
+{
+	while (!handle.done())
+	{
+		if (!runOne())
+			std::this_thread::yield();
+	}
+}
+
+void JobQueue::waitAll()
+{
+	while (inFlight.load(std::memory_order_acquire) != 0)
+	{
+		if (!runOne())
+			std::this_thread::yield();
+	}
+}
+
+u32 JobQueue::pickGrain(const u32 kCount, const u32 kGrain) const
+{
+	if (kGrain != 0)
+		return kGrain;
+
+	// Four ranges per thread leaves room for stealing to even out uneven ranges
+	const u32 kRanges = (numWorkers() + 1) * 4;
+	return std::max(1u, (kCount + kRanges - 1) / kRanges);
+}
+
+bool JobQueue::popOrSteal(Job& job, JobHandle*& pHandle)
+{
+	if (queued.load(std::memory_order_acquire) == 0)
+		return false;
+
+	// Workers go through their steal order, other threads start from the next ring along
+	const u32 kNumWorkers = numWorkers();
+	const bool kIsWorker = (s_pWorkerQueue == this);
+	const u32 kStart = kIsWorker ? 0 : nextWorker.load(std::memory_order_relaxed) % kNumWorkers;
+	for (u32 i = 0; i < kNumWorkers; ++i)
+	{
+		const u32 kVictim = kIsWorker ? workers[s_workerIndex]->stealOrder[i] : (kStart + i) % kNumWorkers;
+		if (workers[kVictim]->ring.tryPop(job, pHandle))
+		{
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobQueue::runOne()
+{
+	Job job;
+	JobHandle* pHandle = nullptr;
+	if (!popOrSteal(job, pHandle))
+		return false;
+
+	run(job, pHandle);
+	return true;
+}
+
+void JobQueue::run(Job& job, JobHandle* pHandle)
+{
+	job();
+	job.reset();
+
+	// The handle may be destroyed as soon as its count reaches zero
+	if (pHandle)
+		pHandle->pending.fetch_sub(1, std::memory_order_release);
+	inFlight.fetch_sub(1, std::memory_order_release);
+}
+
+void JobQueue::workerLoop(u32 index)
+{
+	s_pWorkerQueue = this;
+	s_workerIndex = index;
+
+	const u32 kNode = workers[index]->node;
+	if (numNodes() > 1 && !pin_thread_to_numa_node(GetCurrentThread(), kNode))
+		debugF("JobQueue : couldn't pin worker %u to NUMA node %u", index, kNode);
+
+	for (;;)
+	{
+		if (runOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		condition.wait(lock, [this] { return queued.load(std::memory_order_acquire) != 0 || terminating; });
+		if (terminating && queued.load(std::memory_order_acquire) == 0)
+		{
+			break;
+		}
+	}
+}
+
+bool JobRing::tryPush(Job& job, JobHandle* pHandle)
+{
+	u32 pos = enqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = cells[pos & kMask];
+		const u32 kSequence = cell.sequence.load(std::memory_order_acquire);
+		const s32 kDiff = static_cast<s32>(kSequence - pos);
+		if (kDiff == 0)
+		{
+			// The cell is free on this lap - claim it
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.job = std::move(job);
+				cell.pHandle = pHandle;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (kDiff < 0)
+		{
+			return false;	// Full
+		}
+		else
+		{
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool JobRing::tryPop(Job& job, JobHandle*& pHandle)
+{
+	u32 pos = dequeuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = cells[pos & kMask];
+		const u32 kSequence = cell.sequence.load(std::memory_order_acquire);
+		const s32 kDiff = static_cast<s32>(kSequence - (pos + 1));
+		if (kDiff == 0)
+		{
+			// The cell holds a job from this lap - claim it
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				job = std::move(cell.job);
+				pHandle = cell.pHandle;
+				cell.sequence.store(pos + kCapacity, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (kDiff < 0)
+		{
+			return false;	// Empty
+		}
+		else
+		{
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+JobQueue& global_job_queue()
+{
+	static JobQueue s_queue;
+	static std::once_flag s_launched;
+	std::call_once(s_launched, [] { s_queue.launch(); });
+	return s_queue;
+}
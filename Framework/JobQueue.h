@@ -1,87 +1,347 @@
 #pragma once
 
+#include "CommonHeader.h"
+#include "PageAllocator.h"
+
+#include <atomic>
 #include <functional>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <queue>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 
 // ========================================================
-// class JobQueue
+// class Job
+// A callable stored inline, so creating, queueing and running
+// one never touches the heap. Captures must fit kStorageSize.
 // ========================================================
 
-class JobQueue final
+class Job final
 {
 public:
-	typedef std::function<void()> Job;
+	static constexpr u32 kStorageSize = 48;
+
+	Job() {}
+
+	template<typename Fn, typename = typename std::enable_if<!std::is_same<typename std::decay<Fn>::type, Job>::value>::type>
+	Job(Fn&& fn)
+	{
+		typedef typename std::decay<Fn>::type Callable;
+		static_assert(sizeof(Callable) <= kStorageSize, "Job captures too much to be stored inline");
+		static_assert(alignof(Callable) <= alignof(std::max_align_t), "Job capture is over-aligned");
+		new (storage) Callable(std::forward<Fn>(fn));
+		pOps = &OpsFor<Callable>::ops;
+	}
 
-	// Wait for the worker thread to exit.
-	~JobQueue()
+	Job(Job&& other) { take(other); }
+	Job& operator=(Job&& other)
 	{
-		if (worker.joinable())
+		if (this != &other)
 		{
-			waitAll();
-			mutex.lock();
-			terminating = true;
-			condition.notify_one();
-			mutex.unlock();
-			worker.join();
+			reset();
+			take(other);
 		}
+		return *this;
 	}
+	Job(const Job&) = delete;
+	Job& operator=(const Job&) = delete;
+	~Job() { reset(); }
 
-	// Launch the worker thread.
-	void launch()
+	void operator()() { pOps->invoke(storage); }
+	explicit operator bool() const { return pOps != nullptr; }
+
+	void reset()
 	{
-		ASSERT(!worker.joinable()); // Not already launched!
-		worker = std::thread(&JobQueue::queueLoop, this);
+		if (pOps)
+		{
+			pOps->destroy(storage);
+			pOps = nullptr;
+		}
 	}
 
-	// Add a new job to the thread's queue.
-	void pushJob(Job job)
+private:
+	struct Ops
+	{
+		void (*invoke)(void*);
+		void (*move)(void* pDst, void* pSrc);	// Move constructs into pDst and destroys pSrc
+		void (*destroy)(void*);
+	};
+
+	template<typename Callable>
+	struct OpsFor
 	{
-		std::lock_guard<std::mutex> lock(mutex);
-		queue.push(std::move(job));
-		condition.notify_one();
+		static void invoke(void* p) { (*static_cast<Callable*>(p))(); }
+		static void move(void* pDst, void* pSrc)
+		{
+			new (pDst) Callable(std::move(*static_cast<Callable*>(pSrc)));
+			static_cast<Callable*>(pSrc)->~Callable();
+		}
+		static void destroy(void* p) { static_cast<Callable*>(p)->~Callable(); }
+		static const Ops ops;
+	};
+
+	void take(Job& other)
+	{
+		pOps = other.pOps;
+		if (pOps)
+		{
+			pOps->move(storage, other.storage);
+			other.pOps = nullptr;
+		}
 	}
 
-	// Wait until all work items have been completed.
-	void waitAll()
+	alignas(std::max_align_t) u8 storage[kStorageSize];
+	const Ops* pOps = nullptr;
+};
+
+template<typename Callable>
+const Job::Ops Job::OpsFor<Callable>::ops = { &OpsFor<Callable>::invoke, &OpsFor<Callable>::move, &OpsFor<Callable>::destroy };
+
+// ========================================================
+// class JobHandle
+// Counts the outstanding jobs pushed against it. Owned by
+// the caller and must outlive the jobs it tracks.
+// ========================================================
+
+class JobHandle final
+{
+public:
+	JobHandle() {}
+	JobHandle(const JobHandle&) = delete;
+	JobHandle& operator=(const JobHandle&) = delete;
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobQueue;
+	std::atomic<u32> pending{ 0 };
+};
+
+// ========================================================
+// class JobRing
+// Bounded lock-free multi-producer multi-consumer queue
+// (Vyukov's design). Each cell carries a sequence number that
+// says whether it is ready to be written or read on this lap.
+// ========================================================
+
+class JobRing final
+{
+public:
+	static constexpr u32 kCapacity = 4096;		// Must be a power of two
+
+	JobRing()
 	{
-		std::unique_lock<std::mutex> lock(mutex);
-		condition.wait(lock, [this]() { return queue.empty(); });
+		for (u32 i = 0; i < kCapacity; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
 	}
+	JobRing(const JobRing&) = delete;
+	JobRing& operator=(const JobRing&) = delete;
+
+	// Both return false rather than wait when the ring is full or empty
+	bool tryPush(Job& job, JobHandle* pHandle);
+	bool tryPop(Job& job, JobHandle*& pHandle);
 
 private:
-	void queueLoop()
+	static constexpr u32 kMask = kCapacity - 1;
+
+	struct Cell
 	{
-		for (;;)
+		std::atomic<u32> sequence;
+		JobHandle* pHandle = nullptr;
+		Job job;
+	};
+
+	Cell cells[kCapacity];
+	alignas(64) std::atomic<u32> enqueuePos{ 0 };
+	alignas(64) std::atomic<u32> dequeuePos{ 0 };
+};
+
+// ========================================================
+// class JobQueue
+// A pool of worker threads, each with its own job ring. Workers
+// drain their own ring and steal from the others when they run
+// dry, trying workers on their own NUMA node first. Threads that
+// wait on a handle run jobs too, so waiting from inside a job
+// can't deadlock the pool.
+// ========================================================
+
+class JobQueue final
+{
+public:
+	JobQueue() {}
+	JobQueue(const JobQueue&) = delete;
+	JobQueue& operator=(const JobQueue&) = delete;
+
+	// Finish outstanding work and wait for the worker threads to exit.
+	~JobQueue();
+
+	// Launch the worker threads. 0 means one per hardware thread, less the caller's.
+	// On NUMA machines workers are shared out between the nodes and pinned to them.
+	void launch(u32 numWorkers = 0);
+	u32 numWorkers() const { return static_cast<u32>(workers.size()); }
+	u32 numNodes() const { return static_cast<u32>(nodeWorkers.size()); }
+
+	// Add a new job to the pool. Runs inline when no workers have been launched or the rings are full.
+	void pushJob(Job job, JobHandle* pHandle = nullptr);
+
+	// Add kCount jobs at once, moved out of pJobs, with a single wake-up of the workers.
+	// kNode queues them only on that NUMA node's workers.
+	void pushJobs(Job* pJobs, const u32 kCount, JobHandle* pHandle = nullptr, const s32 kNode = kAnyNumaNode);
+
+	// Help run jobs until everything pushed against the handle has completed.
+	void wait(JobHandle& handle);
+
+	// Wait until all work items have been completed.
+	void waitAll();
+
+	// Run one queued job on the calling thread. Returns false if there was nothing to run.
+	bool runOne();
+
+	// Calls fn(first, last) over [begin, end) in ranges of at most kGrain indices and returns once
+	// all have run. kGrain 0 picks a grain that gives each thread a few ranges to balance with.
+	template<typename Fn>
+	void parallel_for(const u32 kBegin, const u32 kEnd, const u32 kGrain, const Fn& fn);
+
+	// As parallel_for, but each node's workers are given the part of the range numa_node_range assigns
+	// to that node, which is where spread page allocations put the matching data.
+	template<typename Fn>
+	void parallel_for_numa(const u32 kBegin, const u32 kEnd, const u32 kGrain, const Fn& fn);
+
+	// Maps each range to a T with map(first, last) and folds the results with reduce(a, b).
+	// Ranges are folded in index order, so the result doesn't depend on scheduling.
+	template<typename T, typename MapFn, typename ReduceFn>
+	T parallel_reduce(const u32 kBegin, const u32 kEnd, const u32 kGrain, const T& identity, const MapFn& map, const ReduceFn& reduce);
+
+private:
+	// Jobs batched on the stack by parallel_for before each bulk push
+	static constexpr u32 kPushBatch = 32;
+
+	struct Worker
+	{
+		JobRing ring;
+		std::thread thread;
+		u32 node = 0;
+		std::vector<u32> stealOrder;	// Every worker, own node first
+	};
+
+	template<typename Fn>
+	void pushRanges(const u32 kBegin, const u32 kEnd, const u32 kStep, const Fn& fn, JobHandle& handle, const s32 kNode);
+
+	u32 pickGrain(const u32 kCount, const u32 kGrain) const;
+	u32 pushTarget(const s32 kNode);
+	void enqueue(u32 target, Job& job, JobHandle* pHandle);
+	void wakeWorkers(const u32 kCount);
+	bool popOrSteal(Job& job, JobHandle*& pHandle);
+	void run(Job& job, JobHandle* pHandle);
+	void workerLoop(u32 index);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::vector<u32>> nodeWorkers;	// Workers pinned to each NUMA node
+	std::atomic<u32> queued{ 0 };		// Jobs sitting in a ring
+	std::atomic<u32> inFlight{ 0 };		// Jobs queued or running
+	std::atomic<u32> nextWorker{ 0 };	// Round-robin target for pushes from outside the pool
+
+	bool terminating = false;
+	std::mutex sleepMutex;
+	std::condition_variable condition;
+};
+
+// The pool shared by mesh import, Kelvinlet evaluation and baking. Launched on first use.
+JobQueue& global_job_queue();
+
+// ========================================================
+// Template implementation
+// ========================================================
+
+template<typename Fn>
+void JobQueue::parallel_for(const u32 kBegin, const u32 kEnd, const u32 kGrain, const Fn& fn)
+{
+	if (kEnd <= kBegin)
+		return;
+
+	const u32 kCount = kEnd - kBegin;
+	const u32 kStep = pickGrain(kCount, kGrain);
+	if (workers.empty() || kCount <= kStep)
+	{
+		fn(kBegin, kEnd);
+		return;
+	}
+
+	// Push every range but the first, which this thread runs itself before helping with the rest
+	JobHandle handle;
+	pushRanges(kBegin + kStep, kEnd, kStep, fn, handle, kAnyNumaNode);
+	fn(kBegin, kBegin + kStep);
+	wait(handle);
+}
+
+template<typename Fn>
+void JobQueue::parallel_for_numa(const u32 kBegin, const u32 kEnd, const u32 kGrain, const Fn& fn)
+{
+	if (numNodes() <= 1 || numNodes() != numa_node_count())
+	{
+		parallel_for(kBegin, kEnd, kGrain, fn);
+		return;
+	}
+	if (kEnd <= kBegin)
+		return;
+
+	// Every range goes to its node, and this thread only helps
+	const u32 kCount = kEnd - kBegin;
+	const u32 kStep = pickGrain(kCount, kGrain);
+	JobHandle handle;
+	for (u32 node = 0; node < numNodes(); ++node)
+	{
+		u32 first, last;
+		numa_node_range(kCount, node, first, last);
+		pushRanges(kBegin + first, kBegin + last, kStep, fn, handle, static_cast<s32>(node));
+	}
+	wait(handle);
+}
+
+template<typename Fn>
+void JobQueue::pushRanges(const u32 kBegin, const u32 kEnd, const u32 kStep, const Fn& fn, JobHandle& handle, const s32 kNode)
+{
+	Job batch[kPushBatch];
+	u32 batched = 0;
+	for (u32 first = kBegin; first < kEnd; first += kStep)
+	{
+		const u32 kLast = first + std::min(kStep, kEnd - first);
+		batch[batched++] = Job([&fn, first, kLast]() { fn(first, kLast); });
+		if (batched == kPushBatch)
 		{
-			Job job;
-			{
-				std::unique_lock<std::mutex> lock(mutex);
-				condition.wait(lock, [this] { return !queue.empty() || terminating; });
-				if (terminating)
-				{
-					break;
-				}
-				job = queue.front();
-			}
-
-			job();
-
-			{
-				std::lock_guard<std::mutex> lock(mutex);
-				queue.pop();
-				condition.notify_one();
-			}
+			pushJobs(batch, batched, &handle, kNode);
+			batched = 0;
 		}
 	}
+	if (batched > 0)
+		pushJobs(batch, batched, &handle, kNode);
+}
 
-	bool terminating = false;
+template<typename T, typename MapFn, typename ReduceFn>
+T JobQueue::parallel_reduce(const u32 kBegin, const u32 kEnd, const u32 kGrain, const T& identity, const MapFn& map, const ReduceFn& reduce)
+{
+	if (kEnd <= kBegin)
+		return identity;
 
-	std::thread worker;
-	std::queue<Job> queue;
-	std::mutex mutex;
-	std::condition_variable condition;
-};
+	const u32 kCount = kEnd - kBegin;
+	const u32 kStep = pickGrain(kCount, kGrain);
+	const u32 kRanges = (kCount + kStep - 1) / kStep;
+
+	std::vector<T> partials(kRanges, identity);
+	parallel_for(0, kRanges, 1, [&](u32 firstRange, u32 lastRange)
+	{
+		for (u32 r = firstRange; r < lastRange; ++r)
+		{
+			const u32 kFirst = kBegin + r * kStep;
+			partials[r] = map(kFirst, kFirst + std::min(kStep, kEnd - kFirst));
+		}
+	});
 
+	T result = identity;
+	for (const T& partial : partials)
+		result = reduce(result, partial);
+	return result;
+}
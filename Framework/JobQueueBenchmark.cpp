@@ -0,0 +1,152 @@
+#include "JobQueueBenchmark.h"
+#include "JobQueue.h"
+
+#include <chrono>
+#include <queue>
+
+// The queue JobQueue replaced, kept as the baseline: one worker and a std::function per job,
+// copied out of the queue and popped after it has run
+class LegacyJobQueue final
+{
+public:
+	typedef std::function<void()> LegacyJob;
+
+	~LegacyJobQueue()
+	{
+		if (worker.joinable())
+		{
+			waitAll();
+			mutex.lock();
+			terminating = true;
+			condition.notify_one();
+			mutex.unlock();
+			worker.join();
+		}
+	}
+
+	void launch()
+	{
+		worker = std::thread(&LegacyJobQueue::queueLoop, this);
+	}
+
+	void pushJob(LegacyJob job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push(std::move(job));
+		condition.notify_one();
+	}
+
+	void waitAll()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return queue.empty(); });
+	}
+
+private:
+	void queueLoop()
+	{
+		for (;;)
+		{
+			LegacyJob job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return !queue.empty() || terminating; });
+				if (terminating)
+				{
+					break;
+				}
+				job = queue.front();
+			}
+
+			job();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.pop();
+				condition.notify_one();
+			}
+		}
+	}
+
+	bool terminating = false;
+
+	std::thread worker;
+	std::queue<LegacyJob> queue;
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+// A capture about the size of an evaluation job's: a destination and a few parameters
+struct BenchmarkPayload
+{
+	std::atomic<u64>* pSum;
+	u64 a, b, c, d;
+
+	void operator()() const { pSum->fetch_add(a + b + c + d, std::memory_order_relaxed); }
+};
+
+typedef std::chrono::high_resolution_clock BenchmarkClock;
+
+static f64 ns_per_job(BenchmarkClock::time_point start, const u32 kJobs)
+{
+	return std::chrono::duration<f64, std::nano>(BenchmarkClock::now() - start).count() / kJobs;
+}
+
+JobQueueBenchmarkResult run_job_queue_benchmark(const u32 kJobs)
+{
+	JobQueueBenchmarkResult result;
+	result.numJobs = kJobs;
+
+	std::atomic<u64> sum{ 0 };
+	const u64 kExpected = static_cast<u64>(kJobs) * 10;
+
+	// Baseline
+	{
+		LegacyJobQueue legacy;
+		legacy.launch();
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (u32 i = 0; i < kJobs; ++i)
+			legacy.pushJob(BenchmarkPayload{ &sum, 1, 2, 3, 4 });
+		legacy.waitAll();
+		result.legacyNsPerJob = ns_per_job(start, kJobs);
+	}
+	ASSERT(sum.load() == kExpected);
+
+	JobQueue& queue = global_job_queue();
+	result.numWorkers = queue.numWorkers();
+
+	// One push per job
+	sum = 0;
+	{
+		JobHandle handle;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (u32 i = 0; i < kJobs; ++i)
+			queue.pushJob(BenchmarkPayload{ &sum, 1, 2, 3, 4 }, &handle);
+		queue.wait(handle);
+		result.singleNsPerJob = ns_per_job(start, kJobs);
+	}
+	ASSERT(sum.load() == kExpected);
+
+	// Batches of 64
+	sum = 0;
+	{
+		const u32 kBatch = 64;
+		Job batch[kBatch];
+		JobHandle handle;
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (u32 first = 0; first < kJobs; first += kBatch)
+		{
+			const u32 kCount = std::min(kBatch, kJobs - first);
+			for (u32 i = 0; i < kCount; ++i)
+				batch[i] = Job(BenchmarkPayload{ &sum, 1, 2, 3, 4 });
+			queue.pushJobs(batch, kCount, &handle);
+		}
+		queue.wait(handle);
+		result.batchedNsPerJob = ns_per_job(start, kJobs);
+	}
+	ASSERT(sum.load() == kExpected);
+
+	debugF("JobQueue benchmark, %u jobs : legacy %.1f ns/job, pushJob %.1f ns/job, pushJobs %.1f ns/job (%u workers)",
+		kJobs, result.legacyNsPerJob, result.singleNsPerJob, result.batchedNsPerJob, result.numWorkers);
+	return result;
+}
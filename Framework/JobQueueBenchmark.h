@@ -0,0 +1,21 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+//================================================================================
+// JobQueue micro-benchmark
+// Times pushing and running kJobs small jobs through the original single worker
+// std::function queue and through JobQueue, one push at a time and in batches.
+//================================================================================
+
+struct JobQueueBenchmarkResult
+{
+	u32 numJobs = 0;
+	u32 numWorkers = 0;
+	f64 legacyNsPerJob = 0.0;		// Single worker, mutex + condition variable, std::function
+	f64 singleNsPerJob = 0.0;		// JobQueue::pushJob
+	f64 batchedNsPerJob = 0.0;		// JobQueue::pushJobs
+};
+
+// Runs on the shared job queue, so call it while nothing else is using the pool
+JobQueueBenchmarkResult run_job_queue_benchmark(const u32 kJobs = 100000);
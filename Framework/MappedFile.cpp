@@ -0,0 +1,122 @@
+#include "MappedFile.h"
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open_read(const char* pFilename)
+{
+	ASSERT(!is_open());
+
+	m_hFile = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		errorF("MappedFile : could not open %s", pFilename);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_hFile, &size);
+	m_size = static_cast<u64>(size.QuadPart);
+	m_writable = false;
+
+	m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_hMapping)
+	{
+		errorF("MappedFile : could not map %s", pFilename);
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::create(const char* pFilename, const u64 kSize)
+{
+	ASSERT(!is_open() && kSize > 0);
+
+	m_hFile = CreateFileA(pFilename, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		errorF("MappedFile : could not create %s", pFilename);
+		return false;
+	}
+
+	m_size = kSize;
+	m_writable = true;
+
+	// Mapping with an explicit size extends the file to that size
+	m_hMapping = CreateFileMappingA(m_hFile, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(kSize >> 32), static_cast<DWORD>(kSize & 0xFFFFFFFF), nullptr);
+	if (!m_hMapping)
+	{
+		errorF("MappedFile : could not map %s", pFilename);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_hMapping)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_size = 0;
+}
+
+MappedView MappedFile::map_view(const u64 kOffset, const u64 kBytes) const
+{
+	ASSERT(is_open() && kOffset + kBytes <= m_size);
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	// Views must begin on an allocation granularity boundary
+	const u64 kBase = kOffset - (kOffset % info.dwAllocationGranularity);
+
+	const u64 kMappedBytes = kBytes + (kOffset - kBase);
+	void* pBase = MapViewOfFile(m_hMapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+		static_cast<DWORD>(kBase >> 32), static_cast<DWORD>(kBase & 0xFFFFFFFF), static_cast<SIZE_T>(kMappedBytes));
+	if (!pBase)
+	{
+		errorF("MappedFile : could not map %llu bytes at offset %llu (error %lu)", kBytes, kOffset, GetLastError());
+		return MappedView();
+	}
+
+	MappedView view;
+	view.pBase = pBase;
+	view.pData = static_cast<u8*>(pBase) + (kOffset - kBase);
+	view.bytes = kBytes;
+	view.mappedBytes = kMappedBytes;
+	return view;
+}
+
+void MappedFile::unmap_view(MappedView& rView)
+{
+	if (rView.pBase)
+	{
+		UnmapViewOfFile(rView.pBase);
+		rView = MappedView();
+	}
+}
+
+void MappedFile::prefetch_view(const MappedView& rView)
+{
+	if (!rView.pBase)
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = rView.pBase;
+	range.NumberOfBytes = static_cast<SIZE_T>(rView.mappedBytes);
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+//================================================================================
+// MappedView
+// A window of a mapped file. pData points at the requested offset, which may sit
+// past pBase because views have to start on an allocation granularity boundary.
+//================================================================================
+struct MappedView
+{
+	void* pBase = nullptr;
+	u8* pData = nullptr;
+	u64 bytes = 0;
+	u64 mappedBytes = 0;
+};
+
+//================================================================================
+// MappedFile
+// Memory mapping of a file on disk that is accessed one view at a time, so only
+// the windows currently mapped need to be resident.
+//================================================================================
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open_read(const char* pFilename);
+	bool create(const char* pFilename, const u64 kSize);	// Creates or truncates the file to kSize bytes, read/write
+	void close();
+
+	u64 size() const { return m_size; }
+	bool is_open() const { return m_hMapping != nullptr; }
+
+	// Maps [offset, offset + bytes). The view stays valid until unmapped, even after close().
+	// On failure the view is empty, with pData null.
+	MappedView map_view(const u64 kOffset, const u64 kBytes) const;
+	static void unmap_view(MappedView& rView);
+
+	// Asks the OS to start paging a view in while the caller works on something else
+	static void prefetch_view(const MappedView& rView);
+
+private:
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE m_hMapping = nullptr;
+	u64 m_size = 0;
+	bool m_writable = false;
+};
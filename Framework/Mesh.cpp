@@ -1,9 +1,13 @@
 
 #include "Mesh.h"
+#include "MeshProcessing.h"
+#include "Timer.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tinyobjloader/tiny_obj_loader.h"
 
+#include <unordered_map>
+
 //==================================
 // Mesh Class Implementation
 //==================================
@@ -19,25 +23,41 @@ Mesh::~Mesh()
 }
 
 Mesh::Mesh(Mesh&& other) :
-	m_vertices(other.m_vertices),
-	m_pVertexBuffer(nullptr),
-	m_pIndexBuffer(nullptr),
-	m_pVertexStructuredBuffer(nullptr),
-	m_pVertexStructuredBufferSRV(nullptr),
+	m_vertices(std::move(other.m_vertices)),
+	m_positions(std::move(other.m_positions)),
+	m_tangentFrames(std::move(other.m_tangentFrames)),
+	m_quantizedPositions(std::move(other.m_quantizedPositions)),
+	m_quantizeOrigin(other.m_quantizeOrigin),
+	m_quantizeScale(other.m_quantizeScale),
+	m_bounds(other.m_bounds),
+	m_chunkBounds(std::move(other.m_chunkBounds)),
+	m_adjacency(std::move(other.m_adjacency)),
+	m_submeshes(std::move(other.m_submeshes)),
+	m_proxies(std::move(other.m_proxies)),
 	m_numVertices(other.m_numVertices),
 	m_numIndices(other.m_numIndices),
-	m_name(other.m_name)
+	m_name(std::move(other.m_name)),
+	m_pVertexBuffer(nullptr),
+	m_pIndexBuffer(nullptr),
+	m_pPositionBuffer(nullptr),
+	m_pPositionBufferSRV(nullptr),
+	m_pTangentFrameBuffer(nullptr),
+	m_pTangentFrameBufferSRV(nullptr)
 {
 	// Take ownership of the other's contents
 	m_pVertexBuffer = other.m_pVertexBuffer;
 	m_pIndexBuffer = other.m_pIndexBuffer;
-	m_pVertexStructuredBuffer = other.m_pVertexStructuredBuffer;
-	m_pVertexStructuredBufferSRV = other.m_pVertexStructuredBufferSRV;
+	m_pPositionBuffer = other.m_pPositionBuffer;
+	m_pPositionBufferSRV = other.m_pPositionBufferSRV;
+	m_pTangentFrameBuffer = other.m_pTangentFrameBuffer;
+	m_pTangentFrameBufferSRV = other.m_pTangentFrameBufferSRV;
 	// Prevent multiple attempts to free resources
 	other.m_pVertexBuffer = nullptr;
 	other.m_pIndexBuffer = nullptr;
-	other.m_pVertexStructuredBuffer = nullptr;
-	other.m_pVertexStructuredBufferSRV = nullptr;
+	other.m_pPositionBuffer = nullptr;
+	other.m_pPositionBufferSRV = nullptr;
+	other.m_pTangentFrameBuffer = nullptr;
+	other.m_pTangentFrameBufferSRV = nullptr;
 }
 
 Mesh& Mesh::operator=(Mesh&& other)
@@ -46,26 +66,40 @@ Mesh& Mesh::operator=(Mesh&& other)
 	{
 		// Release this object's old resources
 		release();
-		// Copy other object into this one
-		m_vertices = other.m_vertices;
+		// Move the other object's contents into this one
+		m_vertices = std::move(other.m_vertices);
+		m_positions = std::move(other.m_positions);
+		m_tangentFrames = std::move(other.m_tangentFrames);
+		m_quantizedPositions = std::move(other.m_quantizedPositions);
+		m_quantizeOrigin = other.m_quantizeOrigin;
+		m_quantizeScale = other.m_quantizeScale;
+		m_bounds = other.m_bounds;
+		m_chunkBounds = std::move(other.m_chunkBounds);
+		m_adjacency = std::move(other.m_adjacency);
+		m_submeshes = std::move(other.m_submeshes);
+		m_proxies = std::move(other.m_proxies);
 		m_numVertices = other.m_numVertices;
 		m_numIndices = other.m_numIndices;
-		m_name = other.m_name;
+		m_name = std::move(other.m_name);
 		m_pVertexBuffer = other.m_pVertexBuffer;
 		m_pIndexBuffer = other.m_pIndexBuffer;
-		m_pVertexStructuredBuffer = other.m_pVertexStructuredBuffer;
-		m_pVertexStructuredBufferSRV = other.m_pVertexStructuredBufferSRV;
+		m_pPositionBuffer = other.m_pPositionBuffer;
+		m_pPositionBufferSRV = other.m_pPositionBufferSRV;
+		m_pTangentFrameBuffer = other.m_pTangentFrameBuffer;
+		m_pTangentFrameBufferSRV = other.m_pTangentFrameBufferSRV;
 		// Prevent multiple attempts to free resources
 		other.m_pVertexBuffer = nullptr;
 		other.m_pIndexBuffer = nullptr;
-		other.m_pVertexStructuredBuffer = nullptr;
-		other.m_pVertexStructuredBufferSRV = nullptr;
+		other.m_pPositionBuffer = nullptr;
+		other.m_pPositionBufferSRV = nullptr;
+		other.m_pTangentFrameBuffer = nullptr;
+		other.m_pTangentFrameBufferSRV = nullptr;
 	}
 
 	return *this;
 }
 
-void Mesh::init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, const u32 kNumVerts, const u16* pIndices, const u32 kNumIndices, const std::string& meshName)
+void Mesh::init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, const u32 kNumVerts, const u32* pIndices, const u32 kNumIndices, const std::string& meshName)
 {
 	ASSERT(!m_pVertexBuffer && !m_pIndexBuffer);
 
@@ -76,6 +110,18 @@ void Mesh::init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, cons
 		for (size_t i = 0; i < kNumVerts; ++i)
 			m_vertices[i] = pVertices[i];
 
+		// Split out the streams read by Kelvinlet evaluation
+		m_positions.resize(kNumVerts);
+		m_tangentFrames.resize(kNumVerts);
+		for (size_t i = 0; i < kNumVerts; ++i)
+		{
+			m_positions[i] = pVertices[i].pos;
+			m_tangentFrames[i].normal = pVertices[i].normal;
+			m_tangentFrames[i].tangent = pVertices[i].tangent;
+		}
+
+		compute_mesh_bounds(m_positions.data(), kNumVerts, m_bounds, m_chunkBounds);
+
 		// Create a vertex buffer
 		D3D11_BUFFER_DESC vb_desc = {};
 		vb_desc.ByteWidth = sizeof(MeshVertex) * kNumVerts;
@@ -88,25 +134,34 @@ void Mesh::init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, cons
 		HRESULT hr = pDevice->CreateBuffer(&vb_desc, &vb_data, &m_pVertexBuffer);
 		ASSERT(!FAILED(hr));
 
-		D3D11_SUBRESOURCE_DATA vsb_data = {};
-		vsb_data.pSysMem = pVertices;
-		vsb_data.SysMemPitch = 0;
-		vsb_data.SysMemSlicePitch = 0;
-
-		// Create a vertex structured buffer for use in other shaders
-		m_pVertexStructuredBuffer =
-			create_default_structured_buffer<MeshVertex>(pDevice, kNumVerts, &vsb_data);
-
-		// Create an SRV to the vertex structured buffer
-		m_pVertexStructuredBufferSRV = 
-			create_structured_buffer_SRV(pDevice, kNumVerts, m_pVertexStructuredBuffer);
+		D3D11_SUBRESOURCE_DATA psb_data = {};
+		psb_data.pSysMem = m_positions.data();
+		psb_data.SysMemPitch = 0;
+		psb_data.SysMemSlicePitch = 0;
+
+		// Create a position structured buffer for use in other shaders
+		m_pPositionBuffer =
+			create_default_structured_buffer<v3>(pDevice, kNumVerts, &psb_data);
+		m_pPositionBufferSRV =
+			create_structured_buffer_SRV(pDevice, kNumVerts, m_pPositionBuffer);
+
+		D3D11_SUBRESOURCE_DATA tsb_data = {};
+		tsb_data.pSysMem = m_tangentFrames.data();
+		tsb_data.SysMemPitch = 0;
+		tsb_data.SysMemSlicePitch = 0;
+
+		// Create a tangent frame structured buffer for use in other shaders
+		m_pTangentFrameBuffer =
+			create_default_structured_buffer<MeshTangentFrame>(pDevice, kNumVerts, &tsb_data);
+		m_pTangentFrameBufferSRV =
+			create_structured_buffer_SRV(pDevice, kNumVerts, m_pTangentFrameBuffer);
 	}
 
 	// Create an index buffer
 	if (pIndices)
 	{
 		D3D11_BUFFER_DESC ib_desc = {};
-		ib_desc.ByteWidth = sizeof(u16) * kNumIndices;
+		ib_desc.ByteWidth = sizeof(u32) * kNumIndices;
 		ib_desc.Usage = D3D11_USAGE_IMMUTABLE;
 		ib_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 
@@ -115,11 +170,79 @@ void Mesh::init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, cons
 
 		HRESULT hr = pDevice->CreateBuffer(&ib_desc, &ib_data, &m_pIndexBuffer);
 		ASSERT(!FAILED(hr));
+
+		if (pVertices)
+			compute_vertex_adjacency(pIndices, kNumIndices, kNumVerts, m_adjacency);
 	}
 
 	m_numVertices = kNumVerts;
 	m_numIndices = kNumIndices;
 	m_name = meshName;
+
+	// By default the whole index buffer is a single submesh
+	MeshSubmesh submesh;
+	submesh.name = meshName;
+	submesh.firstIndex = 0;
+	submesh.indexCount = kNumIndices;
+	m_submeshes.assign(1, submesh);
+}
+
+// Frees CPU copies the GPU buffers already hold. Evaluation streams are only needed for
+// evaluating or baking on the CPU, and adjacency only by normal recomputation.
+void Mesh::release_cpu_data(const u32 flags)
+{
+	if (flags & kMeshCpuVertices)
+		std::vector<MeshVertex>().swap(m_vertices);
+	if (flags & kMeshCpuEvalStreams)
+	{
+		PageVector<v3>().swap(m_positions);
+		PageVector<MeshTangentFrame>().swap(m_tangentFrames);
+		std::vector<MeshQuantizedPosition>().swap(m_quantizedPositions);
+		std::vector<MeshProxy>().swap(m_proxies);
+	}
+	if (flags & kMeshCpuAdjacency)
+	{
+		std::vector<u32>().swap(m_adjacency.offsets);
+		std::vector<u32>().swap(m_adjacency.neighbours);
+	}
+}
+
+MemoryUsage Mesh::memory_usage() const
+{
+	MemoryUsage usage;
+	usage.cpuBytes = m_vertices.capacity() * sizeof(MeshVertex) +
+		m_positions.capacity() * sizeof(v3) +
+		m_tangentFrames.capacity() * sizeof(MeshTangentFrame) +
+		m_quantizedPositions.capacity() * sizeof(MeshQuantizedPosition) +
+		m_chunkBounds.capacity() * sizeof(MeshBounds) +
+		(m_adjacency.offsets.capacity() + m_adjacency.neighbours.capacity()) * sizeof(u32) +
+		m_submeshes.capacity() * sizeof(MeshSubmesh) +
+		m_proxies.capacity() * sizeof(MeshProxy);
+	for (const MeshProxy& proxy : m_proxies)
+	{
+		usage.cpuBytes += proxy.positions.capacity() * sizeof(v3) + proxy.indices.capacity() * sizeof(u32) +
+			proxy.bindings.capacity() * sizeof(MeshProxyBinding);
+	}
+
+	if (m_pVertexBuffer)
+		usage.gpuBytes += static_cast<u64>(m_numVertices) * sizeof(MeshVertex);
+	if (m_pIndexBuffer)
+		usage.gpuBytes += static_cast<u64>(m_numIndices) * sizeof(u32);
+	if (m_pPositionBuffer)
+		usage.gpuBytes += static_cast<u64>(m_numVertices) * sizeof(v3);
+	if (m_pTangentFrameBuffer)
+		usage.gpuBytes += static_cast<u64>(m_numVertices) * sizeof(MeshTangentFrame);
+	return usage;
+}
+
+void Mesh::set_submeshes(const std::vector<MeshSubmesh>& submeshes)
+{
+	m_submeshes = submeshes;
+}
+
+void Mesh::set_proxies(std::vector<MeshProxy>&& proxies)
+{
+	m_proxies = std::move(proxies);
 }
 
 void Mesh::bind(ID3D11DeviceContext* pContext) const
@@ -133,13 +256,14 @@ void Mesh::bind(ID3D11DeviceContext* pContext) const
 
 	if (m_pIndexBuffer)
 	{
-		pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		pContext->IASetIndexBuffer(m_pIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 	}
 }
 
-void Mesh::bind_structured_VB_SRV(ID3D11DeviceContext* pContext, u32 slot) const
+void Mesh::bind_eval_streams_SRV(ID3D11DeviceContext* pContext, u32 positionSlot, u32 tangentFrameSlot) const
 {
-	pContext->CSSetShaderResources(slot, 1, &m_pVertexStructuredBufferSRV);
+	pContext->CSSetShaderResources(positionSlot, 1, &m_pPositionBufferSRV);
+	pContext->CSSetShaderResources(tangentFrameSlot, 1, &m_pTangentFrameBufferSRV);
 }
 
 void Mesh::draw(ID3D11DeviceContext* pContext) const
@@ -154,90 +278,53 @@ void Mesh::draw(ID3D11DeviceContext* pContext) const
 	}
 }
 
+void Mesh::draw_submesh(ID3D11DeviceContext* pContext, u32 submesh) const
+{
+	ASSERT(m_pIndexBuffer && submesh < m_submeshes.size());
+	pContext->DrawIndexed(m_submeshes[submesh].indexCount, m_submeshes[submesh].firstIndex, 0);
+}
+
 void Mesh::release()
 {
 	SAFE_RELEASE(m_pVertexBuffer);
 	SAFE_RELEASE(m_pIndexBuffer);
-	SAFE_RELEASE(m_pVertexStructuredBuffer);
-	SAFE_RELEASE(m_pVertexStructuredBufferSRV);
+	SAFE_RELEASE(m_pPositionBuffer);
+	SAFE_RELEASE(m_pPositionBufferSRV);
+	SAFE_RELEASE(m_pTangentFrameBuffer);
+	SAFE_RELEASE(m_pTangentFrameBufferSRV);
 }
 
-// Computes tangents using Lengyel's method for an indexed triangle list.
-// Tangents are computed as a 4d vector where w stores the sign need to reconstruct a bitangent in the shader.
-void compute_tangents_lengyel(MeshVertex* pVertices, u32 kVertices, const u16* pIndices, u32 kIndices)
+// Builds a 16-bit position stream over the mesh's bounding box.
+// Halves position bandwidth at the cost of an error of at most half a step per axis.
+void Mesh::quantize_positions()
 {
-	using namespace DirectX;
-
-	const u32 kTris = kIndices / 3;
-
-	// Tangents are accumulated so we need some space to work in.
-	v3* buffer = new v3[kVertices * 2];
-	memset(buffer, 0, sizeof(v3) * kVertices * 2);
-	
-	// offsets into the buffer;
-	v3* tan1 = buffer;
-	v3* tan2 = buffer + kVertices;
-
-	// Step through each triangle.
-	for (u32 iTri = 0; iTri < kTris; ++iTri)
-	{
-		u16 i1 = pIndices[0];
-		u16 i2 = pIndices[1];
-		u16 i3 = pIndices[2];
-
-		v3 p1 = pVertices[i1].pos;
-		v3 p2 = pVertices[i2].pos;
-		v3 p3 = pVertices[i3].pos;
-
-		v2 w1 = pVertices[i1].tex;
-		v2 w2 = pVertices[i2].tex;
-		v2 w3 = pVertices[i3].tex;
-
-		f32 x1 = p2.x - p1.x;
-		f32 x2 = p3.x - p1.x;
-		f32 y1 = p2.y - p1.y;
-		f32 y2 = p3.y - p1.y;
-		f32 z1 = p2.z - p1.z;
-		f32 z2 = p3.z - p1.z;
-
-		f32 s1 = w2.x - w1.x;
-		f32 s2 = w3.x - w1.x;
-		f32 t1 = w2.y - w1.y;
-		f32 t2 = w3.y - w1.y;
-
-		f32 r = 1.f / (s1 * t2 - s2 * t1);
-		v3 sdir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-		v3 tdir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-		// accumulate the tangents
-		tan1[i1] += sdir;
-		tan1[i2] += sdir;
-		tan1[i3] += sdir;
-
-		tan2[i1] += tdir;
-		tan2[i2] += tdir;
-		tan2[i3] += tdir;
-
-		pIndices += 3;
-	}
-
-	// Step through each vertex.
-	for (u32 i = 0; i < kVertices; ++i)
+	if (m_positions.empty())
+		return;
+
+	const v3 vMin = m_bounds.aabbMin;
+	const v3 vMax = m_bounds.aabbMax;
+	const f32 kSteps = 65535.0f;
+	v3 extent = vMax - vMin;
+	m_quantizeOrigin = vMin;
+	m_quantizeScale = v3(extent.x > 0.0f ? extent.x / kSteps : 0.0f,
+		extent.y > 0.0f ? extent.y / kSteps : 0.0f,
+		extent.z > 0.0f ? extent.z / kSteps : 0.0f);
+
+	m_quantizedPositions.resize(m_positions.size());
+	for (size_t i = 0; i < m_positions.size(); ++i)
 	{
-		XMVECTOR n = XMLoadFloat3(&pVertices[i].normal);
-		XMVECTOR t1 = XMLoadFloat3(&tan1[i]);
-		XMVECTOR t2 = XMLoadFloat3(&tan2[i]);
-		
-		// Gram-Schmidt Orthogonalization
-		XMVECTOR tangent = XMVector3Normalize(t1 - n * XMVector3Dot(n, t1));
-		XMVECTOR bitangent = XMVector3Dot(XMVector3Cross(n, t1), t2);
-
-		XMStoreFloat4(&pVertices[i].tangent, tangent);
-		pVertices[i].tangent.w = XMVectorGetX(bitangent) < 0.f ? -1.0f : 1.0f; // sign
+		v3 t = m_positions[i] - vMin;
+		MeshQuantizedPosition& q = m_quantizedPositions[i];
+		q.x = static_cast<u16>(extent.x > 0.0f ? t.x / extent.x * kSteps + 0.5f : 0.0f);
+		q.y = static_cast<u16>(extent.y > 0.0f ? t.y / extent.y * kSteps + 0.5f : 0.0f);
+		q.z = static_cast<u16>(extent.z > 0.0f ? t.z / extent.z * kSteps + 0.5f : 0.0f);
 	}
+}
 
-	// cleanup the temp buffer
-	delete[] buffer;
+v3 Mesh::dequantize_position(u32 i) const
+{
+	const MeshQuantizedPosition& q = m_quantizedPositions[i];
+	return m_quantizeOrigin + v3(q.x, q.y, q.z) * m_quantizeScale;
 }
 
 void create_mesh_cube(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfSize, const std::string& meshName)
@@ -314,7 +401,7 @@ void create_mesh_cube(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfSize
 	const u32 kVertices = sizeof(verts) / sizeof(verts[0]);
 
 	// and indices
-	const u16 indices[] = {
+	const u32 indices[] = {
 		0,  1,  2,  0,  2,  3,   // front
 		4,  5,  6,  4,  6,  7,   // right
 		8,  9,  10, 8,  10, 11,  // back
@@ -362,7 +449,7 @@ void create_mesh_quad_xy(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfS
 	const u32 kVertices = sizeof(verts) / sizeof(verts[0]);
 
 	// and indices
-	const u16 indices[] = {
+	const u32 indices[] = {
 		0,  1,  2, 
 		0,  2,  3
 	};
@@ -374,14 +461,34 @@ void create_mesh_quad_xy(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfS
 	rMeshOut.init_buffers(pDevice, verts, kVertices, indices, kIndices, meshName);
 }
 
+// Identifies a unique OBJ vertex by its position/normal/texcoord attribute indices
+struct ObjIndexKey
+{
+	int v, n, t;
+	bool operator==(const ObjIndexKey& rhs) const { return v == rhs.v && n == rhs.n && t == rhs.t; }
+};
+
+struct ObjIndexKeyHash
+{
+	size_t operator()(const ObjIndexKey& k) const
+	{
+		return (static_cast<size_t>(k.v) * 73856093u) ^ (static_cast<size_t>(k.n) * 19349663u) ^ (static_cast<size_t>(k.t) * 83492791u);
+	}
+};
+
 void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFilename, const char* mtlBaseDir, 
-	const f32 kScale, const std::string& meshName)
+	const f32 kScale, const std::string& meshName, const u32 importFlags)
 {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 
+	// All shapes are merged into one vertex/index buffer, with a submesh per shape
 	std::vector<MeshVertex> meshVertices;
+	std::vector<u32> meshIndices;
+	std::vector<MeshSubmesh> submeshes;
+	std::unordered_map<ObjIndexKey, u32, ObjIndexKeyHash> vertexLookup;
+	bool missingNormals = false;
 
 	std::string err;
 	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, pFilename, mtlBaseDir);
@@ -397,7 +504,10 @@ void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFi
 	// Loop over shapes
 	for (size_t s = 0; s < shapes.size(); s++) {
 
-		meshVertices.clear();
+		MeshSubmesh submesh;
+		submesh.name = shapes[s].name;
+		submesh.firstIndex = static_cast<u32>(meshIndices.size());
+		submesh.materialId = shapes[s].mesh.material_ids.empty() ? -1 : shapes[s].mesh.material_ids[0];
 
 		// Loop over faces(polygon)
 		size_t index_offset = 0;
@@ -413,14 +523,36 @@ void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFi
 
 				// access to vertex
 				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + reorder[v]];
+
+				// Faces sharing an OBJ vertex share a mesh vertex
+				ObjIndexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+				auto found = vertexLookup.find(key);
+				if (found != vertexLookup.end())
+				{
+					meshIndices.push_back(found->second);
+					continue;
+				}
+
 				tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
 				tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
 				tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-				tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-				tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-				tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-				tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-				tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+
+				// A vertex without a normal is left with a zero one for compute_missing_normals to fill in
+				tinyobj::real_t nx = 0, ny = 0, nz = 0;
+				if (idx.normal_index >= 0)
+				{
+					nx = attrib.normals[3 * idx.normal_index + 0];
+					ny = attrib.normals[3 * idx.normal_index + 1];
+					nz = attrib.normals[3 * idx.normal_index + 2];
+				}
+				else
+					missingNormals = true;
+				tinyobj::real_t tx = 0, ty = 0;
+				if (idx.texcoord_index >= 0)
+				{
+					tx = attrib.texcoords[2 * idx.texcoord_index + 0];
+					ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+				}
 
 				// Optional: vertex colors
 				// tinyobj::real_t red = attrib.colors[3*idx.vertex_index+0];
@@ -437,6 +569,9 @@ void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFi
 				// Flip UV y to match DX texture flipping.
 				v2 uv(tx,-ty);
 
+				u32 newIndex = static_cast<u32>(meshVertices.size());
+				vertexLookup.insert({ key, newIndex });
+				meshIndices.push_back(newIndex);
 				meshVertices.push_back(MeshVertex(pos, 0xFFFFFFFF, normal, uv));
 			}
 			index_offset += fv;
@@ -445,16 +580,45 @@ void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFi
 			shapes[s].mesh.material_ids[f];
 		}
 
-		// Make a sequential index buffer so we can use the tangent calculation function
-		std::vector<u16> m_indices(meshVertices.size());
-		for (u32 i = 0; i < meshVertices.size(); ++i)
-		{
-			m_indices[i] = i;
-		}
+		submesh.indexCount = static_cast<u32>(meshIndices.size()) - submesh.firstIndex;
+		submeshes.push_back(submesh);
+	}
+
+	if (meshVertices.empty())
+	{
+		panicF("OBJ %s contains no faces", pFilename);
+	}
+
+	Timer timer;
+	timer.Start();
+
+	// Lay vertices out spatially, then order each submesh's triangles for the vertex cache
+	if (importFlags & kMeshImportReorderMorton)
+		reorder_vertices_morton(meshVertices, meshIndices);
+	if (importFlags & kMeshImportOptimizeTriangles)
+	{
+		for (const MeshSubmesh& submesh : submeshes)
+			optimize_triangle_order(&meshIndices[submesh.firstIndex], submesh.indexCount, static_cast<u32>(meshVertices.size()));
+	}
+
+	// compute the normals the file left out, then the tangents,
+	if (missingNormals)
+		compute_missing_normals(&meshVertices[0], static_cast<u32>(meshVertices.size()), &meshIndices[0], static_cast<u32>(meshIndices.size()));
+	compute_tangents_lengyel(&meshVertices[0], meshVertices.size(), &meshIndices[0], meshIndices.size());
 
-		// compute the tangents,
-		compute_tangents_lengyel(&meshVertices[0], meshVertices.size(), &m_indices[0], m_indices.size());
+	rMeshOut.init_buffers(pDevice, &meshVertices[0], meshVertices.size(), &meshIndices[0], meshIndices.size(), meshName);
+	rMeshOut.set_submeshes(submeshes);
 
-		rMeshOut.init_buffers(pDevice, &meshVertices[0], meshVertices.size(), &m_indices[0], m_indices.size(), meshName);
+	// Proxies are bound to the final vertex order, so they come last
+	if (importFlags & kMeshImportProxyChain)
+	{
+		std::vector<MeshProxy> proxies;
+		build_mesh_proxy_chain(&meshVertices[0], static_cast<u32>(meshVertices.size()), &meshIndices[0],
+			static_cast<u32>(meshIndices.size()), proxies);
+		rMeshOut.set_proxies(std::move(proxies));
 	}
+
+	timer.Stop();
+	debugF("Preprocessed %u vertices of %s in %.2f ms", static_cast<u32>(meshVertices.size()), pFilename,
+		timer.ElapsedMicroseconds() * 0.001);
 }
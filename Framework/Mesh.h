@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CommonHeader.h"
+#include "PageAllocator.h"
 #include "VertexFormats.h"
 
 #include <vector>
@@ -8,10 +9,85 @@
 
 using MeshVertex = Vertex_Pos3fColour4ubNormal3fTangent3fTex2f; // vertex type
 
+// Tangent frame stream used by Kelvinlet evaluation (normal + tangent with bitangent sign in w)
+struct MeshTangentFrame
+{
+	v3 normal;
+	v4 tangent;
+};
+
+// Distance along the tangent and bitangent of the two points Kelvinlet evaluation displaces besides each
+// vertex, from which the deformed normal is rebuilt. The shaders use the same value.
+constexpr f32 kTangentPointOffset = 0.001f;
+
+// Position quantized to 16 bits per axis over the mesh's bounding box
+struct MeshQuantizedPosition
+{
+	u16 x, y, z;
+};
+
+// Number of consecutive vertices covered by one entry of a mesh's chunk bounds
+constexpr u32 kMeshChunkSize = 256;
+
+// Axis-aligned box and bounding sphere of a mesh or of a chunk of its vertices
+struct MeshBounds
+{
+	v3 aabbMin;
+	v3 aabbMax;
+	v3 sphereCentre;
+	f32 sphereRadius = 0.0f;
+};
+
+// A range of the index buffer, one per shape of the source file
+struct MeshSubmesh
+{
+	std::string name;
+	u32 firstIndex = 0;
+	u32 indexCount = 0;
+	s32 materialId = -1;
+};
+
+// One-ring vertex adjacency: the neighbours of vertex i are neighbours[offsets[i]] to neighbours[offsets[i + 1] - 1]
+struct MeshAdjacency
+{
+	std::vector<u32> offsets;
+	std::vector<u32> neighbours;
+};
+
+// A full resolution vertex's place on a proxy's surface: the corners of the closest proxy triangle and their
+// weights for the vertex and for the two tangent plane points Kelvinlet evaluation also displaces
+struct MeshProxyBinding
+{
+	u32 corners[3];
+	f32 weights[3][3];	// [point][corner] for the vertex and the vertex offset along its tangent and bitangent (see kTangentPointOffset)
+};
+
+// A simplified version of a mesh for evaluating Kelvinlets on, with every full resolution vertex bound to it
+struct MeshProxy
+{
+	std::vector<v3> positions;
+	std::vector<u32> indices;
+	std::vector<MeshProxyBinding> bindings;	// One per full resolution vertex
+};
+
+// CPU-side copies a mesh can drop once its GPU buffers exist
+enum MeshCpuData : u32
+{
+	kMeshCpuVertices = 1 << 0,		// Interleaved vertices, already in the vertex buffer
+	kMeshCpuEvalStreams = 1 << 1,	// Positions, tangent frames and proxies, needed to evaluate or bake on the CPU
+	kMeshCpuAdjacency = 1 << 2,		// One-ring adjacency
+
+	kMeshCpuAll = kMeshCpuVertices | kMeshCpuEvalStreams | kMeshCpuAdjacency
+};
+
 //================================================================================
 // Mesh Class
 // Wraps an index and vertex buffer.
 // Provides methods for loading a simple model.
+// Alongside the interleaved render layout, the mesh keeps separate position and
+// tangent frame streams so that evaluation only touches the data it needs.
+// The streams are spread over the NUMA nodes (see PageAllocator.h) to match the
+// way JobQueue::parallel_for_numa hands out vertex ranges.
 //================================================================================
 class Mesh
 {
@@ -23,33 +99,76 @@ public:
 	Mesh& operator=(Mesh&&);
 	~Mesh();
 
-	void init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, const u32 kNumVerts, const u16* pIndices, const u32 kNumIndices, const std::string& meshName);
+	void init_buffers(ID3D11Device* pDevice, const MeshVertex* pVertices, const u32 kNumVerts, const u32* pIndices, const u32 kNumIndices, const std::string& meshName);
 	void bind(ID3D11DeviceContext* pContext) const;
-	void bind_structured_VB_SRV(ID3D11DeviceContext*, u32) const;
+	void bind_eval_streams_SRV(ID3D11DeviceContext*, u32 positionSlot, u32 tangentFrameSlot) const;
 	void draw(ID3D11DeviceContext* pContext) const;
+	void draw_submesh(ID3D11DeviceContext* pContext, u32 submesh) const;
 	void release();
 
+	void set_submeshes(const std::vector<MeshSubmesh>&);
+	void set_proxies(std::vector<MeshProxy>&&);
+	void release_cpu_data(const u32 flags);		// MeshCpuData flags
+	MemoryUsage memory_usage() const;
+	void quantize_positions();
+	v3 dequantize_position(u32 i) const;
+
 	const std::vector<MeshVertex>& get_vertices() const { return m_vertices; }
+	const PageVector<v3>& get_positions() const { return m_positions; }
+	const PageVector<MeshTangentFrame>& get_tangent_frames() const { return m_tangentFrames; }
+	const std::vector<MeshQuantizedPosition>& get_quantized_positions() const { return m_quantizedPositions; }
+	bool has_quantized_positions() const { return !m_quantizedPositions.empty(); }
+	const MeshBounds& get_bounds() const { return m_bounds; }
+	const std::vector<MeshBounds>& get_chunk_bounds() const { return m_chunkBounds; }
+	const MeshAdjacency& get_adjacency() const { return m_adjacency; }
+	const std::vector<MeshSubmesh>& get_submeshes() const { return m_submeshes; }
+	// Proxy level l > 0 is get_proxies()[l - 1], each coarser than the last. Level 0 is the mesh itself.
+	const std::vector<MeshProxy>& get_proxies() const { return m_proxies; }
+	u32 num_proxy_levels() const { return static_cast<u32>(m_proxies.size()); }
+	bool has_eval_streams() const { return m_positions.size() == m_numVertices && m_numVertices > 0; }
 	u32 num_vertices() const { return m_numVertices; }
 	u32 num_indices() const { return m_numIndices; }
 	const std::string& get_name() const { return m_name; }
 
 private:
 	std::vector<MeshVertex> m_vertices;
-	u32 m_numVertices;
-	u32 m_numIndices;
+	PageVector<v3> m_positions;							// Evaluation stream : positions
+	PageVector<MeshTangentFrame> m_tangentFrames;		// Evaluation stream : normals and tangents
+	std::vector<MeshQuantizedPosition> m_quantizedPositions;	// Optional 16-bit positions
+	v3 m_quantizeOrigin;
+	v3 m_quantizeScale;
+	MeshBounds m_bounds;
+	std::vector<MeshBounds> m_chunkBounds;		// Bounds of each run of kMeshChunkSize vertices
+	MeshAdjacency m_adjacency;
+	std::vector<MeshSubmesh> m_submeshes;		// Index ranges drawn together in one call by draw()
+	std::vector<MeshProxy> m_proxies;			// Simplified evaluation proxies, finest first
+	u32 m_numVertices = 0;
+	u32 m_numIndices = 0;
 	std::string m_name;
 
 	ID3D11Buffer* m_pVertexBuffer = nullptr;	// Vertex buffer used by the InputAssembler
 	ID3D11Buffer* m_pIndexBuffer = nullptr;
-	ID3D11Buffer* m_pVertexStructuredBuffer = nullptr;	// Vertex buffer used by other shaders
-	ID3D11ShaderResourceView* m_pVertexStructuredBufferSRV = nullptr;
+	ID3D11Buffer* m_pPositionBuffer = nullptr;			// Position stream used by other shaders
+	ID3D11ShaderResourceView* m_pPositionBufferSRV = nullptr;
+	ID3D11Buffer* m_pTangentFrameBuffer = nullptr;		// Tangent frame stream used by other shaders
+	ID3D11ShaderResourceView* m_pTangentFrameBufferSRV = nullptr;
 };
 
 //================================================================================
 // Helpers for creating mesh data
 //================================================================================
 
+// Import options for create_mesh_from_obj
+enum MeshImportFlags : u32
+{
+	kMeshImportNone = 0,
+	kMeshImportReorderMorton = 1 << 0,		// Sort vertices along a Z-order curve
+	kMeshImportOptimizeTriangles = 1 << 1,	// Reorder triangles for the post-transform cache
+	kMeshImportProxyChain = 1 << 2,			// Build simplified proxies to evaluate Kelvinlets on (see build_mesh_proxy_chain)
+
+	kMeshImportDefault = kMeshImportReorderMorton | kMeshImportOptimizeTriangles
+};
+
 void create_mesh_cube(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfSize, const std::string& meshName);
 void create_mesh_quad_xy(ID3D11Device* pDevice, Mesh& rMeshOut, const f32 kHalfSize, const std::string& meshName);
-void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFilename, const char* mtlBaseDir, const f32 kScale, const std::string& meshName);
+void create_mesh_from_obj(ID3D11Device* pDevice, Mesh& rMeshOut, const char* pFilename, const char* mtlBaseDir, const f32 kScale, const std::string& meshName, const u32 importFlags = kMeshImportDefault);
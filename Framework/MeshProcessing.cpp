@@ -0,0 +1,1113 @@
+#include "MeshProcessing.h"
+#include "JobQueue.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+
+//================================================================================
+// Shared helpers
+//================================================================================
+
+// Scratch memory reused between calls
+struct MeshScratch
+{
+	std::vector<u32> triStart;		// Vertex -> triangle adjacency offsets
+	std::vector<u32> triList;		// Vertex -> triangle adjacency
+	std::vector<v3> triTangents;	// Per-triangle s and t directions
+	std::vector<v3> triNormals;		// Per-triangle normals scaled by twice the triangle's area
+	std::vector<u32> ringCount;		// Unique neighbours found for each vertex
+	std::vector<u32> ringList;		// Neighbour candidates, 2 per incident triangle
+};
+
+// Scratch is leased from a pool rather than kept per thread, because a thread waiting on one
+// call's jobs can pick up another call in the meantime
+class MeshScratchLease
+{
+public:
+	MeshScratchLease()
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		if (s_free.empty())
+			s_free.emplace_back(new MeshScratch);
+		m_pScratch = std::move(s_free.back());
+		s_free.pop_back();
+	}
+	~MeshScratchLease()
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		s_free.push_back(std::move(m_pScratch));
+	}
+	MeshScratchLease(const MeshScratchLease&) = delete;
+	MeshScratchLease& operator=(const MeshScratchLease&) = delete;
+
+	MeshScratch& get() { return *m_pScratch; }
+
+private:
+	std::unique_ptr<MeshScratch> m_pScratch;
+
+	static std::mutex s_mutex;
+	static std::vector<std::unique_ptr<MeshScratch>> s_free;
+};
+
+std::mutex MeshScratchLease::s_mutex;
+std::vector<std::unique_ptr<MeshScratch>> MeshScratchLease::s_free;
+
+// Builds the list of triangles touching each vertex into the scratch arrays
+static void build_vertex_triangles(const u32* pIndices, const u32 kIndices, const u32 kVertices, MeshScratch& scratch)
+{
+	scratch.triStart.assign(kVertices + 1, 0);
+	for (u32 i = 0; i < kIndices; ++i)
+		++scratch.triStart[pIndices[i] + 1];
+	for (u32 v = 0; v < kVertices; ++v)
+		scratch.triStart[v + 1] += scratch.triStart[v];
+
+	// Fill in triangle order so that each vertex's list comes out sorted
+	scratch.triList.resize(kIndices);
+	scratch.ringCount.assign(kVertices, 0);
+	for (u32 i = 0; i < kIndices; ++i)
+	{
+		u32 v = pIndices[i];
+		scratch.triList[scratch.triStart[v] + scratch.ringCount[v]++] = i / 3;
+	}
+}
+
+//================================================================================
+// Morton ordering
+//================================================================================
+
+// Spreads the lower 10 bits of x so that there are two zero bits between each
+static u32 expand_bits_10(u32 x)
+{
+	x &= 0x000003FF;
+	x = (x | (x << 16)) & 0xFF0000FF;
+	x = (x | (x << 8)) & 0x0300F00F;
+	x = (x | (x << 4)) & 0x030C30C3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+// 30-bit Morton code for a point already normalized to [0, 1023] on each axis
+static u32 morton_code_3d(u32 x, u32 y, u32 z)
+{
+	return (expand_bits_10(x) << 2) | (expand_bits_10(y) << 1) | expand_bits_10(z);
+}
+
+void reorder_vertices_morton(std::vector<MeshVertex>& vertices, std::vector<u32>& indices)
+{
+	const u32 kVertices = static_cast<u32>(vertices.size());
+	if (kVertices < 2)
+		return;
+
+	// Find the bounding box of the mesh
+	v3 vMin = vertices[0].pos;
+	v3 vMax = vertices[0].pos;
+	for (const MeshVertex& v : vertices)
+	{
+		vMin = v3::Min(vMin, v.pos);
+		vMax = v3::Max(vMax, v.pos);
+	}
+
+	// Use a cubic grid so that the curve treats every axis the same way
+	v3 extent = vMax - vMin;
+	f32 maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	f32 toGrid = maxExtent > 0.0f ? 1023.0f / maxExtent : 0.0f;
+
+	// Pair each vertex's code with its original index so ties keep file order
+	std::vector<std::pair<u32, u32>> keys(kVertices);
+	for (u32 i = 0; i < kVertices; ++i)
+	{
+		v3 g = (v3(vertices[i].pos) - vMin) * toGrid;
+		keys[i] = { morton_code_3d(static_cast<u32>(g.x), static_cast<u32>(g.y), static_cast<u32>(g.z)), i };
+	}
+	std::sort(keys.begin(), keys.end());
+
+	// Move vertices into curve order and record where each one went
+	std::vector<MeshVertex> reordered(kVertices);
+	std::vector<u32> remap(kVertices);
+	for (u32 i = 0; i < kVertices; ++i)
+	{
+		reordered[i] = vertices[keys[i].second];
+		remap[keys[i].second] = i;
+	}
+	vertices.swap(reordered);
+
+	for (u32& index : indices)
+		index = remap[index];
+}
+
+//================================================================================
+// Triangle ordering (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+//================================================================================
+
+static const u32 kCacheSize = 32;
+static const f32 kCacheDecayPower = 1.5f;
+static const f32 kLastTriScore = 0.75f;
+static const f32 kValenceBoostScale = 2.0f;
+static const f32 kValenceBoostPower = 0.5f;
+
+static f32 forsyth_vertex_score(s32 cachePosition, u32 remainingTris)
+{
+	// Vertices with no triangles left are never picked again
+	if (remainingTris == 0)
+		return -1.0f;
+
+	f32 score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// The three most recent vertices get a fixed score so the last triangle isn't simply repeated
+		if (cachePosition < 3)
+			score = kLastTriScore;
+		else
+		{
+			const f32 kScaler = 1.0f / (kCacheSize - 3);
+			score = powf(1.0f - (cachePosition - 3) * kScaler, kCacheDecayPower);
+		}
+	}
+
+	// Favour vertices with few triangles left so that they are finished off
+	score += kValenceBoostScale * powf(static_cast<f32>(remainingTris), -kValenceBoostPower);
+	return score;
+}
+
+void optimize_triangle_order(u32* pIndices, const u32 kIndices, const u32 kNumVertices)
+{
+	const u32 kTris = kIndices / 3;
+	if (kTris < 2)
+		return;
+
+	// Build the vertex -> triangle adjacency as one flat list
+	std::vector<u32> triStart(kNumVertices + 1, 0);
+	for (u32 i = 0; i < kIndices; ++i)
+		++triStart[pIndices[i] + 1];
+	for (u32 v = 0; v < kNumVertices; ++v)
+		triStart[v + 1] += triStart[v];
+
+	std::vector<u32> remaining(kNumVertices, 0);
+	std::vector<u32> triList(kIndices);
+	for (u32 t = 0; t < kTris; ++t)
+	{
+		for (u32 c = 0; c < 3; ++c)
+		{
+			u32 v = pIndices[3 * t + c];
+			triList[triStart[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector<s32> cachePosition(kNumVertices, -1);
+	std::vector<f32> vertexScore(kNumVertices);
+	for (u32 v = 0; v < kNumVertices; ++v)
+		vertexScore[v] = forsyth_vertex_score(-1, remaining[v]);
+
+	std::vector<f32> triScore(kTris);
+	std::vector<bool> triAdded(kTris, false);
+	s32 bestTri = -1;
+	f32 bestScore = -1.0f;
+	for (u32 t = 0; t < kTris; ++t)
+	{
+		triScore[t] = vertexScore[pIndices[3 * t]] + vertexScore[pIndices[3 * t + 1]] + vertexScore[pIndices[3 * t + 2]];
+		if (triScore[t] > bestScore)
+		{
+			bestScore = triScore[t];
+			bestTri = static_cast<s32>(t);
+		}
+	}
+
+	std::vector<u32> output;
+	output.reserve(kIndices);
+
+	u32 cache[kCacheSize + 3];
+	u32 cacheCount = 0;
+	u32 scanCursor = 0;
+
+	for (u32 n = 0; n < kTris; ++n)
+	{
+		// Nothing in the cache has triangles left, so fall back to the next unused triangle
+		if (bestTri < 0)
+		{
+			while (triAdded[scanCursor])
+				++scanCursor;
+			bestTri = static_cast<s32>(scanCursor);
+		}
+
+		const u32 t = static_cast<u32>(bestTri);
+		triAdded[t] = true;
+
+		// Emit the triangle and push its vertices to the front of the cache
+		u32 newCache[kCacheSize + 3];
+		u32 newCount = 0;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			u32 v = pIndices[3 * t + c];
+			output.push_back(v);
+			newCache[newCount++] = v;
+
+			// Remove the triangle from the vertex's list of remaining triangles
+			u32* pList = &triList[triStart[v]];
+			for (u32 i = 0; i < remaining[v]; ++i)
+			{
+				if (pList[i] == t)
+				{
+					pList[i] = pList[remaining[v] - 1];
+					--remaining[v];
+					break;
+				}
+			}
+		}
+
+		for (u32 i = 0; i < cacheCount; ++i)
+		{
+			u32 v = cache[i];
+			if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+				newCache[newCount++] = v;
+		}
+
+		// Rescore every vertex that was or is in the cache
+		for (u32 i = 0; i < newCount; ++i)
+		{
+			u32 v = newCache[i];
+			cachePosition[v] = i < kCacheSize ? static_cast<s32>(i) : -1;
+			vertexScore[v] = forsyth_vertex_score(cachePosition[v], remaining[v]);
+		}
+
+		// Rescore their triangles and pick the best one for the next step
+		bestTri = -1;
+		bestScore = -1.0f;
+		for (u32 i = 0; i < newCount; ++i)
+		{
+			u32 v = newCache[i];
+			const u32* pList = &triList[triStart[v]];
+			for (u32 j = 0; j < remaining[v]; ++j)
+			{
+				u32 tri = pList[j];
+				triScore[tri] = vertexScore[pIndices[3 * tri]] + vertexScore[pIndices[3 * tri + 1]] + vertexScore[pIndices[3 * tri + 2]];
+				if (triScore[tri] > bestScore)
+				{
+					bestScore = triScore[tri];
+					bestTri = static_cast<s32>(tri);
+				}
+			}
+		}
+
+		cacheCount = std::min(newCount, kCacheSize);
+		for (u32 i = 0; i < cacheCount; ++i)
+			cache[i] = newCache[i];
+	}
+
+	std::copy(output.begin(), output.end(), pIndices);
+}
+
+//================================================================================
+// Preprocessing
+//================================================================================
+
+void compute_missing_normals(MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices)
+{
+	using namespace DirectX;
+
+	const u32 kTris = kIndices / 3;
+	MeshScratchLease lease;
+	MeshScratch& scratch = lease.get();
+	build_vertex_triangles(pIndices, kIndices, kVertices, scratch);
+
+	// The cross product's length is twice the triangle's area, so summing them weights each face by area
+	scratch.triNormals.resize(kTris);
+	v3* pTriNormals = scratch.triNormals.data();
+	global_job_queue().parallel_for(0, kTris, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 iTri = begin; iTri < end; ++iTri)
+		{
+			const u32* pTri = pIndices + 3 * iTri;
+			XMVECTOR p1 = XMLoadFloat3(&pVertices[pTri[0]].pos);
+			XMVECTOR p2 = XMLoadFloat3(&pVertices[pTri[1]].pos);
+			XMVECTOR p3 = XMLoadFloat3(&pVertices[pTri[2]].pos);
+			XMStoreFloat3(&pTriNormals[iTri], XMVector3Cross(p2 - p1, p3 - p1));
+		}
+	});
+
+	// Each vertex gathers from its own triangles, so no two threads write the same vertex
+	const u32* pTriStart = scratch.triStart.data();
+	const u32* pTriList = scratch.triList.data();
+	global_job_queue().parallel_for(0, kVertices, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			if (pVertices[i].normal.x != 0.0f || pVertices[i].normal.y != 0.0f || pVertices[i].normal.z != 0.0f)
+				continue;
+
+			XMVECTOR n = XMVectorZero();
+			for (u32 j = pTriStart[i]; j < pTriStart[i + 1]; ++j)
+				n += XMLoadFloat3(&pTriNormals[pTriList[j]]);
+			XMStoreFloat3(&pVertices[i].normal, XMVector3Normalize(n));
+		}
+	});
+}
+
+void compute_tangents_lengyel(MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices)
+{
+	using namespace DirectX;
+
+	const u32 kTris = kIndices / 3;
+	MeshScratchLease lease;
+	MeshScratch& scratch = lease.get();
+	build_vertex_triangles(pIndices, kIndices, kVertices, scratch);
+
+	// Each triangle's tangent directions, computed independently
+	scratch.triTangents.resize(kTris * 2);
+	v3* pTriTangents = scratch.triTangents.data();
+	global_job_queue().parallel_for(0, kTris, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 iTri = begin; iTri < end; ++iTri)
+		{
+			const u32* pTri = pIndices + 3 * iTri;
+
+			v3 p1 = pVertices[pTri[0]].pos;
+			v3 p2 = pVertices[pTri[1]].pos;
+			v3 p3 = pVertices[pTri[2]].pos;
+
+			v2 w1 = pVertices[pTri[0]].tex;
+			v2 w2 = pVertices[pTri[1]].tex;
+			v2 w3 = pVertices[pTri[2]].tex;
+
+			f32 x1 = p2.x - p1.x;
+			f32 x2 = p3.x - p1.x;
+			f32 y1 = p2.y - p1.y;
+			f32 y2 = p3.y - p1.y;
+			f32 z1 = p2.z - p1.z;
+			f32 z2 = p3.z - p1.z;
+
+			f32 s1 = w2.x - w1.x;
+			f32 s2 = w3.x - w1.x;
+			f32 t1 = w2.y - w1.y;
+			f32 t2 = w3.y - w1.y;
+
+			f32 r = 1.f / (s1 * t2 - s2 * t1);
+			pTriTangents[2 * iTri] = v3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
+			pTriTangents[2 * iTri + 1] = v3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+		}
+	});
+
+	// Each vertex gathers from its own triangles, so no two threads write the same vertex
+	const u32* pTriStart = scratch.triStart.data();
+	const u32* pTriList = scratch.triList.data();
+	global_job_queue().parallel_for(0, kVertices, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			XMVECTOR t1 = XMVectorZero();
+			XMVECTOR t2 = XMVectorZero();
+			for (u32 j = pTriStart[i]; j < pTriStart[i + 1]; ++j)
+			{
+				t1 += XMLoadFloat3(&pTriTangents[2 * pTriList[j]]);
+				t2 += XMLoadFloat3(&pTriTangents[2 * pTriList[j] + 1]);
+			}
+
+			XMVECTOR n = XMLoadFloat3(&pVertices[i].normal);
+
+			// Gram-Schmidt Orthogonalization
+			XMVECTOR tangent = XMVector3Normalize(t1 - n * XMVector3Dot(n, t1));
+			XMVECTOR bitangent = XMVector3Dot(XMVector3Cross(n, t1), t2);
+
+			XMStoreFloat4(&pVertices[i].tangent, tangent);
+			pVertices[i].tangent.w = XMVectorGetX(bitangent) < 0.f ? -1.0f : 1.0f; // sign
+		}
+	});
+}
+
+void compute_mesh_bounds(const v3* pPositions, const u32 kVertices, MeshBounds& rBoundsOut, std::vector<MeshBounds>& rChunkBoundsOut)
+{
+	using namespace DirectX;
+
+	const u32 kChunks = (kVertices + kMeshChunkSize - 1) / kMeshChunkSize;
+	rChunkBoundsOut.resize(kChunks);
+	if (kChunks == 0)
+	{
+		rBoundsOut = MeshBounds();
+		return;
+	}
+
+	// Box and sphere of each chunk
+	MeshBounds* pChunks = rChunkBoundsOut.data();
+	global_job_queue().parallel_for(0, kChunks, 16, [=](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; ++c)
+		{
+			const u32 kFirst = c * kMeshChunkSize;
+			const u32 kLast = std::min(kVertices, kFirst + kMeshChunkSize);
+
+			XMVECTOR vMin = XMLoadFloat3(&pPositions[kFirst]);
+			XMVECTOR vMax = vMin;
+			for (u32 i = kFirst + 1; i < kLast; ++i)
+			{
+				XMVECTOR p = XMLoadFloat3(&pPositions[i]);
+				vMin = XMVectorMin(vMin, p);
+				vMax = XMVectorMax(vMax, p);
+			}
+
+			XMVECTOR centre = XMVectorScale(vMin + vMax, 0.5f);
+			XMVECTOR maxDistSq = XMVectorZero();
+			for (u32 i = kFirst; i < kLast; ++i)
+			{
+				XMVECTOR d = XMLoadFloat3(&pPositions[i]) - centre;
+				maxDistSq = XMVectorMax(maxDistSq, XMVector3LengthSq(d));
+			}
+
+			XMStoreFloat3(&pChunks[c].aabbMin, vMin);
+			XMStoreFloat3(&pChunks[c].aabbMax, vMax);
+			XMStoreFloat3(&pChunks[c].sphereCentre, centre);
+			pChunks[c].sphereRadius = sqrtf(XMVectorGetX(maxDistSq));
+		}
+	});
+
+	// Combine the chunk boxes into the mesh's box
+	v3 vMin = rChunkBoundsOut[0].aabbMin;
+	v3 vMax = rChunkBoundsOut[0].aabbMax;
+	for (const MeshBounds& chunk : rChunkBoundsOut)
+	{
+		vMin = v3::Min(vMin, chunk.aabbMin);
+		vMax = v3::Max(vMax, chunk.aabbMax);
+	}
+	rBoundsOut.aabbMin = vMin;
+	rBoundsOut.aabbMax = vMax;
+	rBoundsOut.sphereCentre = (vMin + vMax) * 0.5f;
+
+	// The sphere radius needs a second pass against the mesh's centre
+	const v3 kCentre = rBoundsOut.sphereCentre;
+	rBoundsOut.sphereRadius = global_job_queue().parallel_reduce(0, kChunks, 16, 0.0f, [=](u32 begin, u32 end)
+	{
+		XMVECTOR centre = XMLoadFloat3(&kCentre);
+		XMVECTOR maxDistSq = XMVectorZero();
+		for (u32 i = begin * kMeshChunkSize; i < std::min(kVertices, end * kMeshChunkSize); ++i)
+		{
+			XMVECTOR d = XMLoadFloat3(&pPositions[i]) - centre;
+			maxDistSq = XMVectorMax(maxDistSq, XMVector3LengthSq(d));
+		}
+		return sqrtf(XMVectorGetX(maxDistSq));
+	},
+	[](f32 a, f32 b) { return std::max(a, b); });
+}
+
+void compute_vertex_adjacency(const u32* pIndices, const u32 kIndices, const u32 kVertices, MeshAdjacency& rAdjacencyOut)
+{
+	MeshScratchLease lease;
+	MeshScratch& scratch = lease.get();
+	build_vertex_triangles(pIndices, kIndices, kVertices, scratch);
+
+	// Each vertex collects the other two corners of its triangles into its own slot range, then dedups them
+	scratch.ringList.resize(2 * kIndices);
+	const u32* pTriStart = scratch.triStart.data();
+	const u32* pTriList = scratch.triList.data();
+	u32* pRingCount = scratch.ringCount.data();
+	u32* pRingList = scratch.ringList.data();
+	global_job_queue().parallel_for(0, kVertices, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 v = begin; v < end; ++v)
+		{
+			u32* pRing = pRingList + 2 * pTriStart[v];
+			u32 count = 0;
+			for (u32 j = pTriStart[v]; j < pTriStart[v + 1]; ++j)
+			{
+				const u32* pTri = pIndices + 3 * pTriList[j];
+				for (u32 c = 0; c < 3; ++c)
+				{
+					if (pTri[c] != v)
+						pRing[count++] = pTri[c];
+				}
+			}
+			std::sort(pRing, pRing + count);
+			pRingCount[v] = static_cast<u32>(std::unique(pRing, pRing + count) - pRing);
+		}
+	});
+
+	rAdjacencyOut.offsets.resize(kVertices + 1);
+	rAdjacencyOut.offsets[0] = 0;
+	for (u32 v = 0; v < kVertices; ++v)
+		rAdjacencyOut.offsets[v + 1] = rAdjacencyOut.offsets[v] + pRingCount[v];
+
+	// Compact the unique neighbours into the final list
+	rAdjacencyOut.neighbours.resize(rAdjacencyOut.offsets[kVertices]);
+	const u32* pOffsets = rAdjacencyOut.offsets.data();
+	u32* pNeighbours = rAdjacencyOut.neighbours.data();
+	global_job_queue().parallel_for(0, kVertices, 4096, [=](u32 begin, u32 end)
+	{
+		for (u32 v = begin; v < end; ++v)
+			std::copy(pRingList + 2 * pTriStart[v], pRingList + 2 * pTriStart[v] + pRingCount[v], pNeighbours + pOffsets[v]);
+	});
+}
+
+//================================================================================
+// Proxy meshes
+//================================================================================
+
+// Symmetric 4x4 error quadric, upper triangle stored row by row
+struct Quadric
+{
+	f64 m[10] = {};
+
+	void add_plane(const f64 a, const f64 b, const f64 c, const f64 d, const f64 weight)
+	{
+		m[0] += weight * a * a; m[1] += weight * a * b; m[2] += weight * a * c; m[3] += weight * a * d;
+		m[4] += weight * b * b; m[5] += weight * b * c; m[6] += weight * b * d;
+		m[7] += weight * c * c; m[8] += weight * c * d;
+		m[9] += weight * d * d;
+	}
+
+	Quadric& operator+=(const Quadric& other)
+	{
+		for (u32 i = 0; i < 10; ++i)
+			m[i] += other.m[i];
+		return *this;
+	}
+
+	f64 error(const v3& p) const
+	{
+		const f64 x = p.x, y = p.y, z = p.z;
+		return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x +
+			m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y +
+			m[7] * z * z + 2 * m[8] * z + m[9];
+	}
+
+	// Position with the least error, false if the quadric is too close to singular to have one
+	bool optimum(v3& rOut) const
+	{
+		const f64 kC00 = m[4] * m[7] - m[5] * m[5];
+		const f64 kC01 = m[2] * m[5] - m[1] * m[7];
+		const f64 kC02 = m[1] * m[5] - m[2] * m[4];
+		const f64 kDet = m[0] * kC00 + m[1] * kC01 + m[2] * kC02;
+		const f64 kTrace = m[0] + m[4] + m[7];
+		if (std::abs(kDet) <= 1e-9 * kTrace * kTrace * kTrace)
+			return false;
+
+		// Cramer's rule on A p = -b
+		const f64 kC11 = m[0] * m[7] - m[2] * m[2];
+		const f64 kC12 = m[1] * m[2] - m[0] * m[5];
+		const f64 kC22 = m[0] * m[4] - m[1] * m[1];
+		const f64 kInvDet = -1.0 / kDet;
+		rOut.x = static_cast<f32>((kC00 * m[3] + kC01 * m[6] + kC02 * m[8]) * kInvDet);
+		rOut.y = static_cast<f32>((kC01 * m[3] + kC11 * m[6] + kC12 * m[8]) * kInvDet);
+		rOut.z = static_cast<f32>((kC02 * m[3] + kC12 * m[6] + kC22 * m[8]) * kInvDet);
+		return true;
+	}
+};
+
+struct EdgeCollapse
+{
+	f64 cost;
+	u32 keep, remove;
+	u32 keepStamp, removeStamp;	// Stale once either vertex has changed since
+	v3 target;
+
+	bool operator>(const EdgeCollapse& other) const { return cost > other.cost; }
+};
+
+// Edge collapse state over a welded copy of the mesh
+class Decimator
+{
+public:
+	Decimator(const MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices);
+
+	// Collapses edges, cheapest first, until no more than kTargetTriangles are left or nothing can go
+	void collapse_to(const u32 kTargetTriangles);
+	u32 num_triangles() const { return m_liveTriangles; }
+
+	// Copies out the surviving triangles and binds the original vertices to them
+	void snapshot(const MeshVertex* pVertices, const u32 kVertices, MeshProxy& rProxyOut);
+
+private:
+	u32 find(u32 v);
+	void push_edges(const u32 kVertex);
+	bool can_collapse(const EdgeCollapse&);
+	void collapse(const EdgeCollapse&);
+
+	std::vector<u32> m_weld;			// Original vertex -> welded vertex
+	std::vector<v3> m_positions;		// Per welded vertex
+	std::vector<Quadric> m_quadrics;
+	std::vector<u32> m_parent;			// The vertex a removed vertex collapsed into, itself while live
+	std::vector<u32> m_stamps;
+	std::vector<std::vector<u32>> m_vertexTriangles;	// Live and dead triangles touching each vertex
+	std::vector<u32> m_triangles;
+	std::vector<u8> m_triangleDead;
+	u32 m_liveTriangles = 0;
+	std::priority_queue<EdgeCollapse, std::vector<EdgeCollapse>, std::greater<EdgeCollapse>> m_heap;
+	std::vector<u32> m_ringScratch;
+};
+
+struct PositionKey
+{
+	u32 bits[3];
+	bool operator==(const PositionKey& other) const
+	{
+		return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+	}
+};
+
+struct PositionKeyHash
+{
+	size_t operator()(const PositionKey& key) const
+	{
+		return (static_cast<size_t>(key.bits[0]) * 73856093u) ^ (static_cast<size_t>(key.bits[1]) * 19349663u) ^
+			(static_cast<size_t>(key.bits[2]) * 83492791u);
+	}
+};
+
+Decimator::Decimator(const MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices)
+{
+	// Weld vertices that only differ in their normal or UV
+	std::unordered_map<PositionKey, u32, PositionKeyHash> welded;
+	m_weld.resize(kVertices);
+	for (u32 i = 0; i < kVertices; ++i)
+	{
+		PositionKey key;
+		memcpy(key.bits, &pVertices[i].pos, sizeof(key.bits));
+		auto inserted = welded.insert({ key, static_cast<u32>(m_positions.size()) });
+		if (inserted.second)
+			m_positions.push_back(v3(pVertices[i].pos));
+		m_weld[i] = inserted.first->second;
+	}
+
+	const u32 kWelded = static_cast<u32>(m_positions.size());
+	m_quadrics.resize(kWelded);
+	m_parent.resize(kWelded);
+	m_stamps.assign(kWelded, 0);
+	m_vertexTriangles.resize(kWelded);
+	for (u32 v = 0; v < kWelded; ++v)
+		m_parent[v] = v;
+
+	// Every triangle adds its plane, weighted by area, to its corners' quadrics
+	std::unordered_map<u64, u32> edgeUses;
+	for (u32 i = 0; i + 2 < kIndices; i += 3)
+	{
+		const u32 kCorners[3] = { m_weld[pIndices[i]], m_weld[pIndices[i + 1]], m_weld[pIndices[i + 2]] };
+		if (kCorners[0] == kCorners[1] || kCorners[1] == kCorners[2] || kCorners[0] == kCorners[2])
+			continue;
+
+		const u32 kTriangle = static_cast<u32>(m_triangles.size() / 3);
+		const v3 kCross = (m_positions[kCorners[1]] - m_positions[kCorners[0]]).Cross(m_positions[kCorners[2]] - m_positions[kCorners[0]]);
+		const f32 kDoubleArea = kCross.Length();
+		for (u32 c = 0; c < 3; ++c)
+		{
+			m_triangles.push_back(kCorners[c]);
+			m_vertexTriangles[kCorners[c]].push_back(kTriangle);
+			const u32 kA = std::min(kCorners[c], kCorners[(c + 1) % 3]);
+			const u32 kB = std::max(kCorners[c], kCorners[(c + 1) % 3]);
+			++edgeUses[(static_cast<u64>(kA) << 32) | kB];
+		}
+		if (kDoubleArea <= 0.0f)
+			continue;
+
+		const v3 kNormal = kCross / kDoubleArea;
+		const f64 kD = -kNormal.Dot(m_positions[kCorners[0]]);
+		for (u32 c = 0; c < 3; ++c)
+			m_quadrics[kCorners[c]].add_plane(kNormal.x, kNormal.y, kNormal.z, kD, 0.5 * kDoubleArea);
+	}
+	m_liveTriangles = static_cast<u32>(m_triangles.size() / 3);
+	m_triangleDead.assign(m_liveTriangles, 0);
+
+	// Open borders get a steep plane through them, at right angles to their triangle, so they hold their shape
+	const f64 kBorderWeight = 10.0;
+	for (u32 t = 0; t < m_liveTriangles; ++t)
+	{
+		const u32* pTri = &m_triangles[3 * t];
+		const v3 kFaceNormal = (m_positions[pTri[1]] - m_positions[pTri[0]]).Cross(m_positions[pTri[2]] - m_positions[pTri[0]]);
+		for (u32 c = 0; c < 3; ++c)
+		{
+			const u32 kA = std::min(pTri[c], pTri[(c + 1) % 3]);
+			const u32 kB = std::max(pTri[c], pTri[(c + 1) % 3]);
+			if (edgeUses[(static_cast<u64>(kA) << 32) | kB] != 1)
+				continue;
+
+			const v3 kEdge = m_positions[pTri[(c + 1) % 3]] - m_positions[pTri[c]];
+			v3 borderNormal = kEdge.Cross(kFaceNormal);
+			if (borderNormal.LengthSquared() <= 0.0f)
+				continue;
+			borderNormal.Normalize();
+			const f64 kD = -borderNormal.Dot(m_positions[pTri[c]]);
+			const f64 kWeight = kBorderWeight * kEdge.LengthSquared();
+			m_quadrics[pTri[c]].add_plane(borderNormal.x, borderNormal.y, borderNormal.z, kD, kWeight);
+			m_quadrics[pTri[(c + 1) % 3]].add_plane(borderNormal.x, borderNormal.y, borderNormal.z, kD, kWeight);
+		}
+	}
+
+	for (u32 v = 0; v < kWelded; ++v)
+		push_edges(v);
+}
+
+u32 Decimator::find(u32 v)
+{
+	u32 root = v;
+	while (m_parent[root] != root)
+		root = m_parent[root];
+	while (m_parent[v] != root)
+	{
+		const u32 kNext = m_parent[v];
+		m_parent[v] = root;
+		v = kNext;
+	}
+	return root;
+}
+
+void Decimator::push_edges(const u32 kVertex)
+{
+	for (u32 t : m_vertexTriangles[kVertex])
+	{
+		if (m_triangleDead[t])
+			continue;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			const u32 kOther = m_triangles[3 * t + c];
+			if (kOther == kVertex)
+				continue;
+
+			EdgeCollapse collapse;
+			collapse.keep = kVertex;
+			collapse.remove = kOther;
+			collapse.keepStamp = m_stamps[kVertex];
+			collapse.removeStamp = m_stamps[kOther];
+
+			Quadric q = m_quadrics[kVertex];
+			q += m_quadrics[kOther];
+			const v3& kP0 = m_positions[kVertex];
+			const v3& kP1 = m_positions[kOther];
+
+			// The optimum unless it is ill-conditioned or runs away from the edge, else the best of the ends and middle
+			v3 target;
+			if (q.optimum(target) && v3::DistanceSquared(target, (kP0 + kP1) * 0.5f) <= 4.0f * v3::DistanceSquared(kP0, kP1))
+				collapse.cost = q.error(target);
+			else
+			{
+				const v3 kCandidates[3] = { kP0, kP1, (kP0 + kP1) * 0.5f };
+				collapse.cost = DBL_MAX;
+				for (const v3& candidate : kCandidates)
+				{
+					const f64 kError = q.error(candidate);
+					if (kError < collapse.cost)
+					{
+						collapse.cost = kError;
+						target = candidate;
+					}
+				}
+			}
+			collapse.target = target;
+			m_heap.push(collapse);
+		}
+	}
+}
+
+bool Decimator::can_collapse(const EdgeCollapse& collapse)
+{
+	const u32 kKeep = collapse.keep;
+	const u32 kRemove = collapse.remove;
+
+	// Link condition: the two ends may only share the neighbours opposite the edge, or the surface pinches
+	m_ringScratch.clear();
+	u32 sharedTriangles = 0;
+	for (u32 v : { kKeep, kRemove })
+	{
+		for (u32 t : m_vertexTriangles[v])
+		{
+			if (m_triangleDead[t])
+				continue;
+			const u32* pTri = &m_triangles[3 * t];
+			const bool kShared = (pTri[0] == kKeep || pTri[1] == kKeep || pTri[2] == kKeep) &&
+				(pTri[0] == kRemove || pTri[1] == kRemove || pTri[2] == kRemove);
+			if (kShared && v == kKeep)
+				++sharedTriangles;
+			for (u32 c = 0; c < 3; ++c)
+			{
+				if (pTri[c] != kKeep && pTri[c] != kRemove)
+					m_ringScratch.push_back((v == kKeep ? 0u : 0x80000000u) | pTri[c]);
+			}
+		}
+	}
+	if (sharedTriangles == 0)
+		return false;
+	std::sort(m_ringScratch.begin(), m_ringScratch.end());
+	m_ringScratch.erase(std::unique(m_ringScratch.begin(), m_ringScratch.end()), m_ringScratch.end());
+	u32 commonNeighbours = 0;
+	auto split = std::lower_bound(m_ringScratch.begin(), m_ringScratch.end(), 0x80000000u);
+	for (auto it = split; it != m_ringScratch.end(); ++it)
+	{
+		if (std::binary_search(m_ringScratch.begin(), split, *it & 0x7FFFFFFFu))
+			++commonNeighbours;
+	}
+	if (commonNeighbours != sharedTriangles)
+		return false;
+
+	// No triangle that survives may fold over
+	for (u32 v : { kKeep, kRemove })
+	{
+		for (u32 t : m_vertexTriangles[v])
+		{
+			if (m_triangleDead[t])
+				continue;
+			const u32* pTri = &m_triangles[3 * t];
+			v3 before[3], after[3];
+			bool shared = false;
+			for (u32 c = 0; c < 3; ++c)
+			{
+				before[c] = m_positions[pTri[c]];
+				after[c] = (pTri[c] == v) ? collapse.target : before[c];
+				shared |= (pTri[c] == (v == kKeep ? kRemove : kKeep));
+			}
+			if (shared)
+				continue;
+
+			v3 normalBefore = (before[1] - before[0]).Cross(before[2] - before[0]);
+			v3 normalAfter = (after[1] - after[0]).Cross(after[2] - after[0]);
+			const f32 kLengths = normalBefore.Length() * normalAfter.Length();
+			if (kLengths <= 0.0f || normalBefore.Dot(normalAfter) < 0.2f * kLengths)
+				return false;
+		}
+	}
+	return true;
+}
+
+void Decimator::collapse(const EdgeCollapse& collapse)
+{
+	const u32 kKeep = collapse.keep;
+	const u32 kRemove = collapse.remove;
+	m_positions[kKeep] = collapse.target;
+	m_quadrics[kKeep] += m_quadrics[kRemove];
+	m_parent[kRemove] = kKeep;
+	++m_stamps[kKeep];
+	++m_stamps[kRemove];
+
+	for (u32 t : m_vertexTriangles[kRemove])
+	{
+		if (m_triangleDead[t])
+			continue;
+		u32* pTri = &m_triangles[3 * t];
+		if (pTri[0] == kKeep || pTri[1] == kKeep || pTri[2] == kKeep)
+		{
+			m_triangleDead[t] = 1;
+			--m_liveTriangles;
+			continue;
+		}
+		for (u32 c = 0; c < 3; ++c)
+		{
+			if (pTri[c] == kRemove)
+				pTri[c] = kKeep;
+		}
+		m_vertexTriangles[kKeep].push_back(t);
+	}
+	std::vector<u32>().swap(m_vertexTriangles[kRemove]);
+
+	std::vector<u32>& keepTriangles = m_vertexTriangles[kKeep];
+	keepTriangles.erase(std::remove_if(keepTriangles.begin(), keepTriangles.end(),
+		[this](u32 t) { return m_triangleDead[t] != 0; }), keepTriangles.end());
+	push_edges(kKeep);
+}
+
+void Decimator::collapse_to(const u32 kTargetTriangles)
+{
+	while (m_liveTriangles > kTargetTriangles && !m_heap.empty())
+	{
+		const EdgeCollapse kCollapse = m_heap.top();
+		m_heap.pop();
+		if (m_parent[kCollapse.keep] != kCollapse.keep || m_parent[kCollapse.remove] != kCollapse.remove ||
+			m_stamps[kCollapse.keep] != kCollapse.keepStamp || m_stamps[kCollapse.remove] != kCollapse.removeStamp)
+			continue;
+		if (can_collapse(kCollapse))
+			collapse(kCollapse);
+	}
+}
+
+// Barycentric coordinates of a point's projection onto a triangle's plane, unclamped. False if degenerate.
+static bool triangle_barycentrics(const v3& p, const v3& a, const v3& b, const v3& c, f32 rOut[3])
+{
+	const v3 kV0 = b - a, kV1 = c - a, kV2 = p - a;
+	const f32 kD00 = kV0.Dot(kV0), kD01 = kV0.Dot(kV1), kD11 = kV1.Dot(kV1);
+	const f32 kD20 = kV2.Dot(kV0), kD21 = kV2.Dot(kV1);
+	const f32 kDenom = kD00 * kD11 - kD01 * kD01;
+	if (kDenom <= 1e-20f)
+		return false;
+	rOut[1] = (kD11 * kD20 - kD01 * kD21) / kDenom;
+	rOut[2] = (kD00 * kD21 - kD01 * kD20) / kDenom;
+	rOut[0] = 1.0f - rOut[1] - rOut[2];
+	return true;
+}
+
+// Barycentric coordinates of the point of a triangle closest to p (Ericson, Real-Time Collision Detection 5.1.5)
+static void closest_triangle_barycentrics(const v3& p, const v3& a, const v3& b, const v3& c, f32 rOut[3])
+{
+	auto set = [&](f32 u, f32 v, f32 w) { rOut[0] = u; rOut[1] = v; rOut[2] = w; };
+	const v3 kAB = b - a, kAC = c - a, kAP = p - a;
+	const f32 kD1 = kAB.Dot(kAP), kD2 = kAC.Dot(kAP);
+	if (kD1 <= 0.0f && kD2 <= 0.0f) return set(1.0f, 0.0f, 0.0f);
+
+	const v3 kBP = p - b;
+	const f32 kD3 = kAB.Dot(kBP), kD4 = kAC.Dot(kBP);
+	if (kD3 >= 0.0f && kD4 <= kD3) return set(0.0f, 1.0f, 0.0f);
+
+	const f32 kVC = kD1 * kD4 - kD3 * kD2;
+	if (kVC <= 0.0f && kD1 >= 0.0f && kD3 <= 0.0f)
+	{
+		const f32 kV = kD1 / (kD1 - kD3);
+		return set(1.0f - kV, kV, 0.0f);
+	}
+
+	const v3 kCP = p - c;
+	const f32 kD5 = kAB.Dot(kCP), kD6 = kAC.Dot(kCP);
+	if (kD6 >= 0.0f && kD5 <= kD6) return set(0.0f, 0.0f, 1.0f);
+
+	const f32 kVB = kD5 * kD2 - kD1 * kD6;
+	if (kVB <= 0.0f && kD2 >= 0.0f && kD6 <= 0.0f)
+	{
+		const f32 kW = kD2 / (kD2 - kD6);
+		return set(1.0f - kW, 0.0f, kW);
+	}
+
+	const f32 kVA = kD3 * kD6 - kD5 * kD4;
+	if (kVA <= 0.0f && (kD4 - kD3) >= 0.0f && (kD5 - kD6) >= 0.0f)
+	{
+		const f32 kW = (kD4 - kD3) / ((kD4 - kD3) + (kD5 - kD6));
+		return set(0.0f, 1.0f - kW, kW);
+	}
+
+	const f32 kDenom = 1.0f / (kVA + kVB + kVC);
+	const f32 kV = kVB * kDenom, kW = kVC * kDenom;
+	set(1.0f - kV - kW, kV, kW);
+}
+
+// Rings of triangles a vertex's binding may walk across from the proxy vertex it collapsed into
+static constexpr u32 kMaxBindingSteps = 4;
+
+void Decimator::snapshot(const MeshVertex* pVertices, const u32 kVertices, MeshProxy& rProxyOut)
+{
+	// Compact the live triangles and the vertices they use
+	const u32 kWelded = static_cast<u32>(m_positions.size());
+	std::vector<u32> remap(kWelded, ~0u);
+	rProxyOut.positions.clear();
+	rProxyOut.indices.clear();
+	for (u32 t = 0; t < m_triangleDead.size(); ++t)
+	{
+		if (m_triangleDead[t])
+			continue;
+		for (u32 c = 0; c < 3; ++c)
+		{
+			const u32 kVertex = m_triangles[3 * t + c];
+			if (remap[kVertex] == ~0u)
+			{
+				remap[kVertex] = static_cast<u32>(rProxyOut.positions.size());
+				rProxyOut.positions.push_back(m_positions[kVertex]);
+			}
+			rProxyOut.indices.push_back(remap[kVertex]);
+		}
+	}
+
+	const u32 kProxyVertices = static_cast<u32>(rProxyOut.positions.size());
+	const u32 kProxyTriangles = static_cast<u32>(rProxyOut.indices.size() / 3);
+	MeshScratchLease lease;
+	MeshScratch& scratch = lease.get();
+	build_vertex_triangles(rProxyOut.indices.data(), static_cast<u32>(rProxyOut.indices.size()), kProxyVertices, scratch);
+
+	// Each original vertex lands in the proxy vertex its welded vertex collapsed into
+	std::vector<u32> home(kVertices);
+	for (u32 i = 0; i < kVertices; ++i)
+		home[i] = remap[find(m_weld[i])];
+
+	// Bind each vertex to the closest triangle around that proxy vertex, walking on through the triangles around
+	// the closest one's corners while that finds closer ones, or to the closest of all if it has none. The tangent
+	// plane points take the vertex's weights plus how far the linear interpolant moves along them.
+	rProxyOut.bindings.resize(kVertices);
+	const v3* pProxyPositions = rProxyOut.positions.data();
+	const u32* pProxyIndices = rProxyOut.indices.data();
+	const u32* pTriStart = scratch.triStart.data();
+	const u32* pTriList = scratch.triList.data();
+	const u32* pHome = home.data();
+	MeshProxyBinding* pBindings = rProxyOut.bindings.data();
+	global_job_queue().parallel_for(0, kVertices, 1024, [=](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const v3 kPos(pVertices[i].pos);
+			MeshProxyBinding& binding = pBindings[i];
+			f32 bestDistanceSq = FLT_MAX;
+			u32 bestTriangle = 0;
+			auto test_triangle = [&](const u32 kTriangle)
+			{
+				const u32* pTri = pProxyIndices + 3 * kTriangle;
+				f32 bary[3];
+				closest_triangle_barycentrics(kPos, pProxyPositions[pTri[0]], pProxyPositions[pTri[1]], pProxyPositions[pTri[2]], bary);
+				const v3 kClosest = pProxyPositions[pTri[0]] * bary[0] + pProxyPositions[pTri[1]] * bary[1] + pProxyPositions[pTri[2]] * bary[2];
+				const f32 kDistanceSq = v3::DistanceSquared(kPos, kClosest);
+				if (kDistanceSq < bestDistanceSq)
+				{
+					bestDistanceSq = kDistanceSq;
+					bestTriangle = kTriangle;
+					for (u32 c = 0; c < 3; ++c)
+						binding.weights[0][c] = bary[c];
+				}
+			};
+
+			if (pHome[i] == ~0u)
+			{
+				for (u32 t = 0; t < kProxyTriangles; ++t)
+					test_triangle(t);
+			}
+			else
+			{
+				for (u32 j = pTriStart[pHome[i]]; j < pTriStart[pHome[i] + 1]; ++j)
+					test_triangle(pTriList[j]);
+				for (u32 step = 0; step < kMaxBindingSteps; ++step)
+				{
+					const u32 kFrom = bestTriangle;
+					for (u32 c = 0; c < 3; ++c)
+					{
+						const u32 kCorner = pProxyIndices[3 * kFrom + c];
+						for (u32 j = pTriStart[kCorner]; j < pTriStart[kCorner + 1]; ++j)
+							test_triangle(pTriList[j]);
+					}
+					if (bestTriangle == kFrom)
+						break;
+				}
+			}
+
+			const u32* pTri = pProxyIndices + 3 * bestTriangle;
+			for (u32 c = 0; c < 3; ++c)
+				binding.corners[c] = pTri[c];
+
+			const v3 kTangent(pVertices[i].tangent.x, pVertices[i].tangent.y, pVertices[i].tangent.z);
+			const v3 kNormal(pVertices[i].normal);
+			const v3 kOffsets[2] = { kTangent * kTangentPointOffset, kNormal.Cross(kTangent) * kTangentPointOffset };
+			const v3& kA = pProxyPositions[pTri[0]];
+			const v3& kB = pProxyPositions[pTri[1]];
+			const v3& kC = pProxyPositions[pTri[2]];
+			f32 baseBary[3];
+			const bool kValid = triangle_barycentrics(kPos, kA, kB, kC, baseBary);
+			for (u32 point = 0; point < 2; ++point)
+			{
+				f32 offsetBary[3];
+				const bool kOffsetValid = kValid && triangle_barycentrics(kPos + kOffsets[point], kA, kB, kC, offsetBary);
+				for (u32 c = 0; c < 3; ++c)
+					binding.weights[point + 1][c] = binding.weights[0][c] + (kOffsetValid ? offsetBary[c] - baseBary[c] : 0.0f);
+			}
+		}
+	});
+}
+
+void build_mesh_proxy_chain(const MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices,
+	std::vector<MeshProxy>& rProxiesOut)
+{
+	rProxiesOut.clear();
+	Decimator decimator(pVertices, kVertices, pIndices, kIndices);
+
+	u32 levelTriangles = decimator.num_triangles();
+	for (u32 level = 0; level < kMeshMaxProxyLevels; ++level)
+	{
+		const u32 kTarget = levelTriangles / 4;
+		if (kTarget < kMeshMinProxyTriangles)
+			break;
+		decimator.collapse_to(kTarget);
+
+		// Stop once collapses run out before the level is much coarser than the last
+		if (decimator.num_triangles() > levelTriangles / 2)
+			break;
+		levelTriangles = decimator.num_triangles();
+		rProxiesOut.emplace_back();
+		decimator.snapshot(pVertices, kVertices, rProxiesOut.back());
+	}
+}
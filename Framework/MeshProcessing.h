@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Mesh.h"
+
+//================================================================================
+// Mesh import stages
+// These run on the raw vertex/index arrays before they are uploaded to a Mesh.
+//================================================================================
+
+// Reorders vertices along a Z-order (Morton) curve over the mesh's bounding box and remaps the indices.
+// Spatially close vertices end up close in memory, which tightens the bounds of any contiguous vertex range.
+void reorder_vertices_morton(std::vector<MeshVertex>& vertices, std::vector<u32>& indices);
+
+// Reorders the triangles of an index range for the post-transform vertex cache (Forsyth's linear-speed optimizer).
+// Vertex order is left untouched.
+void optimize_triangle_order(u32* pIndices, const u32 kIndices, const u32 kNumVertices);
+
+//================================================================================
+// Mesh preprocessing
+// Each stage runs on the shared job queue and works in scratch memory leased from
+// a shared pool, so repeated imports don't allocate once warmed up.
+//================================================================================
+
+// Gives every vertex whose normal is zero the area weighted average of its triangles' normals, for sources
+// that leave normals out. Triangles are taken to be wound clockwise, as Direct3D draws them.
+void compute_missing_normals(MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices);
+
+// Computes tangents using Lengyel's method for an indexed triangle list.
+// Tangents are computed as a 4d vector where w stores the sign need to reconstruct a bitangent in the shader.
+void compute_tangents_lengyel(MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices);
+
+// Computes the mesh's box and sphere, plus the bounds of every kMeshChunkSize run of vertices.
+void compute_mesh_bounds(const v3* pPositions, const u32 kVertices, MeshBounds& rBoundsOut, std::vector<MeshBounds>& rChunkBoundsOut);
+
+// Computes the one-ring neighbours of every vertex, sorted by index.
+void compute_vertex_adjacency(const u32* pIndices, const u32 kIndices, const u32 kVertices, MeshAdjacency& rAdjacencyOut);
+
+//================================================================================
+// Proxy meshes
+//================================================================================
+
+constexpr u32 kMeshMaxProxyLevels = 3;		// Each level keeps a quarter of the previous one's triangles
+constexpr u32 kMeshMinProxyTriangles = 32;	// No level is made coarser than this
+
+// Simplifies the mesh by quadric error edge collapse (Garland and Heckbert), taking a snapshot each time the
+// triangle count falls to a quarter of the last one, and binds every vertex to the closest triangle of each. Vertices
+// sharing a position are welded first so normal and UV seams don't split the surface. Levels that would
+// barely be smaller than the one before are left out, so small meshes get fewer or none.
+void build_mesh_proxy_chain(const MeshVertex* pVertices, const u32 kVertices, const u32* pIndices, const u32 kIndices,
+	std::vector<MeshProxy>& rProxiesOut);
@@ -0,0 +1,174 @@
+#include "PageAllocator.h"
+
+#include <mutex>
+
+u32 numa_node_count()
+{
+	static const u32 s_count = []()
+	{
+		ULONG highest = 0;
+		if (!GetNumaHighestNodeNumber(&highest))
+			return 1u;
+		return static_cast<u32>(highest) + 1;
+	}();
+	return s_count;
+}
+
+void numa_node_range(const u32 kCount, const u32 kNode, u32& rBegin, u32& rEnd)
+{
+	const u32 kNodes = numa_node_count();
+	rBegin = static_cast<u32>(static_cast<u64>(kCount) * kNode / kNodes);
+	rEnd = static_cast<u32>(static_cast<u64>(kCount) * (kNode + 1) / kNodes);
+}
+
+bool pin_thread_to_numa_node(HANDLE hThread, const u32 kNode)
+{
+	GROUP_AFFINITY affinity = {};
+	if (!GetNumaNodeProcessorMaskEx(static_cast<USHORT>(kNode), &affinity) || affinity.Mask == 0)
+		return false;
+	return SetThreadGroupAffinity(hThread, &affinity, nullptr) != 0;
+}
+
+// Live large page allocations and their rounded sizes. There are only ever a handful.
+static std::mutex s_largePageMutex;
+static std::vector<std::pair<void*, size_t>> s_largePageAllocs;
+static u64 s_largePageBytes = 0;
+
+size_t large_page_size()
+{
+	// Large pages need the lock memory privilege enabled on the process token first
+	static const size_t s_size = []() -> size_t
+	{
+		const size_t kMinimum = GetLargePageMinimum();
+		if (kMinimum == 0)
+			return 0;
+
+		HANDLE hToken = nullptr;
+		if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+			return 0;
+
+		TOKEN_PRIVILEGES privileges = {};
+		privileges.PrivilegeCount = 1;
+		privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+		BOOL enabled = LookupPrivilegeValueA(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+			AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, nullptr, nullptr) &&
+			GetLastError() != ERROR_NOT_ALL_ASSIGNED;
+		CloseHandle(hToken);
+
+		if (!enabled)
+		{
+			debugF("PageAllocator : SeLockMemoryPrivilege not held, large pages disabled");
+			return 0;
+		}
+		return kMinimum;
+	}();
+	return s_size;
+}
+
+u64 large_page_bytes_in_use()
+{
+	std::lock_guard<std::mutex> lock(s_largePageMutex);
+	return s_largePageBytes;
+}
+
+static void* alloc_large_pages(const size_t kBytes, const PagePlacement& placement)
+{
+	// Large page allocations must be a whole number of large pages
+	const size_t kLargePage = large_page_size();
+	const size_t kRounded = (kBytes + kLargePage - 1) / kLargePage * kLargePage;
+	const DWORD kType = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+	void* p = (placement.numaNode != kAnyNumaNode)
+		? VirtualAllocExNuma(GetCurrentProcess(), nullptr, kRounded, kType, PAGE_READWRITE, static_cast<DWORD>(placement.numaNode))
+		: VirtualAlloc(nullptr, kRounded, kType, PAGE_READWRITE);
+	if (p)
+	{
+		std::lock_guard<std::mutex> lock(s_largePageMutex);
+		s_largePageAllocs.push_back({ p, kRounded });
+		s_largePageBytes += kRounded;
+	}
+	return p;
+}
+
+static void forget_large_pages(void* p)
+{
+	std::lock_guard<std::mutex> lock(s_largePageMutex);
+	for (size_t i = 0; i < s_largePageAllocs.size(); ++i)
+	{
+		if (s_largePageAllocs[i].first == p)
+		{
+			s_largePageBytes -= s_largePageAllocs[i].second;
+			s_largePageAllocs[i] = s_largePageAllocs.back();
+			s_largePageAllocs.pop_back();
+			return;
+		}
+	}
+}
+
+// Node shares are rounded to the allocation granularity, which is a whole number of pages on every Windows target
+constexpr size_t kSpreadGranularity = 64 * 1024;
+
+static void* commit_spread(const size_t kBytes)
+{
+	const u32 kNodes = numa_node_count();
+	u8* pBase = static_cast<u8*>(VirtualAlloc(nullptr, kBytes, MEM_RESERVE, PAGE_READWRITE));
+	if (!pBase)
+		return nullptr;
+
+	// Node n prefers the n-th equal share of the range, rounded to whole pages
+	const size_t kPages = (kBytes + kSpreadGranularity - 1) / kSpreadGranularity;
+	for (u32 node = 0; node < kNodes; ++node)
+	{
+		const size_t kFirst = kPages * node / kNodes * kSpreadGranularity;
+		const size_t kLast = std::min(kBytes, kPages * (node + 1) / kNodes * kSpreadGranularity);
+		if (kFirst >= kLast)
+			continue;
+
+		if (!VirtualAllocExNuma(GetCurrentProcess(), pBase + kFirst, kLast - kFirst, MEM_COMMIT, PAGE_READWRITE, node))
+		{
+			VirtualFree(pBase, 0, MEM_RELEASE);
+			return nullptr;
+		}
+	}
+	return pBase;
+}
+
+void* page_alloc(const size_t kBytes, const PagePlacement& placement)
+{
+	if (kBytes < kPageAllocMinBytes)
+		return ::operator new(kBytes);
+
+	void* p = nullptr;
+	const bool kSpread = placement.numaNode == kAnyNumaNode && placement.spreadAcrossNodes && numa_node_count() > 1;
+	if (placement.largePages && !kSpread && large_page_size() != 0 && kBytes >= large_page_size())
+		p = alloc_large_pages(kBytes, placement);
+
+	if (p)
+		return p;
+	if (placement.numaNode != kAnyNumaNode)
+		p = VirtualAllocExNuma(GetCurrentProcess(), nullptr, kBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, static_cast<DWORD>(placement.numaNode));
+	else if (kSpread)
+		p = commit_spread(kBytes);
+
+	// Anything the NUMA calls refused still gets memory, just without a placement
+	if (!p)
+		p = VirtualAlloc(nullptr, kBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!p)
+		panicF("page_alloc : out of memory allocating %zu bytes", kBytes);
+	return p;
+}
+
+void page_free(void* p, const size_t kBytes)
+{
+	if (!p)
+		return;
+
+	if (kBytes < kPageAllocMinBytes)
+	{
+		::operator delete(p);
+		return;
+	}
+
+	if (large_page_size() != 0 && kBytes >= large_page_size())
+		forget_large_pages(p);
+	VirtualFree(p, 0, MEM_RELEASE);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+#include <type_traits>
+#include <vector>
+
+//================================================================================
+// NUMA topology
+//================================================================================
+
+constexpr s32 kAnyNumaNode = -1;
+
+u32 numa_node_count();
+
+// Splits [0, kCount) into one contiguous part per NUMA node, the same way
+// spread allocations split their pages
+void numa_node_range(const u32 kCount, const u32 kNode, u32& rBegin, u32& rEnd);
+
+// Restricts a thread to the processors of a node. Returns false if it couldn't.
+bool pin_thread_to_numa_node(HANDLE hThread, const u32 kNode);
+
+//================================================================================
+// Page allocation
+// Large buffers are allocated straight from the OS in whole pages so their
+// physical placement and page size can be chosen. Small ones go through the
+// regular heap.
+//
+// Large pages (2 MB on x64) need SeLockMemoryPrivilege and enough contiguous
+// physical memory, and have to be committed all at once. Whenever one of those
+// doesn't hold the allocation quietly falls back to normal pages.
+//================================================================================
+
+struct PagePlacement
+{
+	s32 numaNode = kAnyNumaNode;	// Node to place every page on
+	bool spreadAcrossNodes = true;	// With kAnyNumaNode: give node n the n-th equal part of the pages
+	bool largePages = true;			// Back the buffer with large pages when it is at least one large page in size.
+									// A buffer spread over several nodes keeps normal pages, since large pages
+									// can't be committed a node at a time and locality matters more.
+
+	bool operator==(const PagePlacement& other) const
+	{
+		return numaNode == other.numaNode && spreadAcrossNodes == other.spreadAcrossNodes && largePages == other.largePages;
+	}
+};
+
+// Allocations below this many bytes aren't worth a dedicated mapping
+constexpr size_t kPageAllocMinBytes = 256 * 1024;
+
+void* page_alloc(const size_t kBytes, const PagePlacement& placement);
+void page_free(void* p, const size_t kBytes);
+
+// Large page size, or 0 if large pages can't be used by this process
+size_t large_page_size();
+
+// Bytes currently allocated on large pages, to confirm they are actually in use
+u64 large_page_bytes_in_use();
+
+// Standard allocator over page_alloc, so buffers keep their std::vector interface
+template<typename T>
+class PageAllocator
+{
+public:
+	typedef T value_type;
+	// Containers always take each other's pages on move, whatever their placement
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	PageAllocator() {}
+	PageAllocator(const PagePlacement& placement) : m_placement(placement) {}
+	template<typename U>
+	PageAllocator(const PageAllocator<U>& other) : m_placement(other.get_placement()) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(page_alloc(n * sizeof(T), m_placement)); }
+	void deallocate(T* p, size_t n) { page_free(p, n * sizeof(T)); }
+
+	const PagePlacement& get_placement() const { return m_placement; }
+
+	template<typename U>
+	bool operator==(const PageAllocator<U>& other) const { return m_placement == other.get_placement(); }
+	template<typename U>
+	bool operator!=(const PageAllocator<U>& other) const { return !(*this == other); }
+
+private:
+	PagePlacement m_placement;
+};
+
+template<typename T>
+using PageVector = std::vector<T, PageAllocator<T>>;
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// ========================================================
+// struct SlotHandle
+// Refers to an element of a SlotMap. The generation changes
+// every time a slot is reused, so a handle to an element that
+// has been removed never finds whatever took its place.
+// ========================================================
+
+struct SlotHandle
+{
+	static constexpr u32 kInvalidIndex = ~0u;
+
+	u32 index = kInvalidIndex;
+	u32 generation = 0;
+
+	bool valid() const { return index != kInvalidIndex; }
+	bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+// ========================================================
+// class SlotMap
+// Elements are kept packed in one dense array, which is what
+// iteration walks. A sparse array of slots maps handles to
+// dense positions. Adding and removing are O(1): removal moves
+// the last element into the hole, so element order is not
+// preserved unless swap() is used to re-establish it.
+// ========================================================
+
+template<typename T>
+class SlotMap
+{
+public:
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+
+	SlotMap() {}
+	SlotMap(const SlotMap&) = delete;
+	SlotMap& operator=(const SlotMap&) = delete;
+
+	// Grow storage for kCount elements in total, so adding that many doesn't reallocate
+	void reserve(const u32 kCount)
+	{
+		m_dense.reserve(kCount);
+		m_slots.reserve(kCount);
+	}
+
+	template<typename... Args>
+	SlotHandle emplace(Args&&... args)
+	{
+		const u32 kDense = size();
+		m_dense.emplace_back(std::forward<Args>(args)...);
+
+		// Reuse a free slot if there is one, otherwise grow by one slot
+		u32 slot = m_freeHead;
+		if (slot != SlotHandle::kInvalidIndex)
+			m_freeHead = m_slots[slot].dense;
+		else
+		{
+			slot = static_cast<u32>(m_slots.size());
+			m_slots.push_back(Slot());
+		}
+
+		m_slots[slot].dense = kDense;
+		m_slots[kDense].owner = slot;
+
+		SlotHandle handle;
+		handle.index = slot;
+		handle.generation = m_slots[slot].generation;
+		return handle;
+	}
+
+	// Returns false if the handle was already stale
+	bool erase(const SlotHandle& handle)
+	{
+		if (!contains(handle))
+			return false;
+
+		const u32 kDense = m_slots[handle.index].dense;
+		const u32 kLast = size() - 1;
+		if (kDense != kLast)
+		{
+			// Fill the hole with the last element and repoint its slot
+			m_dense[kDense] = std::move(m_dense[kLast]);
+			const u32 kMovedSlot = m_slots[kLast].owner;
+			m_slots[kMovedSlot].dense = kDense;
+			m_slots[kDense].owner = kMovedSlot;
+		}
+		m_dense.pop_back();
+
+		// Retire the slot: a new generation invalidates outstanding handles
+		Slot& slot = m_slots[handle.index];
+		++slot.generation;
+		slot.dense = m_freeHead;
+		m_freeHead = handle.index;
+		return true;
+	}
+
+	void clear()
+	{
+		m_dense.clear();
+		m_slots.clear();
+		m_freeHead = SlotHandle::kInvalidIndex;
+	}
+
+	bool contains(const SlotHandle& handle) const
+	{
+		return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation &&
+			m_slots[handle.index].dense < size() && m_slots[m_slots[handle.index].dense].owner == handle.index;
+	}
+
+	// nullptr if the handle is stale
+	T* get(const SlotHandle& handle) { return contains(handle) ? &m_dense[m_slots[handle.index].dense] : nullptr; }
+	const T* get(const SlotHandle& handle) const { return contains(handle) ? &m_dense[m_slots[handle.index].dense] : nullptr; }
+
+	// Handle of the element at a dense position
+	SlotHandle handle_at(const u32 kDense) const
+	{
+		ASSERT(kDense < size());
+		SlotHandle handle;
+		handle.index = m_slots[kDense].owner;
+		handle.generation = m_slots[handle.index].generation;
+		return handle;
+	}
+
+	// Exchanges the elements at two dense positions. Handles stay valid.
+	void swap(const u32 kDenseA, const u32 kDenseB)
+	{
+		ASSERT(kDenseA < size() && kDenseB < size());
+		if (kDenseA == kDenseB)
+			return;
+		std::swap(m_dense[kDenseA], m_dense[kDenseB]);
+		const u32 kSlotA = m_slots[kDenseA].owner;
+		set_owner(kDenseA, m_slots[kDenseB].owner);
+		set_owner(kDenseB, kSlotA);
+	}
+
+	u32 size() const { return static_cast<u32>(m_dense.size()); }
+	bool empty() const { return m_dense.empty(); }
+
+	T& operator[](const u32 kDense) { return m_dense[kDense]; }
+	const T& operator[](const u32 kDense) const { return m_dense[kDense]; }
+
+	iterator begin() { return m_dense.begin(); }
+	iterator end() { return m_dense.end(); }
+	const_iterator begin() const { return m_dense.cbegin(); }
+	const_iterator end() const { return m_dense.cend(); }
+	const_iterator cbegin() const { return m_dense.cbegin(); }
+	const_iterator cend() const { return m_dense.cend(); }
+
+private:
+	// Slot i doubles as the back-reference for dense position i, so the map needs only two arrays
+	struct Slot
+	{
+		u32 dense = SlotHandle::kInvalidIndex;	// Dense position while live, next free slot once retired
+		u32 generation = 0;
+		u32 owner = SlotHandle::kInvalidIndex;	// Slot of the element at dense position i
+	};
+
+	void set_owner(const u32 kDense, const u32 kSlot)
+	{
+		m_slots[kDense].owner = kSlot;
+		m_slots[kSlot].dense = kDense;
+	}
+
+	std::vector<T> m_dense;
+	std::vector<Slot> m_slots;	// Never smaller than m_dense
+	u32 m_freeHead = SlotHandle::kInvalidIndex;
+};
@@ -0,0 +1,192 @@
+#include "TaskGraph.h"
+
+static const u32 kNoTask = ~0u;
+
+u32 TaskGraph::add_task(const char* pName, TaskFn fn, bool mainThread)
+{
+	Task task;
+	task.name = pName;
+	task.fn = std::move(fn);
+	task.mainThread = mainThread;
+	m_tasks.push_back(std::move(task));
+	m_compiled = false;
+	return static_cast<u32>(m_tasks.size() - 1);
+}
+
+void TaskGraph::add_dependency(u32 before, u32 after)
+{
+	ASSERT(before < m_tasks.size() && after < m_tasks.size() && before != after);
+	m_edges.push_back({ before, after });
+	m_compiled = false;
+}
+
+void TaskGraph::clear()
+{
+	m_tasks.clear();
+	m_edges.clear();
+	m_criticalPath.clear();
+	m_criticalPathMs = 0.0f;
+	m_compiled = false;
+}
+
+void TaskGraph::compile()
+{
+	const u32 kNumTasks = num_tasks();
+
+	// Successor and predecessor lists, stored as offsets into one array each
+	m_successorOffsets.assign(kNumTasks + 1, 0);
+	m_predecessorOffsets.assign(kNumTasks + 1, 0);
+	for (const auto& edge : m_edges)
+	{
+		++m_successorOffsets[edge.first + 1];
+		++m_predecessorOffsets[edge.second + 1];
+	}
+	for (u32 i = 0; i < kNumTasks; ++i)
+	{
+		m_successorOffsets[i + 1] += m_successorOffsets[i];
+		m_predecessorOffsets[i + 1] += m_predecessorOffsets[i];
+	}
+
+	m_successors.resize(m_edges.size());
+	m_predecessors.resize(m_edges.size());
+	std::vector<u32> successorFill(m_successorOffsets.begin(), m_successorOffsets.end() - 1);
+	std::vector<u32> predecessorFill(m_predecessorOffsets.begin(), m_predecessorOffsets.end() - 1);
+	for (const auto& edge : m_edges)
+	{
+		m_successors[successorFill[edge.first]++] = edge.second;
+		m_predecessors[predecessorFill[edge.second]++] = edge.first;
+	}
+
+	// Topological order, which also rejects cycles
+	std::vector<u32> inDegree(kNumTasks);
+	m_topologicalOrder.clear();
+	m_topologicalOrder.reserve(kNumTasks);
+	for (u32 i = 0; i < kNumTasks; ++i)
+	{
+		m_tasks[i].numDependencies = m_predecessorOffsets[i + 1] - m_predecessorOffsets[i];
+		inDegree[i] = m_tasks[i].numDependencies;
+		if (inDegree[i] == 0)
+			m_topologicalOrder.push_back(i);
+	}
+	for (u32 i = 0; i < m_topologicalOrder.size(); ++i)
+	{
+		const u32 kTask = m_topologicalOrder[i];
+		for (u32 j = m_successorOffsets[kTask]; j < m_successorOffsets[kTask + 1]; ++j)
+		{
+			if (--inDegree[m_successors[j]] == 0)
+				m_topologicalOrder.push_back(m_successors[j]);
+		}
+	}
+	if (m_topologicalOrder.size() != kNumTasks)
+		panicF("TaskGraph : the dependencies contain a cycle");
+
+	// Everything execute() needs, sized up front
+	m_pPending.reset(new std::atomic<u32>[kNumTasks]);
+	m_mainReady.resize(kNumTasks);
+	m_finishMs.resize(kNumTasks);
+	m_criticalPrev.resize(kNumTasks);
+	m_criticalPath.reserve(kNumTasks);
+	m_compiled = true;
+}
+
+void TaskGraph::execute(JobQueue& queue)
+{
+	if (!m_compiled)
+		compile();
+
+	const u32 kNumTasks = num_tasks();
+	const Clock::time_point kStart = Clock::now();
+
+	m_pQueue = &queue;
+	m_mainReadyCount = 0;
+	m_remaining.store(kNumTasks, std::memory_order_relaxed);
+	for (u32 i = 0; i < kNumTasks; ++i)
+		m_pPending[i].store(m_tasks[i].numDependencies, std::memory_order_relaxed);
+
+	for (u32 i = 0; i < kNumTasks; ++i)
+	{
+		if (m_tasks[i].numDependencies == 0)
+			make_ready(i);
+	}
+
+	// Run main thread tasks as they become ready and help the pool the rest of the time
+	while (m_remaining.load(std::memory_order_acquire) != 0)
+	{
+		u32 task = kNoTask;
+		{
+			std::lock_guard<std::mutex> lock(m_mainMutex);
+			if (m_mainReadyCount > 0)
+				task = m_mainReady[--m_mainReadyCount];
+		}
+
+		if (task != kNoTask)
+			run_task(task);
+		else if (!queue.runOne())
+			std::this_thread::yield();
+	}
+	queue.wait(m_handle);
+
+	m_executeMs = std::chrono::duration<f32, std::milli>(Clock::now() - kStart).count();
+	compute_critical_path();
+}
+
+void TaskGraph::run_task(u32 task)
+{
+	const Clock::time_point kStart = Clock::now();
+	m_tasks[task].fn();
+	m_tasks[task].ms = std::chrono::duration<f32, std::milli>(Clock::now() - kStart).count();
+
+	for (u32 j = m_successorOffsets[task]; j < m_successorOffsets[task + 1]; ++j)
+	{
+		const u32 kSuccessor = m_successors[j];
+		if (m_pPending[kSuccessor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			make_ready(kSuccessor);
+	}
+	m_remaining.fetch_sub(1, std::memory_order_release);
+}
+
+void TaskGraph::make_ready(u32 task)
+{
+	if (m_tasks[task].mainThread)
+	{
+		std::lock_guard<std::mutex> lock(m_mainMutex);
+		m_mainReady[m_mainReadyCount++] = task;
+	}
+	else
+	{
+		m_pQueue->pushJob([this, task]() { run_task(task); }, &m_handle);
+	}
+}
+
+void TaskGraph::compute_critical_path()
+{
+	// Earliest finish of each task if every task started as soon as its dependencies allowed
+	u32 last = kNoTask;
+	m_criticalPathMs = 0.0f;
+	for (u32 task : m_topologicalOrder)
+	{
+		f32 start = 0.0f;
+		m_criticalPrev[task] = kNoTask;
+		for (u32 j = m_predecessorOffsets[task]; j < m_predecessorOffsets[task + 1]; ++j)
+		{
+			const u32 kPredecessor = m_predecessors[j];
+			if (m_finishMs[kPredecessor] > start)
+			{
+				start = m_finishMs[kPredecessor];
+				m_criticalPrev[task] = kPredecessor;
+			}
+		}
+
+		m_finishMs[task] = start + m_tasks[task].ms;
+		if (last == kNoTask || m_finishMs[task] > m_criticalPathMs)
+		{
+			m_criticalPathMs = m_finishMs[task];
+			last = task;
+		}
+	}
+
+	m_criticalPath.clear();
+	for (u32 task = last; task != kNoTask; task = m_criticalPrev[task])
+		m_criticalPath.push_back(task);
+	std::reverse(m_criticalPath.begin(), m_criticalPath.end());
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "JobQueue.h"
+
+#include <chrono>
+#include <string>
+
+//================================================================================
+// TaskGraph
+// A set of tasks and the dependencies between them, built once and executed as
+// many times as needed. Tasks run on a JobQueue as soon as their dependencies
+// have finished, except main thread tasks (anything touching the immediate
+// device context), which run on the thread calling execute().
+// Executing doesn't allocate: all per-run state is sized by compile().
+//================================================================================
+class TaskGraph
+{
+public:
+	typedef std::function<void()> TaskFn;
+
+	TaskGraph() {}
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	// Building
+	u32 add_task(const char* pName, TaskFn fn, bool mainThread = false);
+	void add_dependency(u32 before, u32 after);
+	void compile();
+	void clear();
+
+	// Runs every task once and returns when all have finished
+	void execute(JobQueue& queue);
+
+	// Timings from the last execute()
+	u32 num_tasks() const { return static_cast<u32>(m_tasks.size()); }
+	const char* get_task_name(u32 task) const { return m_tasks[task].name.c_str(); }
+	f32 get_task_ms(u32 task) const { return m_tasks[task].ms; }
+	f32 get_execute_ms() const { return m_executeMs; }
+
+	// Longest chain of dependent tasks by time - the floor on execute() however many threads there are
+	const std::vector<u32>& get_critical_path() const { return m_criticalPath; }
+	f32 get_critical_path_ms() const { return m_criticalPathMs; }
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Task
+	{
+		std::string name;
+		TaskFn fn;
+		bool mainThread = false;
+		u32 numDependencies = 0;
+		f32 ms = 0.0f;
+	};
+
+	void run_task(u32 task);
+	void make_ready(u32 task);
+	void compute_critical_path();
+
+private:
+	std::vector<Task> m_tasks;
+	std::vector<std::pair<u32, u32>> m_edges;
+
+	// Built by compile()
+	std::vector<u32> m_successorOffsets;
+	std::vector<u32> m_successors;
+	std::vector<u32> m_predecessorOffsets;
+	std::vector<u32> m_predecessors;
+	std::vector<u32> m_topologicalOrder;
+	std::unique_ptr<std::atomic<u32>[]> m_pPending;		// Unfinished dependencies of each task this run
+	bool m_compiled = false;
+
+	// Main thread tasks that are ready to run, filled by workers
+	std::mutex m_mainMutex;
+	std::vector<u32> m_mainReady;
+	u32 m_mainReadyCount = 0;
+
+	JobQueue* m_pQueue = nullptr;
+	std::atomic<u32> m_remaining{ 0 };
+	JobHandle m_handle;
+
+	std::vector<f32> m_finishMs;
+	std::vector<u32> m_criticalPrev;
+	std::vector<u32> m_criticalPath;
+	f32 m_criticalPathMs = 0.0f;
+	f32 m_executeMs = 0.0f;
+};
@@ -3,6 +3,8 @@
 //////////////////////
 
 static const float PI = 3.14159265f;
+// Distance of each vertex's tangent plane points, kTangentPointOffset in Mesh.h
+static const float kTangentPointOffset = 0.001f;
 
 // Kelvinlet data
 struct Kelvinlet
@@ -16,14 +18,11 @@ struct Kelvinlet
 	int type;				// Is the Kelvinlet Impulse, Scale or Pinch?
 };
 
-// Vertex data
-struct Vertex
+// Vertex tangent frame data
+struct TangentFrame
 {
-	float3 pos;
-	uint color;
 	float3 normal;
 	float4 tangent;
-	float2 uv;
 };
 
 // Vertex displacements
@@ -51,15 +50,16 @@ cbuffer PerFrameCB : register(b0)
 // Per instance data
 cbuffer PerInstanceCB : register(b1)
 {
-	matrix matModel;	// Model matrix
+	matrix matModel;	// Model matrix, unused here since evaluation is in object space
 	uint numVertices;	// Number of vertices in this instance
 	uint numKelvinlets; // Number of kelvinlets attached to this instance
 	float alpha;		// Material parameter: pressure wave speed
 	float beta;			// Material parameter: shear wave speed
 };
 
-StructuredBuffer<Vertex> vertices : register(t0);
-StructuredBuffer<Kelvinlet> kelvinlets : register(t1);
+StructuredBuffer<float3> positions : register(t0);
+StructuredBuffer<Kelvinlet> kelvinlets : register(t1);	// The instance's own then the scene field's, in its object space
+StructuredBuffer<TangentFrame> tangentFrames : register(t2);
 RWStructuredBuffer<Displacement> displacements : register(u0);
 
 /////////////////////////////////////
@@ -208,14 +208,14 @@ void CS_Kelvinlet(uint3 DispatchThreadID : SV_DispatchThreadID)
 	// Prevent undefined behaviour by not utilising more threads than vertices
 	if (myID < numVertices)
 	{
-		// Read a vertex position and transform to world space
-		Vertex vertex = vertices[myID];
-		float3 vpos = mul(float4(vertex.pos, 1.0f), matModel).xyz;
+		// Read a vertex position. The Kelvinlets were uploaded in object space, so no transform is needed.
+		float3 vpos = positions[myID];
+		TangentFrame frame = tangentFrames[myID];
 		
 		// Find local points in the vertex's tangent plane
-		float3 bitangent = cross(vertex.normal, vertex.tangent.xyz);
-		float3 localPos1 = vpos + 0.001f * vertex.tangent.xyz;
-		float3 localPos2 = vpos + 0.001f * bitangent;
+		float3 bitangent = cross(frame.normal, frame.tangent.xyz);
+		float3 localPos1 = vpos + kTangentPointOffset * frame.tangent.xyz;
+		float3 localPos2 = vpos + kTangentPointOffset * bitangent;
 
 		float3 D1, D2, D3;
 		
@@ -1,4 +1,7 @@
 static const float PI = 3.14159265f;
+// Distance of each vertex's tangent plane points, kTangentPointOffset in Mesh.h. It has to match the
+// one the displacements were evaluated at, or the rebuilt normal is off.
+static const float kTangentPointOffset = 0.001f;
 
 struct Displacement
 {
@@ -69,20 +72,23 @@ VertexOutput VS_Main(VertexInput input, uint vertexID : SV_VertexID)
 	output.color = input.color;
 	output.tangent = input.tangent;
 	output.uv = input.uv;
-	output.vpos = mul(float4(input.pos, 1.0f), matModel);
+	// Displacements are evaluated in object space, so they are applied before the model transform
+	float3 pos = input.pos;
 
 	// Find two local points in the vertex's tangent plane
 	float3 bitangent = cross(input.normal, input.tangent.xyz);
-	float3 localPos1 = output.vpos.xyz + 0.1f * input.tangent.xyz;
-	float3 localPos2 = output.vpos.xyz + 0.1f * bitangent;
+	float3 localPos1 = pos + kTangentPointOffset * input.tangent.xyz;
+	float3 localPos2 = pos + kTangentPointOffset * bitangent;
 
 	// Add the corresponding Kelvinlet displacements to the vertex and its neighbours
-	output.vpos.xyz += displacements[vertexID].vertexDisplacement;
+	pos += displacements[vertexID].vertexDisplacement;
 	localPos1 += displacements[vertexID].neighbourDisplacement1;
 	localPos2 += displacements[vertexID].neighbourDisplacement2;
 
 	// Estimate the tangent plane after displacement
-	float3 estimatedNormal = normalize(cross(localPos1 - output.vpos.xyz, localPos2 - output.vpos.xyz));
+	float3 estimatedNormal = normalize(cross(localPos1 - pos, localPos2 - pos));
+
+	output.vpos = mul(float4(pos, 1.0f), matModel);
 
 	// Create matrix for sending the displaced vertex to screen space
 	matrix matVP = mul(matView, matProjection);
@@ -1,7 +1,8 @@
 #include "KDisplacementManager.h"
 
 KDisplacementManager::KDisplacementManager(KDisplacementManager&& other) :
-	m_displacements(other.m_displacements),
+	m_numVertices(other.m_numVertices),
+	m_displacements(std::move(other.m_displacements)),
 	m_pDisplacementBuffer(nullptr),
 	m_pDisplacementBufferSRV(nullptr),
 	m_pDisplacementBufferUAV(nullptr)
@@ -19,7 +20,8 @@ KDisplacementManager& KDisplacementManager::operator=(KDisplacementManager&& oth
 	if (this != &other)
 	{
 		release();
-		m_displacements = other.m_displacements;
+		m_numVertices = other.m_numVertices;
+		m_displacements = std::move(other.m_displacements);
 		m_pDisplacementBuffer = other.m_pDisplacementBuffer;
 		m_pDisplacementBufferSRV = other.m_pDisplacementBufferSRV;
 		m_pDisplacementBufferUAV = other.m_pDisplacementBufferUAV;
@@ -38,10 +40,7 @@ KDisplacementManager::~KDisplacementManager()
 
 void KDisplacementManager::init(SystemsInterface& systems)
 {
-	// Fill displacement buffer with zeros
-	KDisplacement kd;
-	for (size_t i = 0; i < m_numVertices; ++i)
-		m_displacements.push_back(kd);
+	// The CPU copy is only allocated once something evaluates on the CPU
 	create_displacement_buffer(systems);
 }
 
@@ -58,30 +57,58 @@ void KDisplacementManager::release()
 
 void KDisplacementManager::zero_displacement_buffer(ID3D11DeviceContext* pContext)
 {
-	zero_dynamic_structured_buffer<KDisplacement>(pContext, m_pDisplacementBuffer, m_displacements.size());
+	// The buffer is D3D11_USAGE_DEFAULT, which can't be mapped
+	zero_default_structured_buffer(pContext, m_pDisplacementBufferUAV);
+}
+
+PageVector<KDisplacement>& KDisplacementManager::get_displacements()
+{
+	if (m_displacements.size() != m_numVertices)
+		m_displacements.assign(m_numVertices, KDisplacement());
+	return m_displacements;
+}
+
+void KDisplacementManager::release_cpu_displacements()
+{
+	PageVector<KDisplacement>().swap(m_displacements);
+}
+
+MemoryUsage KDisplacementManager::memory_usage() const
+{
+	MemoryUsage usage;
+	usage.cpuBytes = m_displacements.capacity() * sizeof(KDisplacement);
+	if (m_pDisplacementBuffer)
+		usage.gpuBytes = static_cast<u64>(m_numVertices) * sizeof(KDisplacement);
+	return usage;
+}
+
+void KDisplacementManager::upload_displacements(ID3D11DeviceContext* pContext)
+{
+	// The buffer is D3D11_USAGE_DEFAULT so the CPU results go up through UpdateSubresource
+	ASSERT(m_displacements.size() == m_numVertices);
+	pContext->UpdateSubresource(m_pDisplacementBuffer, 0, nullptr, m_displacements.data(), 0, 0);
 }
 
 void KDisplacementManager::resize_displacement_buffer(SystemsInterface& systems, size_t numVertices)
 {
 	// Resize displacement buffers to accomodate a new mesh
-	m_displacements.resize(numVertices);
+	m_numVertices = static_cast<u32>(numVertices);
+	if (!m_displacements.empty())
+		m_displacements.assign(m_numVertices, KDisplacement());
 	release();
 	create_displacement_buffer(systems);
 }
 
 void KDisplacementManager::create_displacement_buffer(SystemsInterface& systems)
 {
-	D3D11_SUBRESOURCE_DATA data;
-	data.pSysMem = m_displacements.data();
-	data.SysMemPitch = 0;
-	data.SysMemSlicePitch = 0;
-
+	// Created without initial data, so no zeroed copy has to be built on the CPU first
 	m_pDisplacementBuffer =
-		create_default_structured_buffer<KDisplacement>(systems.pD3DDevice, m_displacements.size(), &data);
+		create_default_structured_buffer<KDisplacement>(systems.pD3DDevice, m_numVertices, nullptr);
 	m_pDisplacementBufferSRV =
-		create_structured_buffer_SRV(systems.pD3DDevice, m_displacements.size(), m_pDisplacementBuffer);
+		create_structured_buffer_SRV(systems.pD3DDevice, m_numVertices, m_pDisplacementBuffer);
 	m_pDisplacementBufferUAV =
-		create_structured_buffer_UAV(systems.pD3DDevice, m_displacements.size(), m_pDisplacementBuffer);
+		create_structured_buffer_UAV(systems.pD3DDevice, m_numVertices, m_pDisplacementBuffer);
+	zero_displacement_buffer(systems.pD3DContext);
 }
 
 void KDisplacementManager::bind_displacements_SRV_to_VS(ID3D11DeviceContext* pContext, u32 slot) const
@@ -1,6 +1,7 @@
 #pragma once
 #include "Manager.h"
 #include "KDisplacement.h"
+#include "PageAllocator.h"
 
 #include <vector>
 
@@ -23,12 +24,22 @@ public:
 	void bind_displacements_UAV_to_CS(ID3D11DeviceContext* pContext, u32 slot) const;
 	void zero_displacement_buffer(ID3D11DeviceContext* pContext);
 
+	// CPU copy of the displacements, filled when evaluating on the CPU. Spread over the NUMA nodes
+	// in the same proportions as the mesh's evaluation streams. Allocated on first use and freed
+	// again by release_cpu_displacements, so GPU-only instances don't carry it.
+	PageVector<KDisplacement>& get_displacements();
+	const PageVector<KDisplacement>& get_displacements() const { return m_displacements; }
+	void release_cpu_displacements();
+	void upload_displacements(ID3D11DeviceContext* pContext);
+
+	MemoryUsage memory_usage() const;
+
 private:
 	void create_displacement_buffer(SystemsInterface&);
 	
 private:
 	u32 m_numVertices;
-	std::vector<KDisplacement> m_displacements;
+	PageVector<KDisplacement> m_displacements;
 	ID3D11Buffer* m_pDisplacementBuffer = nullptr;
 	ID3D11UnorderedAccessView* m_pDisplacementBufferUAV = nullptr;
 	ID3D11ShaderResourceView* m_pDisplacementBufferSRV = nullptr;
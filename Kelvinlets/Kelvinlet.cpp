@@ -3,4 +3,13 @@
 Kelvinlet::Kelvinlet() :
 	loadCentre(0.0f), epsilon(1.0f), forceParams(0.0f),
 	startTime(0.0f), age(0.0f), lifespan(0.0f), type(0)
-{}
\ No newline at end of file
+{}
+
+Kelvinlet Kelvinlet::transformed(const m4x4& mat) const
+{
+	Kelvinlet k = *this;
+	k.loadCentre = v3::Transform(loadCentre, mat);
+	if (type == 1)	// Impulse forces are directions
+		k.forceParams = v3::TransformNormal(forceParams, mat);
+	return k;
+}
@@ -12,4 +12,8 @@ struct Kelvinlet
 	int type;	// 0 = null Kelvinlet, 1 = Impulse, 2 = Pinch, 3 = Scale
 
 	Kelvinlet();	// Default initialization is a null Kelvinlet
+
+	// Copy with the load centre and impulse force taken into another space, e.g. a mesh's object space.
+	// Pinch and scale factors are left alone, which is exact for the translations instances are placed with.
+	Kelvinlet transformed(const m4x4& mat) const;
 };
@@ -0,0 +1,715 @@
+#include "KelvinletEngine.h"
+#include "JobQueue.h"
+#include "MeshInstance.h"
+#include "MeshStreamFile.h"
+
+#include <algorithm>
+
+// Scratch memory reused between evaluations
+struct EngineScratch
+{
+	std::vector<Kelvinlet> active;			// Kelvinlets with a type, packed together
+	std::vector<KDisplacement> partials;	// One displacement buffer per Kelvinlet slice after the first
+	std::vector<KelvinletEvalParams> groupParams;	// Per evaluated instance of a group, over the packed Kelvinlets
+	std::vector<KDisplacement*> groupOutputs;
+	std::vector<u32> groupEvaluated;				// Indices of the instances a group evaluates
+	std::vector<u32> keyTable;						// Open addressing table of instance indices for find_shared_evaluations
+	std::vector<u64> keys;							// Evaluation key of each instance in the table
+	KelvinletLattice lattice;
+	std::vector<v3> proxyDisplacements;			// Per proxy vertex
+	std::vector<f32> chunkErrors;				// Asymptotic error bound per Kelvinlet slice and mesh chunk
+	std::vector<f32> packStrengths;				// Displacement bound of each Kelvinlet pack_kelvinlets ranks
+	std::vector<u32> packOrder;
+};
+
+// Scratch is leased from a pool rather than kept per thread, because a thread waiting on one
+// evaluation's jobs can pick up another instance's evaluation in the meantime
+class ScratchLease
+{
+public:
+	ScratchLease()
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		if (s_free.empty())
+			s_free.emplace_back(new EngineScratch);
+		m_pScratch = std::move(s_free.back());
+		s_free.pop_back();
+	}
+	~ScratchLease()
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		s_free.push_back(std::move(m_pScratch));
+	}
+	ScratchLease(const ScratchLease&) = delete;
+	ScratchLease& operator=(const ScratchLease&) = delete;
+
+	EngineScratch& get() { return *m_pScratch; }
+
+private:
+	std::unique_ptr<EngineScratch> m_pScratch;
+
+	static std::mutex s_mutex;
+	static std::vector<std::unique_ptr<EngineScratch>> s_free;
+};
+
+std::mutex ScratchLease::s_mutex;
+std::vector<std::unique_ptr<EngineScratch>> ScratchLease::s_free;
+
+static void accumulate(KDisplacement& rDst, const KDisplacement& src)
+{
+	rDst.displacement += src.displacement;
+	rDst.auxDisplacement1 += src.auxDisplacement1;
+	rDst.auxDisplacement2 += src.auxDisplacement2;
+}
+
+KelvinletEvalParams KelvinletEngine::make_eval_params(const MeshInstance& mi)
+{
+	// Matches the per-instance constant buffer the compute shader receives
+	const KelvinletManager& km = mi.get_kelvinlet_manager();
+	KelvinletEvalParams params;
+	params.pKelvinlets = km.get_evaluated_kelvinlets();
+	params.numKelvinlets = km.get_num_kelvinlets();
+	params.pFieldKelvinlets = mi.get_field_kelvinlets();
+	params.numFieldKelvinlets = mi.get_num_field_kelvinlets();
+	params.alpha = km.get_alpha();
+	params.beta = km.get_beta();
+	params.matWorldToObject = mi.get_world_to_object();
+	return params;
+}
+
+f32 KelvinletEngine::max_displacement(const MeshInstance& mi)
+{
+	// Displacements add, so their bounds do too. Each is bounded over the instance's bounding sphere in object
+	// space, where the vertices are evaluated.
+	const KelvinletManager& km = mi.get_kelvinlet_manager();
+	const MeshBounds& bounds = mi.get_mesh().get_bounds();
+	const Kelvinlet* pKelvinlets = km.get_evaluated_kelvinlets();
+	f32 bound = 0.0f;
+	for (u32 k = 0; k < km.get_num_kelvinlets(); ++k)
+	{
+		if (pKelvinlets[k].type != 0)
+			bound += kelvinlet_displacement_bound(pKelvinlets[k].transformed(mi.get_world_to_object()), km.get_alpha(),
+				km.get_beta(), bounds.sphereCentre, bounds.sphereRadius);
+	}
+	for (u32 k = 0; k < mi.get_num_field_kelvinlets(); ++k)
+		bound += kelvinlet_displacement_bound(mi.get_field_kelvinlets()[k].transformed(mi.get_world_to_object()),
+			km.get_alpha(), km.get_beta(), bounds.sphereCentre, bounds.sphereRadius);
+	return bound;
+}
+
+// Appends the live Kelvinlets an evaluation reads to the scratch's active list, its own then any from the scene's
+// field, in object space. Past kMaxKelvinlets only those that can move a point of kBounds' sphere furthest are kept,
+// in their original order.
+static void pack_kelvinlets(const KelvinletEvalParams& params, const MeshBounds& kBounds, const u32 kMaxKelvinlets,
+	EngineScratch& rScratch)
+{
+	std::vector<Kelvinlet>& rOut = rScratch.active;
+	const size_t kFirst = rOut.size();
+	for (u32 k = 0; k < params.numKelvinlets; ++k)
+	{
+		if (params.pKelvinlets[k].type != 0)
+			rOut.push_back(params.pKelvinlets[k].transformed(params.matWorldToObject));
+	}
+	for (u32 k = 0; k < params.numFieldKelvinlets; ++k)
+		rOut.push_back(params.pFieldKelvinlets[k].transformed(params.matWorldToObject));
+
+	const u32 kPacked = static_cast<u32>(rOut.size() - kFirst);
+	if (kPacked <= kMaxKelvinlets)
+		return;
+
+	// Each bound is worked out once, then the strongest are picked by index
+	std::vector<f32>& strengths = rScratch.packStrengths;
+	std::vector<u32>& order = rScratch.packOrder;
+	strengths.resize(kPacked);
+	order.resize(kPacked);
+	for (u32 k = 0; k < kPacked; ++k)
+	{
+		strengths[k] = kelvinlet_displacement_bound(rOut[kFirst + k], params.alpha, params.beta, kBounds.sphereCentre,
+			kBounds.sphereRadius);
+		order[k] = k;
+	}
+	std::nth_element(order.begin(), order.begin() + kMaxKelvinlets, order.end(),
+		[&strengths](const u32 a, const u32 b) { return strengths[a] > strengths[b]; });
+
+	// Kept indices in ascending order never point below where they land, so they compact in place
+	std::sort(order.begin(), order.begin() + kMaxKelvinlets);
+	for (u32 k = 0; k < kMaxKelvinlets; ++k)
+		rOut[kFirst + k] = rOut[kFirst + order[k]];
+	rOut.resize(kFirst + kMaxKelvinlets);
+}
+
+u32 KelvinletEngine::choose_kelvinlet_slices(const u32 kNumVertices, const u32 kNumKelvinlets, const u32 kNumThreads)
+{
+	// Vertex ranges alone keep every thread busy on big meshes. On small meshes each thread also
+	// takes a slice of the Kelvinlets, as long as a slice is big enough to pay for its reduction.
+	const u32 kVertexRanges = (kNumVertices + kVertexGrain - 1) / kVertexGrain;
+	const u32 kWantedJobs = kNumThreads * 2;
+	if (kNumThreads <= 1 || kVertexRanges >= kWantedJobs)
+		return 1;
+
+	const u32 kSlices = (kWantedJobs + kVertexRanges - 1) / kVertexRanges;
+	return std::max(1u, std::min(kSlices, kNumKelvinlets / kMinSliceKelvinlets));
+}
+
+KelvinletEngine::AsymptoticBlocks KelvinletEngine::asymptotic_blocks(const Mesh& mesh) const
+{
+	AsymptoticBlocks blocks;
+	const u32 kChunks = (mesh.num_vertices() + kMeshChunkSize - 1) / kMeshChunkSize;
+	if (m_asymptoticEvaluation && mesh.get_chunk_bounds().size() == kChunks)
+	{
+		blocks.pChunkBounds = mesh.get_chunk_bounds().data();
+		blocks.tolerance = m_asymptoticTolerance * mesh.get_bounds().sphereRadius;
+	}
+	return blocks;
+}
+
+void KelvinletEngine::evaluate_range(const KelvinletEvalParams& packed, const AsymptoticBlocks& blocks,
+	const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kBegin, const u32 kEnd, KDisplacement* pOut,
+	f32* pChunkErrors) const
+{
+	if (!blocks.pChunkBounds)
+	{
+		evaluate_kelvinlet_displacements(packed, pPositions + kBegin, pFrames + kBegin, kEnd - kBegin, pOut + kBegin);
+		return;
+	}
+
+	// Ranges needn't start on a chunk, but each part of a chunk still lies within the chunk's bounds
+	KelvinletAsymptoticStats stats;
+	for (u32 first = kBegin; first < kEnd;)
+	{
+		const u32 kChunk = first / kMeshChunkSize;
+		const u32 kLast = std::min(kEnd, (kChunk + 1) * kMeshChunkSize);
+		const f32 kError = evaluate_kelvinlet_displacements(packed, pPositions + first, pFrames + first, kLast - first,
+			blocks.pChunkBounds[kChunk], blocks.tolerance, pOut + first, stats);
+		if (pChunkErrors)
+			pChunkErrors[kChunk] = kError;
+		else
+			stats.maxErrorBound = std::max(stats.maxErrorBound, kError);
+		first = kLast;
+	}
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_asymptoticStats.asymptoticPairs += stats.asymptoticPairs;
+	m_asymptoticStats.directPairs += stats.directPairs;
+	m_asymptoticStats.maxErrorBound = std::max(m_asymptoticStats.maxErrorBound, stats.maxErrorBound);
+}
+
+void KelvinletEngine::evaluate_parallel(const KelvinletEvalParams& params, const MeshBounds& kBounds,
+	const u32 kMaxKelvinlets, const AsymptoticBlocks& blocks, const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount,
+	KDisplacement* pOut) const
+{
+	JobQueue& queue = global_job_queue();
+
+	// Pack the live Kelvinlets in object space so slices split the real work evenly
+	ScratchLease lease;
+	EngineScratch& scratch = lease.get();
+	scratch.active.clear();
+	pack_kelvinlets(params, kBounds, kMaxKelvinlets, scratch);
+
+	KelvinletEvalParams packed = params;
+	packed.pKelvinlets = scratch.active.data();
+	packed.numKelvinlets = static_cast<u32>(scratch.active.size());
+	packed.pFieldKelvinlets = nullptr;
+	packed.numFieldKelvinlets = 0;
+
+	const u32 kSlices = choose_kelvinlet_slices(kCount, packed.numKelvinlets, queue.numWorkers() + 1);
+	if (kSlices == 1)
+	{
+		// Vertex ranges go to the node holding their streams and displacements
+		queue.parallel_for_numa(0, kCount, kVertexGrain, [&](u32 begin, u32 end)
+		{
+			evaluate_range(packed, blocks, pPositions, pFrames, begin, end, pOut);
+		});
+		return;
+	}
+
+	// Slice 0 writes straight to the output, the others to partial buffers
+	scratch.partials.resize(static_cast<size_t>(kSlices - 1) * kCount);
+	KDisplacement* pPartials = scratch.partials.data();
+	auto slice_output = [=](u32 slice) { return slice == 0 ? pOut : pPartials + static_cast<size_t>(slice - 1) * kCount; };
+
+	// A vertex's asymptotic error is the sum of its chunk's over the slices, so each slice keeps its own
+	static_assert(kVertexGrain % kMeshChunkSize == 0, "Vertex ranges must not share a chunk");
+	const u32 kChunks = (kCount + kMeshChunkSize - 1) / kMeshChunkSize;
+	f32* pChunkErrors = nullptr;
+	if (blocks.pChunkBounds)
+	{
+		scratch.chunkErrors.assign(static_cast<size_t>(kSlices) * kChunks, 0.0f);
+		pChunkErrors = scratch.chunkErrors.data();
+	}
+
+	// One job per (slice, vertex range)
+	const u32 kVertexRanges = (kCount + kVertexGrain - 1) / kVertexGrain;
+	queue.parallel_for(0, kSlices * kVertexRanges, 1, [&](u32 firstJob, u32 lastJob)
+	{
+		for (u32 job = firstJob; job < lastJob; ++job)
+		{
+			const u32 kSlice = job / kVertexRanges;
+			const u32 kBegin = (job % kVertexRanges) * kVertexGrain;
+			const u32 kEnd = std::min(kCount, kBegin + kVertexGrain);
+
+			KelvinletEvalParams sliceParams = packed;
+			const u32 kFirstK = kSlice * packed.numKelvinlets / kSlices;
+			const u32 kLastK = (kSlice + 1) * packed.numKelvinlets / kSlices;
+			sliceParams.pKelvinlets = packed.pKelvinlets + kFirstK;
+			sliceParams.numKelvinlets = kLastK - kFirstK;
+
+			evaluate_range(sliceParams, blocks, pPositions, pFrames, kBegin, kEnd, slice_output(kSlice),
+				pChunkErrors ? pChunkErrors + static_cast<size_t>(kSlice) * kChunks : nullptr);
+		}
+	});
+
+	if (pChunkErrors)
+	{
+		f32 maxError = 0.0f;
+		for (u32 c = 0; c < kChunks; ++c)
+		{
+			f32 error = 0.0f;
+			for (u32 slice = 0; slice < kSlices; ++slice)
+				error += pChunkErrors[static_cast<size_t>(slice) * kChunks + c];
+			maxError = std::max(maxError, error);
+		}
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_asymptoticStats.maxErrorBound = std::max(m_asymptoticStats.maxErrorBound, maxError);
+	}
+
+	// Pairwise tree reduction into slice 0. The pairing only depends on the slice count,
+	// so results are identical from run to run.
+	for (u32 stride = 1; stride < kSlices; stride *= 2)
+	{
+		const u32 kPairs = (kSlices + 2 * stride - 1) / (2 * stride);
+		queue.parallel_for(0, kPairs * kVertexRanges, 1, [&](u32 firstJob, u32 lastJob)
+		{
+			for (u32 job = firstJob; job < lastJob; ++job)
+			{
+				const u32 kDst = (job / kVertexRanges) * 2 * stride;
+				const u32 kSrc = kDst + stride;
+				if (kSrc >= kSlices)
+					continue;
+
+				const u32 kBegin = (job % kVertexRanges) * kVertexGrain;
+				const u32 kEnd = std::min(kCount, kBegin + kVertexGrain);
+				KDisplacement* pDst = slice_output(kDst);
+				const KDisplacement* pSrc = slice_output(kSrc);
+				for (u32 i = kBegin; i < kEnd; ++i)
+					accumulate(pDst[i], pSrc[i]);
+			}
+		});
+	}
+}
+
+bool KelvinletEngine::evaluate_lattice(const KelvinletEvalParams& params, const Mesh& mesh, KDisplacement* pOut) const
+{
+	ScratchLease lease;
+	EngineScratch& scratch = lease.get();
+	scratch.active.clear();
+	pack_kelvinlets(params, mesh.get_bounds(), m_maxKelvinlets, scratch);
+
+	KelvinletEvalParams packed = params;
+	packed.pKelvinlets = scratch.active.data();
+	packed.numKelvinlets = static_cast<u32>(scratch.active.size());
+	packed.pFieldKelvinlets = nullptr;
+	packed.numFieldKelvinlets = 0;
+
+	KelvinletLattice& lattice = scratch.lattice;
+	const u32 kNumVertices = mesh.num_vertices();
+	if (!lattice.build(packed, mesh.get_bounds(), kNumVertices, m_latticeCellEpsilons))
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		++m_latticeStats.directEvaluations;
+		return false;
+	}
+
+	// Nodes first, then the vertices, both across the job queue
+	const v3* pPositions = mesh.get_positions().data();
+	const MeshTangentFrame* pFrames = mesh.get_tangent_frames().data();
+	JobQueue& queue = global_job_queue();
+	queue.parallel_for(0, lattice.num_nodes(), kVertexGrain / KelvinletLattice::kEvaluationsPerNode,
+		[&](u32 begin, u32 end) { lattice.evaluate_nodes(begin, end); });
+	queue.parallel_for_numa(0, kNumVertices, kVertexGrain, [&](u32 begin, u32 end)
+	{
+		lattice.interpolate(pPositions + begin, pFrames + begin, end - begin, pOut + begin);
+	});
+
+	f32 maxDisplacement = 0.0f;
+	const f32 kError = lattice.measure_error(pPositions, pFrames, kNumVertices, pOut, maxDisplacement);
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	++m_latticeStats.latticeEvaluations;
+	m_latticeStats.nodes += lattice.num_nodes();
+	m_latticeStats.vertices += kNumVertices;
+	m_latticeStats.maxError = std::max(m_latticeStats.maxError, kError);
+	m_latticeStats.maxDisplacement = std::max(m_latticeStats.maxDisplacement, maxDisplacement);
+	return true;
+}
+
+void KelvinletEngine::evaluate_proxy(const KelvinletEvalParams& params, const Mesh& mesh, const u32 kLevel,
+	KDisplacement* pOut) const
+{
+	ScratchLease lease;
+	EngineScratch& scratch = lease.get();
+	scratch.active.clear();
+	pack_kelvinlets(params, mesh.get_bounds(), m_maxKelvinlets, scratch);
+	const Kelvinlet* pKelvinlets = scratch.active.data();
+	const u32 kNumKelvinlets = static_cast<u32>(scratch.active.size());
+
+	// One displacement per proxy vertex, then every vertex and its tangent plane points blend their corners'
+	const MeshProxy& proxy = mesh.get_proxies()[kLevel - 1];
+	const u32 kProxyVertices = static_cast<u32>(proxy.positions.size());
+	scratch.proxyDisplacements.resize(kProxyVertices);
+	v3* pProxyDisplacements = scratch.proxyDisplacements.data();
+	const v3* pProxyPositions = proxy.positions.data();
+	JobQueue& queue = global_job_queue();
+	queue.parallel_for(0, kProxyVertices, kVertexGrain, [&](u32 begin, u32 end)
+	{
+		for (u32 v = begin; v < end; ++v)
+		{
+			v3 d(0.0f);
+			for (u32 k = 0; k < kNumKelvinlets; ++k)
+				d += kelvinlet_displacement(pProxyPositions[v], pKelvinlets[k], params.alpha, params.beta);
+			pProxyDisplacements[v] = d;
+		}
+	});
+
+	const MeshProxyBinding* pBindings = proxy.bindings.data();
+	queue.parallel_for_numa(0, mesh.num_vertices(), kVertexGrain, [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; ++i)
+		{
+			const MeshProxyBinding& binding = pBindings[i];
+			v3 points[3] = { v3(0.0f), v3(0.0f), v3(0.0f) };
+			for (u32 c = 0; c < 3; ++c)
+			{
+				const v3& kCorner = pProxyDisplacements[binding.corners[c]];
+				for (u32 p = 0; p < 3; ++p)
+					points[p] += kCorner * binding.weights[p][c];
+			}
+			pOut[i].displacement = points[0];
+			pOut[i].auxDisplacement1 = points[1];
+			pOut[i].auxDisplacement2 = points[2];
+		}
+	});
+}
+
+KelvinletLatticeStats KelvinletEngine::get_lattice_stats() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_latticeStats;
+}
+
+void KelvinletEngine::reset_lattice_stats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_latticeStats = KelvinletLatticeStats();
+}
+
+KelvinletAsymptoticStats KelvinletEngine::get_asymptotic_stats() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_asymptoticStats;
+}
+
+void KelvinletEngine::reset_asymptotic_stats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_asymptoticStats = KelvinletAsymptoticStats();
+}
+
+void KelvinletEngine::evaluate_instance(MeshInstance& mi) const
+{
+	const Mesh& mesh = mi.get_mesh();
+	ASSERT(mesh.has_eval_streams());	// Not released with release_cpu_data
+	PageVector<KDisplacement>& displacements = mi.get_displacement_manager().get_displacements();
+	ASSERT(displacements.size() >= mesh.num_vertices());
+
+	const KelvinletEvalParams kParams = make_eval_params(mi);
+	const u32 kProxyLevel = mi.get_effective_proxy_level();
+	if (kProxyLevel > 0)
+	{
+		evaluate_proxy(kParams, mesh, kProxyLevel, displacements.data());
+		return;
+	}
+	if (m_latticeEvaluation && evaluate_lattice(kParams, mesh, displacements.data()))
+		return;
+	evaluate_parallel(kParams, mesh.get_bounds(), m_maxKelvinlets, asymptotic_blocks(mesh),
+		mesh.get_positions().data(), mesh.get_tangent_frames().data(), mesh.num_vertices(), displacements.data());
+}
+
+void KelvinletEngine::evaluate_group(MeshInstance* pInstances, const u32 kCount, const u32* pSources) const
+{
+	ScratchLease lease;
+	EngineScratch& scratch = lease.get();
+	scratch.groupEvaluated.clear();
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		if (pSources && pSources[i] != i)
+			continue;
+		// Proxies are small enough that sharing mesh reads buys nothing
+		if (pInstances[i].get_effective_proxy_level() > 0)
+			evaluate_instance(pInstances[i]);
+		else
+			scratch.groupEvaluated.push_back(i);
+	}
+
+	const u32 kEvaluated = static_cast<u32>(scratch.groupEvaluated.size());
+	if (kEvaluated == 0)
+		return;
+	// A lattice is cheap next to the vertex pass it replaces, so each instance simply takes its own
+	if (kEvaluated == 1 || m_latticeEvaluation)
+	{
+		for (u32 i : scratch.groupEvaluated)
+			evaluate_instance(pInstances[i]);
+		return;
+	}
+
+	const Mesh& mesh = pInstances[0].get_mesh();
+	ASSERT(mesh.has_eval_streams());
+	const u32 kNumVertices = mesh.num_vertices();
+	const v3* pPositions = mesh.get_positions().data();
+	const MeshTangentFrame* pFrames = mesh.get_tangent_frames().data();
+
+	// Pack every evaluated instance's live Kelvinlets into one array in its own object space, sized first
+	// so the pointers stay put
+	u32 totalKelvinlets = 0;
+	for (u32 i : scratch.groupEvaluated)
+		totalKelvinlets += pInstances[i].get_kelvinlet_manager().get_num_kelvinlets() + pInstances[i].get_num_field_kelvinlets();
+	scratch.active.clear();
+	scratch.active.reserve(totalKelvinlets);
+	scratch.groupParams.resize(kEvaluated);
+	scratch.groupOutputs.resize(kEvaluated);
+	for (u32 e = 0; e < kEvaluated; ++e)
+	{
+		MeshInstance& mi = pInstances[scratch.groupEvaluated[e]];
+		ASSERT(&mi.get_mesh() == &mesh);
+		KelvinletEvalParams params = make_eval_params(mi);
+		const u32 kFirst = static_cast<u32>(scratch.active.size());
+		pack_kelvinlets(params, mesh.get_bounds(), m_maxKelvinlets, scratch);
+		params.pKelvinlets = scratch.active.data() + kFirst;
+		params.numKelvinlets = static_cast<u32>(scratch.active.size()) - kFirst;
+		params.pFieldKelvinlets = nullptr;
+		params.numFieldKelvinlets = 0;
+		scratch.groupParams[e] = params;
+		scratch.groupOutputs[e] = mi.get_displacement_manager().get_displacements().data();
+	}
+
+	// Each job takes one vertex range and runs it for a block of instances, so the range is read from
+	// memory once and comes from cache for the rest. Small meshes are split across instance blocks too.
+	JobQueue& queue = global_job_queue();
+	const u32 kVertexRanges = (kNumVertices + kVertexGrain - 1) / kVertexGrain;
+	const u32 kWantedJobs = (queue.numWorkers() + 1) * 2;
+	const u32 kBlocks = std::max(1u, std::min(kEvaluated, (kWantedJobs + kVertexRanges - 1) / kVertexRanges));
+	const KelvinletEvalParams* pParams = scratch.groupParams.data();
+	KDisplacement* const* ppOutputs = scratch.groupOutputs.data();
+	const AsymptoticBlocks kChunkBlocks = asymptotic_blocks(mesh);
+
+	queue.parallel_for(0, kBlocks * kVertexRanges, 1, [&](u32 firstJob, u32 lastJob)
+	{
+		for (u32 job = firstJob; job < lastJob; ++job)
+		{
+			const u32 kBlock = job / kVertexRanges;
+			const u32 kBegin = (job % kVertexRanges) * kVertexGrain;
+			const u32 kEnd = std::min(kNumVertices, kBegin + kVertexGrain);
+			const u32 kFirstInstance = kBlock * kEvaluated / kBlocks;
+			const u32 kLastInstance = (kBlock + 1) * kEvaluated / kBlocks;
+			for (u32 e = kFirstInstance; e < kLastInstance; ++e)
+				evaluate_range(pParams[e], kChunkBlocks, pPositions, pFrames, kBegin, kEnd, ppOutputs[e]);
+		}
+	});
+}
+
+static u64 hash_bytes(u64 hash, const void* pData, const size_t kBytes)
+{
+	// FNV-1a
+	const u8* pBytes = static_cast<const u8*>(pData);
+	for (size_t i = 0; i < kBytes; ++i)
+	{
+		hash ^= pBytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// Only what the kernels read
+static u64 hash_kelvinlet(u64 hash, const Kelvinlet& k)
+{
+	const f32 kValues[] = { k.loadCentre.x, k.loadCentre.y, k.loadCentre.z, k.epsilon,
+		k.forceParams.x, k.forceParams.y, k.forceParams.z, k.age };
+	hash = hash_bytes(hash, kValues, sizeof(kValues));
+	return hash_bytes(hash, &k.type, sizeof(k.type));
+}
+
+static bool same_kelvinlet(const Kelvinlet& a, const Kelvinlet& b)
+{
+	return a.type == b.type && a.epsilon == b.epsilon && a.age == b.age && a.forceParams == b.forceParams &&
+		a.loadCentre == b.loadCentre;
+}
+
+u64 KelvinletEngine::evaluation_key(const MeshInstance& mi)
+{
+	const KelvinletManager& km = mi.get_kelvinlet_manager();
+	const Mesh* pMesh = &mi.get_mesh();
+	const f32 kMaterial[2] = { km.get_alpha(), km.get_beta() };
+
+	u64 hash = 0xcbf29ce484222325ull;
+	hash = hash_bytes(hash, &pMesh, sizeof(pMesh));
+	hash = hash_bytes(hash, kMaterial, sizeof(kMaterial));
+	const u32 kProxyLevel = mi.get_effective_proxy_level();
+	hash = hash_bytes(hash, &kProxyLevel, sizeof(kProxyLevel));
+
+	// Kelvinlets are hashed in the instance's object space, as the kernels see them
+	const Kelvinlet* pKelvinlets = km.get_evaluated_kelvinlets();
+	for (u32 k = 0; k < km.get_num_kelvinlets(); ++k)
+	{
+		if (pKelvinlets[k].type != 0)
+			hash = hash_kelvinlet(hash, pKelvinlets[k].transformed(mi.get_world_to_object()));
+	}
+	const u32 kNumField = mi.get_num_field_kelvinlets();
+	hash = hash_bytes(hash, &kNumField, sizeof(kNumField));
+	for (u32 k = 0; k < kNumField; ++k)
+		hash = hash_kelvinlet(hash, mi.get_field_kelvinlets()[k].transformed(mi.get_world_to_object()));
+	return hash;
+}
+
+bool KelvinletEngine::same_evaluation(const MeshInstance& a, const MeshInstance& b)
+{
+	const KelvinletManager& kmA = a.get_kelvinlet_manager();
+	const KelvinletManager& kmB = b.get_kelvinlet_manager();
+	if (&a.get_mesh() != &b.get_mesh() || kmA.get_alpha() != kmB.get_alpha() || kmA.get_beta() != kmB.get_beta() ||
+		a.get_num_field_kelvinlets() != b.get_num_field_kelvinlets() ||
+		a.get_effective_proxy_level() != b.get_effective_proxy_level())
+		return false;
+
+	// Walk the live Kelvinlets of both in step
+	const Kelvinlet* pA = kmA.get_evaluated_kelvinlets();
+	const Kelvinlet* pB = kmB.get_evaluated_kelvinlets();
+	u32 i = 0, j = 0;
+	for (;;)
+	{
+		while (i < kmA.get_num_kelvinlets() && pA[i].type == 0)
+			++i;
+		while (j < kmB.get_num_kelvinlets() && pB[j].type == 0)
+			++j;
+		const bool kEndA = (i == kmA.get_num_kelvinlets());
+		const bool kEndB = (j == kmB.get_num_kelvinlets());
+		if (kEndA || kEndB)
+		{
+			if (!(kEndA && kEndB))
+				return false;
+			break;
+		}
+
+		if (!same_kelvinlet(pA[i++].transformed(a.get_world_to_object()), pB[j++].transformed(b.get_world_to_object())))
+			return false;
+	}
+
+	for (u32 k = 0; k < a.get_num_field_kelvinlets(); ++k)
+	{
+		if (!same_kelvinlet(a.get_field_kelvinlets()[k].transformed(a.get_world_to_object()),
+			b.get_field_kelvinlets()[k].transformed(b.get_world_to_object())))
+			return false;
+	}
+	return true;
+}
+
+u32 KelvinletEngine::find_shared_evaluations(const MeshInstance* pInstances, const u32 kCount, u32* pSources)
+{
+	// Open addressing over a power of two table at most half full
+	ScratchLease lease;
+	std::vector<u32>& table = lease.get().keyTable;
+	std::vector<u64>& keys = lease.get().keys;
+	keys.resize(kCount);
+	u32 tableSize = 16;
+	while (tableSize < kCount * 2)
+		tableSize *= 2;
+	const u32 kMask = tableSize - 1;
+	table.assign(tableSize, ~0u);
+
+	u32 distinct = 0;
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		pSources[i] = i;
+		keys[i] = evaluation_key(pInstances[i]);
+		for (u32 slot = static_cast<u32>(keys[i]) & kMask; ; slot = (slot + 1) & kMask)
+		{
+			if (table[slot] == ~0u)
+			{
+				table[slot] = i;
+				++distinct;
+				break;
+			}
+			// Equal hashes are confirmed field by field before sharing
+			if (keys[table[slot]] == keys[i] && same_evaluation(pInstances[table[slot]], pInstances[i]))
+			{
+				pSources[i] = table[slot];
+				break;
+			}
+		}
+	}
+	return distinct;
+}
+
+bool KelvinletEngine::evaluate_out_of_core(const char* pMeshFile, const char* pDisplacementFile,
+	const KelvinletEvalParams& params, u32 chunkVertices) const
+{
+	MeshStreamReader reader;
+	if (!reader.open(pMeshFile))
+		return false;
+
+	const u32 kNumVertices = reader.num_vertices();
+	const u64 kOutputSize = sizeof(DisplacementFileHeader) + static_cast<u64>(kNumVertices) * sizeof(KDisplacement);
+
+	MappedFile output;
+	if (!output.create(pDisplacementFile, kOutputSize))
+		return false;
+
+	MappedView headerView = output.map_view(0, sizeof(DisplacementFileHeader));
+	if (!headerView.pData)
+		return false;
+	DisplacementFileHeader header = { kDisplacementFileMagic, kStreamFileVersion, kNumVertices, 0 };
+	*reinterpret_cast<DisplacementFileHeader*>(headerView.pData) = header;
+	MappedFile::unmap_view(headerView);
+
+	chunkVertices = std::max(chunkVertices, 1u);
+
+	// Map the first chunk up front, then keep one chunk ahead so the OS reads chunk N+1
+	// from disk while chunk N is being evaluated. An empty mesh maps nothing.
+	MeshStreamChunk current;
+	if (kNumVertices > 0)
+		current = reader.map_chunk(0, std::min(chunkVertices, kNumVertices), true);
+	bool ok = true;
+	for (u32 first = 0; first < kNumVertices; first += chunkVertices)
+	{
+		const u32 kNext = first + chunkVertices;
+		MeshStreamChunk next;
+		if (kNext < kNumVertices)
+			next = reader.map_chunk(kNext, std::min(chunkVertices, kNumVertices - kNext), true);
+
+		const u64 kOutOffset = sizeof(DisplacementFileHeader) + static_cast<u64>(first) * sizeof(KDisplacement);
+		MappedView outView = output.map_view(kOutOffset, static_cast<u64>(current.numVertices) * sizeof(KDisplacement));
+
+		if (!current.pPositions || !current.pFrames || !outView.pData)
+		{
+			errorF("KelvinletEngine : failed to map chunk at vertex %u", first);
+			ok = false;
+		}
+		else
+		{
+			// Every Kelvinlet is kept, so no bounds are needed to rank them
+			evaluate_parallel(params, MeshBounds(), ~0u, AsymptoticBlocks(), current.pPositions, current.pFrames,
+				current.numVertices, reinterpret_cast<KDisplacement*>(outView.pData));
+		}
+
+		// Unmapping lets the OS write the results back and drop the input pages
+		MappedFile::unmap_view(outView);
+		reader.unmap_chunk(current);
+		current = next;
+
+		if (!ok)
+		{
+			reader.unmap_chunk(current);
+			break;
+		}
+	}
+
+	return ok;
+}
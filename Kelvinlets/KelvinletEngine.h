@@ -0,0 +1,125 @@
+#pragma once
+#include "KelvinletLattice.h"
+
+#include <mutex>
+
+class MeshInstance;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// KelvinletEngine
+//
+// Responsibility : Evaluates Kelvinlet displacements on the CPU across the shared job queue, either for
+//                  a loaded mesh instance or out-of-core for a mesh stream file that does not fit in memory.
+
+class KelvinletEngine
+{
+public:
+	// Vertices per chunk when streaming from disk (~10 MB of input per chunk)
+	static constexpr u32 kDefaultStreamChunk = 256 * 1024;
+	// Vertices per job on the shared job queue
+	static constexpr u32 kVertexGrain = 1024;
+	// Fewest Kelvinlets worth giving a thread of their own when splitting across Kelvinlets
+	static constexpr u32 kMinSliceKelvinlets = 8;
+	// Error each Kelvinlet may leave in a vertex through its asymptotic form, in bounding radii of the mesh
+	static constexpr f32 kDefaultAsymptoticTolerance = 1e-5f;
+
+	KelvinletEngine() {}
+	KelvinletEngine(const KelvinletEngine&) = delete;
+	KelvinletEngine& operator=(const KelvinletEngine&) = delete;
+
+	// Fills the instance's CPU displacement buffer. Uploading it is up to the caller.
+	// Instances with a proxy level are evaluated on that proxy (see MeshInstance::set_proxy_level). Otherwise,
+	// with lattice evaluation on, instances dense enough for it are deformed through a KelvinletLattice.
+	// With asymptotic evaluation on, the rest are evaluated a mesh chunk at a time, and each Kelvinlet whose
+	// wave fronts are far enough from a chunk takes its asymptotic form there.
+	void evaluate_instance(MeshInstance&) const;
+
+	// As evaluate_instance for kCount adjacent instances sharing one mesh. Each vertex range of the
+	// mesh is evaluated for every instance in turn, so the mesh streams are read once per group.
+	// With pSources (see find_shared_evaluations) only instances that are their own source are evaluated.
+	void evaluate_group(MeshInstance* pInstances, const u32 kCount, const u32* pSources = nullptr) const;
+
+	// Instances evaluate to the same displacements (up to rounding) when they share a mesh, proxy level,
+	// material and live Kelvinlets at the same ages, once the Kelvinlets are taken into each instance's
+	// object space. Kelvinlets reaching them from the scene's field count as well.
+	static u64 evaluation_key(const MeshInstance&);
+	static bool same_evaluation(const MeshInstance&, const MeshInstance&);
+
+	// For each instance writes the index of the first one with the same evaluation, which is its own
+	// index if there is none. Returns how many distinct evaluations there are.
+	static u32 find_shared_evaluations(const MeshInstance* pInstances, const u32 kCount, u32* pSources);
+
+	// Streams a mesh stream file chunk by chunk and writes a displacement file.
+	// At most two input chunks and one output chunk are mapped at any time, and chunk N+1
+	// is paged in while chunk N is evaluated.
+	bool evaluate_out_of_core(const char* pMeshFile, const char* pDisplacementFile,
+		const KelvinletEvalParams& params, u32 chunkVertices = kDefaultStreamChunk) const;
+
+	static KelvinletEvalParams make_eval_params(const MeshInstance&);
+
+	// Upper bound on how far any vertex of the instance can be displaced, from its own live Kelvinlets
+	// and the field's that reach it. Growing the rest bounds by this gives bounds that hold when deformed.
+	// A pinch or scale centred within the bounds makes it FLT_MAX, as those grow without bound towards their centre.
+	static f32 max_displacement(const MeshInstance&);
+
+	// How many slices to split the Kelvinlets into, from the mesh size and Kelvinlet count
+	static u32 choose_kelvinlet_slices(const u32 kNumVertices, const u32 kNumKelvinlets, const u32 kNumThreads);
+
+	// Caps the Kelvinlets each evaluation of a loaded instance keeps to the kMax that can displace it
+	// furthest, as a quality knob. Out-of-core evaluation always takes all of them.
+	void set_max_kelvinlets(const u32 kMax) { m_maxKelvinlets = kMax; }
+	u32 get_max_kelvinlets() const { return m_maxKelvinlets; }
+
+	// Lattice spacing is in units of each evaluation's smallest live epsilon
+	void set_lattice_evaluation(bool enabled, f32 cellEpsilons = KelvinletLattice::kDefaultCellEpsilons)
+	{
+		m_latticeEvaluation = enabled;
+		m_latticeCellEpsilons = cellEpsilons;
+	}
+	bool lattice_evaluation() const { return m_latticeEvaluation; }
+	// Gathered from every evaluation since the last reset, which may run on several threads at once
+	KelvinletLatticeStats get_lattice_stats() const;
+	void reset_lattice_stats();
+
+	// The tolerance is in bounding radii of each evaluated mesh
+	void set_asymptotic_evaluation(bool enabled, f32 tolerance = kDefaultAsymptoticTolerance)
+	{
+		m_asymptoticEvaluation = enabled;
+		m_asymptoticTolerance = tolerance;
+	}
+	bool asymptotic_evaluation() const { return m_asymptoticEvaluation; }
+	// Gathered like the lattice stats
+	KelvinletAsymptoticStats get_asymptotic_stats() const;
+	void reset_asymptotic_stats();
+
+private:
+	// Mesh chunks asymptotic evaluation works on, and the error it may leave per Kelvinlet. Without chunk
+	// bounds every Kelvinlet is evaluated in full.
+	struct AsymptoticBlocks
+	{
+		const MeshBounds* pChunkBounds = nullptr;
+		f32 tolerance = 0.0f;
+	};
+
+	void evaluate_proxy(const KelvinletEvalParams& params, const Mesh& mesh, const u32 kLevel, KDisplacement* pOut) const;
+	bool evaluate_lattice(const KelvinletEvalParams& params, const Mesh& mesh, KDisplacement* pOut) const;
+	// Past kMaxKelvinlets, keeps those that can move a point of kBounds' sphere furthest
+	void evaluate_parallel(const KelvinletEvalParams& params, const MeshBounds& kBounds, const u32 kMaxKelvinlets,
+		const AsymptoticBlocks& blocks, const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount,
+		KDisplacement* pOut) const;
+	// Evaluates vertices kBegin to kEnd of the arrays for packed Kelvinlets. With pChunkErrors each chunk's
+	// error bound goes there rather than into the stats, for callers that split a chunk's Kelvinlets.
+	void evaluate_range(const KelvinletEvalParams& packed, const AsymptoticBlocks& blocks, const v3* pPositions,
+		const MeshTangentFrame* pFrames, const u32 kBegin, const u32 kEnd, KDisplacement* pOut,
+		f32* pChunkErrors = nullptr) const;
+	AsymptoticBlocks asymptotic_blocks(const Mesh& mesh) const;
+
+	u32 m_maxKelvinlets = ~0u;
+	bool m_latticeEvaluation = false;
+	f32 m_latticeCellEpsilons = KelvinletLattice::kDefaultCellEpsilons;
+	bool m_asymptoticEvaluation = false;
+	f32 m_asymptoticTolerance = kDefaultAsymptoticTolerance;
+	mutable std::mutex m_statsMutex;
+	mutable KelvinletLatticeStats m_latticeStats;
+	mutable KelvinletAsymptoticStats m_asymptoticStats;
+};
@@ -0,0 +1,188 @@
+#include "KelvinletField.h"
+#include "MeshInstance.h"
+
+#include <algorithm>
+
+static f32 distance_squared_to_box(const v3& point, const v3& boxMin, const v3& boxMax)
+{
+	const v3 kClosest = v3::Max(boxMin, v3::Min(point, boxMax));
+	return v3::DistanceSquared(point, kClosest);
+}
+
+void KelvinletField::init()
+{
+	m_timeline.init();
+}
+
+void KelvinletField::advance_timeline(float dt)
+{
+	m_timeline.update(dt);
+}
+
+void KelvinletField::play()
+{
+	m_timeline.play();
+}
+
+void KelvinletField::pause()
+{
+	m_timeline.pause();
+}
+
+void KelvinletField::stop()
+{
+	m_timeline.stop();
+}
+
+void KelvinletField::build_node(const u32 kNode, const u32 kFirst, const u32 kCount)
+{
+	v3 nodeMin = m_instanceMin[m_order[kFirst]];
+	v3 nodeMax = m_instanceMax[m_order[kFirst]];
+	v3 centreMin = (nodeMin + nodeMax) * 0.5f;
+	v3 centreMax = centreMin;
+	for (u32 i = kFirst + 1; i < kFirst + kCount; ++i)
+	{
+		const u32 kInstance = m_order[i];
+		nodeMin = v3::Min(nodeMin, m_instanceMin[kInstance]);
+		nodeMax = v3::Max(nodeMax, m_instanceMax[kInstance]);
+		const v3 kCentre = (m_instanceMin[kInstance] + m_instanceMax[kInstance]) * 0.5f;
+		centreMin = v3::Min(centreMin, kCentre);
+		centreMax = v3::Max(centreMax, kCentre);
+	}
+
+	m_nodes[kNode].aabbMin = nodeMin;
+	m_nodes[kNode].aabbMax = nodeMax;
+	if (kCount <= kLeafSize)
+	{
+		m_nodes[kNode].first = kFirst;
+		m_nodes[kNode].count = kCount;
+		return;
+	}
+
+	// Median split along the axis the centres spread furthest on
+	const v3 kExtent = centreMax - centreMin;
+	const u32 kAxis = (kExtent.x >= kExtent.y && kExtent.x >= kExtent.z) ? 0 : (kExtent.y >= kExtent.z ? 1 : 2);
+	auto centre = [this, kAxis](u32 instance)
+	{
+		const v3 kCentre = m_instanceMin[instance] + m_instanceMax[instance];
+		return kAxis == 0 ? kCentre.x : (kAxis == 1 ? kCentre.y : kCentre.z);
+	};
+	const u32 kHalf = kCount / 2;
+	std::nth_element(m_order.begin() + kFirst, m_order.begin() + kFirst + kHalf, m_order.begin() + kFirst + kCount,
+		[&centre](u32 lhs, u32 rhs) { return centre(lhs) < centre(rhs); });
+
+	// Children are allocated as a pair so the right one is always left + 1
+	const u32 kLeft = static_cast<u32>(m_nodes.size());
+	m_nodes.resize(kLeft + 2);
+	m_nodes[kNode].first = kLeft;
+	m_nodes[kNode].count = 0;
+	build_node(kLeft, kFirst, kHalf);
+	build_node(kLeft + 1, kFirst + kHalf, kCount - kHalf);
+}
+
+void KelvinletField::update_reach(MeshInstance* pInstances, const u32 kCount)
+{
+	// World bounds of every instance, from the corners of its mesh's box
+	m_instanceMin.resize(kCount);
+	m_instanceMax.resize(kCount);
+	f32 maxAlpha = 0.0f;
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const MeshBounds& bounds = pInstances[i].get_mesh().get_bounds();
+		const m4x4& matModel = pInstances[i].get_model_matrix();
+		v3 boxMin = v3::Transform(bounds.aabbMin, matModel);
+		v3 boxMax = boxMin;
+		for (u32 corner = 1; corner < 8; ++corner)
+		{
+			const v3 kCorner((corner & 1) ? bounds.aabbMax.x : bounds.aabbMin.x,
+				(corner & 2) ? bounds.aabbMax.y : bounds.aabbMin.y,
+				(corner & 4) ? bounds.aabbMax.z : bounds.aabbMin.z);
+			const v3 kWorld = v3::Transform(kCorner, matModel);
+			boxMin = v3::Min(boxMin, kWorld);
+			boxMax = v3::Max(boxMax, kWorld);
+		}
+		m_instanceMin[i] = boxMin;
+		m_instanceMax[i] = boxMax;
+		maxAlpha = std::max(maxAlpha, pInstances[i].get_kelvinlet_manager().get_alpha());
+	}
+
+	m_order.resize(kCount);
+	for (u32 i = 0; i < kCount; ++i)
+		m_order[i] = i;
+	m_nodes.clear();
+	m_nodes.reserve(kCount * 2);
+	if (kCount > 0)
+	{
+		m_nodes.resize(1);
+		build_node(0, 0, kCount);
+	}
+
+	// Each live Kelvinlet walks the BVH with a sphere covering the fastest material's wave, then checks
+	// every instance it finds against that instance's own material. Kelvinlets at age zero displace nothing.
+	m_pairs.clear();
+	const Kelvinlet* pKelvinlets = m_timeline.get_kelvinlet_array();
+	for (u32 k = 0; k < m_maxKelvinlets && !m_nodes.empty(); ++k)
+	{
+		const Kelvinlet& kelvinlet = pKelvinlets[k];
+		if (kelvinlet.type == 0 || kelvinlet.age <= 0.0f)
+			continue;
+		const f32 kPadding = kKelvinletReachEpsilons * kelvinlet.epsilon;
+		const f32 kMaxReach = maxAlpha * kelvinlet.age + kPadding;
+
+		u32 stack[64];
+		u32 depth = 0;
+		stack[depth++] = 0;
+		while (depth > 0)
+		{
+			const BVHNode& node = m_nodes[stack[--depth]];
+			if (distance_squared_to_box(kelvinlet.loadCentre, node.aabbMin, node.aabbMax) > kMaxReach * kMaxReach)
+				continue;
+			if (node.count == 0)
+			{
+				stack[depth++] = node.first;
+				stack[depth++] = node.first + 1;
+				continue;
+			}
+			for (u32 i = node.first; i < node.first + node.count; ++i)
+			{
+				const u32 kInstance = m_order[i];
+				const f32 kReach = pInstances[kInstance].get_kelvinlet_manager().get_alpha() * kelvinlet.age + kPadding;
+				if (distance_squared_to_box(kelvinlet.loadCentre, m_instanceMin[kInstance], m_instanceMax[kInstance]) <= kReach * kReach)
+				{
+					m_pairs.push_back(kInstance);
+					m_pairs.push_back(k);
+				}
+			}
+		}
+	}
+
+	// Group the reaches by instance. Kelvinlets keep their timeline order within an instance,
+	// so instances that see the same Kelvinlets get them in the same order.
+	m_reachOffsets.assign(kCount + 1, 0);
+	for (size_t p = 0; p < m_pairs.size(); p += 2)
+		++m_reachOffsets[m_pairs[p] + 1];
+	for (u32 i = 0; i < kCount; ++i)
+		m_reachOffsets[i + 1] += m_reachOffsets[i];
+
+	m_reached.resize(m_pairs.size() / 2);
+	for (size_t p = 0; p < m_pairs.size(); p += 2)
+		m_reached[m_reachOffsets[m_pairs[p]]++] = pKelvinlets[m_pairs[p + 1]];
+	// Filling moved each offset on to the next instance's start, so shift them back
+	for (u32 i = kCount; i > 0; --i)
+		m_reachOffsets[i] = m_reachOffsets[i - 1];
+	m_reachOffsets[0] = 0;
+
+	for (u32 i = 0; i < kCount; ++i)
+		pInstances[i].set_field_kelvinlets(m_reached.data() + m_reachOffsets[i], m_reachOffsets[i + 1] - m_reachOffsets[i]);
+}
+
+MemoryUsage KelvinletField::memory_usage() const
+{
+	MemoryUsage usage;
+	usage.cpuBytes = m_timeline.memory_bytes() +
+		m_nodes.capacity() * sizeof(BVHNode) +
+		(m_order.capacity() + m_pairs.capacity() + m_reachOffsets.capacity()) * sizeof(u32) +
+		(m_instanceMin.capacity() + m_instanceMax.capacity()) * sizeof(v3) +
+		m_reached.capacity() * sizeof(Kelvinlet);
+	return usage;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "KelvinletKernels.h"
+#include "KelvinletTimeline.h"
+
+class MeshInstance;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// KelvinletField
+//
+// Responsibility : Holds scene-level Kelvinlets in world space on a timeline of their own, so one
+//                  Kelvinlet can shake every instance near it. A BVH over the instances' world bounds
+//                  finds the instances each Kelvinlet's wave can have reached (see kKelvinletReachEpsilons),
+//                  and only those evaluate it. Alpha and beta stay with each instance.
+
+class KelvinletField
+{
+public:
+	KelvinletField(const u32 maxNum) : m_maxKelvinlets(maxNum), m_timeline(maxNum) {}
+	KelvinletField(const KelvinletField&) = delete;
+	KelvinletField& operator=(const KelvinletField&) = delete;
+
+	void init();
+	void advance_timeline(float dt);
+
+	void play();
+	void pause();
+	void stop();
+
+	// Rebuilds the BVH over the instances' bounds and gives every instance the live Kelvinlets that
+	// reach it (see MeshInstance::get_field_kelvinlets). The lists stay valid until the next call.
+	void update_reach(MeshInstance* pInstances, const u32 kCount);
+
+	const u32 get_num_kelvinlets() const { return m_maxKelvinlets; }
+	KelvinletTimeline& get_timeline() { return m_timeline; }
+	const KelvinletTimeline& get_timeline() const { return m_timeline; }
+	// Instance and Kelvinlet pairs found by the last update_reach
+	u32 get_num_reached() const { return static_cast<u32>(m_reached.size()); }
+
+	MemoryUsage memory_usage() const;
+
+private:
+	struct BVHNode
+	{
+		v3 aabbMin;
+		u32 first;	// First entry of m_order for a leaf, left child otherwise (the right one follows it)
+		v3 aabbMax;
+		u32 count;	// Instances in a leaf, 0 for an inner node
+	};
+
+	static constexpr u32 kLeafSize = 4;
+
+	void build_node(const u32 kNode, const u32 kFirst, const u32 kCount);
+
+	u32 m_maxKelvinlets;
+	KelvinletTimeline m_timeline;
+
+	std::vector<BVHNode> m_nodes;
+	std::vector<u32> m_order;				// Instance indices, in leaf order
+	std::vector<v3> m_instanceMin;			// World bounds of each instance
+	std::vector<v3> m_instanceMax;
+	std::vector<u32> m_pairs;				// Instance and Kelvinlet index of every reach, interleaved
+	std::vector<u32> m_reachOffsets;		// Where each instance's Kelvinlets start in m_reached
+	std::vector<Kelvinlet> m_reached;		// Reaching Kelvinlets grouped by instance
+};
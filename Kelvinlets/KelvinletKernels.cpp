@@ -0,0 +1,644 @@
+#include "KelvinletKernels.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Terms shared by all three Kelvinlet types, named as in the shader. They only depend on the distance
+// r = |x_ - c_| from the load centre, so the displacement bound can also work them out in double precision.
+template<typename T>
+struct KelvinletTerms
+{
+	T r;
+	T k_ab[2];
+	T s_ab[4];
+	T s_ab_e[4];
+	T W[4];
+	T dW[4];
+};
+
+template<typename T>
+static void kelvinlet_terms(const T r, const Kelvinlet& k, f32 alpha, f32 beta, KelvinletTerms<T>& t)
+{
+	t.r = r;
+
+	const T e = k.epsilon;
+	const T at = alpha * k.age;
+	const T bt = beta * k.age;
+
+	// Calculate multiplicative constants for convenience
+	const T kConst = T(1) / (16.0f * kfPI * r * r * r);
+	t.k_ab[0] = kConst / alpha;
+	t.k_ab[1] = kConst / beta;
+
+	// Important auxiliary quantities
+	t.s_ab[0] = r + at;
+	t.s_ab[1] = r - at;
+	t.s_ab[2] = r + bt;
+	t.s_ab[3] = r - bt;
+
+	const T e4 = e * e * e * e;
+	for (u32 i = 0; i < 4; ++i)
+	{
+		const T s = t.s_ab[i];
+		const T se = std::sqrt(s * s + e * e);
+		const T se3 = se * se * se;
+		t.s_ab_e[i] = se;
+
+		// Pseudo-potentials used for evaluating displacement
+		t.W[i] = (2 * s * s + e * e - 3 * r * s) / se + r * s * s * s / se3;
+		t.dW[i] = -3.0f * r * e4 / (se3 * se * se);
+	}
+}
+
+// Impulse displacement at the load centre, where the general form is singular
+static f32 kelvinlet_impulse_centre(const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	const f32 e = k.epsilon;
+	const f32 at = alpha * k.age;
+	const f32 bt = beta * k.age;
+	const f32 ate = sqrtf(at * at + e * e);
+	const f32 bte = sqrtf(bt * bt + e * e);
+	return 5.0f * k.age * e * e * e * e * (1.0f / powf(ate, 7) + 2.0f / powf(bte, 7)) / (8.0f * kfPI);
+}
+
+// Coefficients of the impulse matrix A I + B r r^T
+template<typename T>
+static void kelvinlet_impulse_terms(const KelvinletTerms<T>& t, T& A, T& B)
+{
+	const T r = t.r;
+	const T U[2] = { t.k_ab[0] * (t.W[0] - t.W[1]), t.k_ab[1] * (t.W[2] - t.W[3]) };
+	const T dU[2] = {
+		t.k_ab[0] * (t.dW[0] - 3.0f * t.W[0] / r - t.dW[1] + 3.0f * t.W[1] / r),
+		t.k_ab[1] * (t.dW[2] - 3.0f * t.W[2] / r - t.dW[3] + 3.0f * t.W[3] / r) };
+
+	A = U[0] + 2 * U[1] + r * dU[1];
+	B = (dU[0] - dU[1]) / r;
+}
+
+// Distance from the load centre at the precision the terms are worked out in
+static f32 centre_distance(const v3& rVec, f32) { return rVec.Length(); }
+static f64 centre_distance(const v3& rVec, f64)
+{
+	return std::sqrt(static_cast<f64>(rVec.x) * rVec.x + static_cast<f64>(rVec.y) * rVec.y + static_cast<f64>(rVec.z) * rVec.z);
+}
+
+// The kernels below work out their radial terms in T. Only the f32 versions match the shader; the f64 ones
+// avoid the cancellation the terms suffer from close to the load centre, and also take the limit at the
+// centre for pinch and scale, which vanish there.
+template<typename T>
+static bool affine_at_centre(const T r) { return sizeof(T) > sizeof(f32) && r < T(0.0001f); }
+
+template<typename T>
+static v3 kelvinlet_impulse_t(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	const v3 rVec = vpos - k.loadCentre;	// r_ = x_ - c_
+	KelvinletTerms<T> t;
+	kelvinlet_terms(centre_distance(rVec, T()), k, alpha, beta, t);
+
+	// Avoid singularities in the limit r -> 0
+	if (t.r < T(0.0001f))
+		return k.forceParams * kelvinlet_impulse_centre(k, alpha, beta);
+
+	T A, B;
+	kelvinlet_impulse_terms(t, A, B);
+
+	// f * (A I + B r r^T)
+	return k.forceParams * static_cast<f32>(A) + rVec * static_cast<f32>(B * T(k.forceParams.Dot(rVec)));
+}
+
+v3 kelvinlet_impulse(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	return kelvinlet_impulse_t<f32>(vpos, k, alpha, beta);
+}
+
+// Derivative terms shared by pinch and scale
+template<typename T>
+static void kelvinlet_affine_terms(const KelvinletTerms<T>& t, const Kelvinlet& k, T& B, T& dA, T& dB)
+{
+	const T r = t.r;
+	const T e = k.epsilon;
+	const T e4 = e * e * e * e;
+
+	T d2W[4];
+	for (u32 i = 0; i < 4; ++i)
+	{
+		const T se = t.s_ab_e[i];
+		const T se7 = se * se * se * se * se * se * se;
+		d2W[i] = -3.0f * e4 * (se * se - 5 * r * t.s_ab[i]) / se7;
+	}
+
+	// Auxiliary quantities for calculating displacement
+	const T dU[2] = {
+		t.k_ab[0] * (t.dW[0] - 3 * t.W[0] / r - t.dW[1] + 3 * t.W[1] / r),
+		t.k_ab[1] * (t.dW[2] - 3 * t.W[2] / r - t.dW[3] + 3 * t.W[3] / r) };
+	const T d2U[2] = {
+		t.k_ab[0] * (d2W[0] - d2W[1] - 6 * (t.dW[0] - t.dW[1]) / r + 12 * (d2W[0] - d2W[1]) / r),
+		t.k_ab[1] * (d2W[2] - d2W[3] - 6 * (t.dW[2] - t.dW[3]) / r + 12 * (d2W[2] - d2W[3]) / r) };
+
+	B = (dU[0] - dU[1]) / r;
+	dA = dU[0] + 3.0f * dU[1] + r * d2U[1];
+	dB = (d2U[0] - d2U[1] - B) / r;
+}
+
+template<typename T>
+static v3 kelvinlet_pinch_t(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	const v3 rVec = vpos - k.loadCentre;
+	KelvinletTerms<T> t;
+	kelvinlet_terms(centre_distance(rVec, T()), k, alpha, beta, t);
+	if (affine_at_centre(t.r))
+		return v3(0.0f);
+
+	T B, dA, dB;
+	kelvinlet_affine_terms(t, k, B, dA, dB);
+
+	const T r = t.r;
+	v3 Fr = k.forceParams * rVec;
+	return Fr * static_cast<f32>(dA / r + B) + rVec * static_cast<f32>(dB * T(rVec.Dot(Fr)) / r);
+}
+
+v3 kelvinlet_pinch(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	return kelvinlet_pinch_t<f32>(vpos, k, alpha, beta);
+}
+
+template<typename T>
+static v3 kelvinlet_scale_t(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	const v3 rVec = vpos - k.loadCentre;
+	KelvinletTerms<T> t;
+	kelvinlet_terms(centre_distance(rVec, T()), k, alpha, beta, t);
+	if (affine_at_centre(t.r))
+		return v3(0.0f);
+
+	T B, dA, dB;
+	kelvinlet_affine_terms(t, k, B, dA, dB);
+
+	const T r = t.r;
+	return rVec * static_cast<f32>((4.0f * B + dA / r + r * dB) * T(k.forceParams.x));
+}
+
+v3 kelvinlet_scale(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	return kelvinlet_scale_t<f32>(vpos, k, alpha, beta);
+}
+
+v3 kelvinlet_displacement(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	switch (k.type)
+	{
+	case 1:		// Impulse
+		return kelvinlet_impulse(vpos, k, alpha, beta);
+	case 2:		// Pinch
+		return kelvinlet_pinch(vpos, k, alpha, beta);
+	case 3:		// Scale
+		return kelvinlet_scale(vpos, k, alpha, beta);
+	default:
+		return v3(0.0f);
+	}
+}
+
+v3 kelvinlet_displacement_precise(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	switch (k.type)
+	{
+	case 1:		// Impulse
+		return kelvinlet_impulse_t<f64>(vpos, k, alpha, beta);
+	case 2:		// Pinch
+		return kelvinlet_pinch_t<f64>(vpos, k, alpha, beta);
+	case 3:		// Scale
+		return kelvinlet_scale_t<f64>(vpos, k, alpha, beta);
+	default:
+		return v3(0.0f);
+	}
+}
+
+void evaluate_kelvinlet_displacements(const KelvinletEvalParams& params, const v3* pPositions,
+	const MeshTangentFrame* pFrames, const u32 kCount, KDisplacement* pOut)
+{
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		// Kelvinlets are in object space, so the vertex is used as it is
+		const v3& vpos = pPositions[i];
+
+		// Find local points in the vertex's tangent plane
+		v3 tangent(pFrames[i].tangent.x, pFrames[i].tangent.y, pFrames[i].tangent.z);
+		v3 bitangent = pFrames[i].normal.Cross(tangent);
+		v3 localPos1 = vpos + tangent * kTangentPointOffset;
+		v3 localPos2 = vpos + bitangent * kTangentPointOffset;
+
+		// Determine the displacement each Kelvinlet causes for this vertex and accumulate
+		KDisplacement d;
+		for (u32 j = 0; j < params.numKelvinlets; ++j)
+		{
+			const Kelvinlet& k = params.pKelvinlets[j];
+			if (k.type == 0)
+				continue;
+
+			d.displacement += kelvinlet_displacement(vpos, k, params.alpha, params.beta);
+			d.auxDisplacement1 += kelvinlet_displacement(localPos1, k, params.alpha, params.beta);
+			d.auxDisplacement2 += kelvinlet_displacement(localPos2, k, params.alpha, params.beta);
+		}
+		pOut[i] = d;
+	}
+}
+
+// What the direction dependent factors of each type are bounded by
+static f64 force_size(const Kelvinlet& k)
+{
+	if (k.type == 1)
+		return k.forceParams.Length();
+	if (k.type == 2)	// |F r_| <= max|F_i| r
+		return std::max(fabsf(k.forceParams.x), std::max(fabsf(k.forceParams.y), fabsf(k.forceParams.z)));
+	return fabsf(k.forceParams.x);
+}
+
+// Sizes of a pseudo-potential's parts for the points whose s is at least a from zero and whose r is at most r.
+// With se = sqrt(s^2 + e^2) and u = a / se, W less its polynomial part 2 |s| - 2 r sign(s) is exactly
+//   e^4 / (se (se + a)^2) + r sign(s) (1 - u)^2 (2 + u)
+// Every part falls as a grows, past a = e / sqrt(6) for d2W, and at most rises linearly with r. At the front
+// itself (a = 0) they come to about e + 2 r, 3 r / e and 3 / e + 3.6 r / e^2.
+struct PseudoPotentialBounds
+{
+	f64 R;		// W less its polynomial part
+	f64 dW;
+	f64 d2W;
+};
+
+static PseudoPotentialBounds pseudo_potential_bounds(const f64 a, const f64 r, const f64 e)
+{
+	const f64 e4 = e * e * e * e;
+	const f64 se = std::sqrt(a * a + e * e);
+	const f64 se5 = se * se * se * se * se;
+	const f64 u = a / se;
+	const f64 kOneLessU = e * e / (se * (se + a));
+
+	// |s| / se^7 only starts to fall at |s| = e / sqrt(6)
+	const f64 kPeak = std::max(a, e / std::sqrt(6.0));
+	const f64 kPeakSe2 = kPeak * kPeak + e * e;
+
+	PseudoPotentialBounds b;
+	b.R = e4 / (se * (se + a) * (se + a)) + r * kOneLessU * kOneLessU * (2.0 + u);
+	b.dW = 3.0 * r * e4 / se5;
+	b.d2W = 3.0 * e4 / se5 + 15.0 * r * e4 * kPeak / (kPeakSe2 * kPeakSe2 * kPeakSe2 * std::sqrt(kPeakSe2));
+	return b;
+}
+
+// Upper bound on a type's radial profile for the points between kMinR > 0 and kMaxR from the load centre. Each
+// type is a radial profile times factors that depend on direction but are bounded by the force's size.
+// The pseudo-potentials are split as in kelvinlet_asymptotic_terms: the polynomial parts are exact and
+// partly cancel, and the rest is bounded through pseudo_potential_bounds. The bound holds for any shell,
+// but is tightest for thin ones.
+static f64 shell_profile_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f64 kMinR, const f64 kMaxR)
+{
+	const f64 e = k.epsilon;
+	const f64 kConst = 1.0 / (16.0 * kfPI * kMinR * kMinR * kMinR);
+	const f64 kSpeeds[2] = { alpha, beta };
+	f64 D[2], E[2], G[2], P[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		// Closest r + c t and r - c t come to zero over the shell
+		const f64 ct = kSpeeds[c] * k.age;
+		const f64 kClosest = (ct < kMinR) ? kMinR - ct : (ct > kMaxR) ? ct - kMaxR : 0.0;
+		const PseudoPotentialBounds kAhead = pseudo_potential_bounds(kMinR + ct, kMaxR, e);
+		const PseudoPotentialBounds kBehind = pseudo_potential_bounds(kClosest, kMaxR, e);
+
+		const f64 kC = kConst / kSpeeds[c];
+		D[c] = kC * (kAhead.R + kBehind.R);
+		E[c] = kC * (kAhead.dW + kBehind.dW);
+		G[c] = kC * (kAhead.d2W + kBehind.d2W);
+		P[c] = (kMaxR > ct) ? 4.0 * k.age * kConst : 0.0;
+	}
+
+	// The polynomial parts of U_a - U_b only differ between the fronts
+	const f64 kFirstFront = std::min(kSpeeds[0], kSpeeds[1]) * k.age;
+	const f64 kLastFront = std::max(kSpeeds[0], kSpeeds[1]) * k.age;
+	const f64 kDeltaP = (kMaxR > kFirstFront && kMinR <= kLastFront) ? 4.0 * k.age * kConst : 0.0;
+	const f64 kDeltaU = D[0] + D[1] + kDeltaP;
+
+	// Carried through the combinations of kelvinlet_displacement_asymptotic, largest r where it multiplies
+	// and smallest where it divides
+	const f64 B = (E[0] + E[1] + 3.0 * kDeltaU / kMinR) / kMinR;
+	if (k.type == 1)
+	{
+		// |(A I + B r r^T) f| <= (|A| + |B| r^2) |f|
+		const f64 A = kDeltaU + kMaxR * E[1];
+		return A + B * kMaxR * kMaxR;
+	}
+
+	f64 dU[2], d2U[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		dU[c] = E[c] + 3.0 * (D[c] + P[c]) / kMinR;
+		d2U[c] = G[c] * (1.0 + 12.0 / kMinR) + 6.0 * E[c] / kMinR;
+	}
+	if (k.type == 2)
+	{
+		// dA / r + B = 2 (dU_a + dU_b) / r + d2U_b, and |F r_| <= max|F_i| r
+		const f64 dB = (d2U[0] + d2U[1] + B) / kMinR;
+		return 2.0 * (dU[0] + dU[1]) * kMaxR / kMinR + kMaxR * d2U[1] + dB * kMaxR * kMaxR;
+	}
+
+	// For scale the shear terms cancel: (4 B + dA / r + r dB) r = 4 dU_a + r d2U_a
+	//   = (r + 12) G_a - 2 E_a - 12 (D_a + P_a) / r
+	return (kMaxR + 12.0) * G[0] + 2.0 * E[0] + 12.0 * (D[0] + P[0]) / kMinR;
+}
+
+// Upper bound on the impulse profile within kMaxR of the load centre, which unlike shell_profile_bound holds
+// at the centre itself. With w1(s) = s^3 / se^3 - 3 s / se, the difference W(r + c t) - W(r - c t) is the
+// error of the trapezoid rule for w1 over [c t - r, c t + r], so
+//   U_c = 1 / (16 pi c) Int_-1^1 (1 - u^2) / 2 w1''(c t + r u) du
+// and dU_c is the same integral with u (1 - u^2) / 2 w1'''. Neither is singular, and both only need w1''
+// and w1''' for s within kMaxR of c t.
+static f64 impulse_core_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f64 kMaxR)
+{
+	const f64 e = k.epsilon;
+	const f64 e4 = e * e * e * e;
+	const f64 kSpeeds[2] = { alpha, beta };
+	f64 U[2], dU[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		// |w1''| = 15 e^4 |s| / se^7 peaks at |s| = e / sqrt(6), and |w1'''| <= 90 e^4 / se^7
+		const f64 kClosest = std::max(0.0, kSpeeds[c] * k.age - kMaxR);
+		const f64 kPeak = std::max(kClosest, e / std::sqrt(6.0));
+		const f64 kPeakSe2 = kPeak * kPeak + e * e;
+		const f64 kSe2 = kClosest * kClosest + e * e;
+		const f64 kW2 = 15.0 * e4 * kPeak / (kPeakSe2 * kPeakSe2 * kPeakSe2 * std::sqrt(kPeakSe2));
+		const f64 kW3 = 90.0 * e4 / (kSe2 * kSe2 * kSe2 * std::sqrt(kSe2));
+
+		U[c] = kW2 / (24.0 * kfPI * kSpeeds[c]);
+		dU[c] = kW3 / (64.0 * kfPI * kSpeeds[c]);
+	}
+
+	// A = U_a + 2 U_b + r dU_b and B r^2 = r (dU_a - dU_b)
+	return U[0] + 2.0 * U[1] + kMaxR * (dU[0] + 2.0 * dU[1]);
+}
+
+// Upper bound on the displacement between kMinR and kMaxR from the load centre. The range is cut into shells,
+// thin near the load centre and the wave fronts where the profile changes fastest and widening away from
+// them, and the largest of their bounds is taken. Pinch and scale have no bound at the centre: the
+// 12 d2W / r term of d2U leaves them growing as 1 / r^2 towards it.
+static f64 radial_profile_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f64 kMinR, const f64 kMaxR)
+{
+	static constexpr f64 kShellFraction = 1.0 / 16.0;
+	if (k.type != 1 && kMinR <= 0.0)
+		return DBL_MAX;
+
+	const f64 e = k.epsilon;
+	const f64 kFronts[2] = { alpha * k.age, beta * k.age };
+	f64 bound = 0.0;
+	f64 r = kMinR;
+	do
+	{
+		const f64 kFrontDistance = std::min(std::fabs(r - kFronts[0]), std::fabs(r - kFronts[1]));
+		const f64 kOuter = std::min(kMaxR, r + kShellFraction * std::max(e, std::min(r, kFrontDistance)));
+
+		f64 shell = (r > 0.0) ? shell_profile_bound(k, alpha, beta, r, kOuter) : DBL_MAX;
+		if (k.type == 1)
+			shell = std::min(shell, impulse_core_bound(k, alpha, beta, kOuter));
+		bound = std::max(bound, shell);
+		r = kOuter;
+	} while (r < kMaxR);
+	return bound * force_size(k);
+}
+
+f32 kelvinlet_displacement_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f32 kMinDistance, const f32 kMaxDistance)
+{
+	if (k.type == 0 || k.age <= 0.0f || kMaxDistance < kMinDistance)
+		return 0.0f;
+	return static_cast<f32>(std::min<f64>(FLT_MAX, radial_profile_bound(k, alpha, beta, std::max(0.0f, kMinDistance), kMaxDistance)));
+}
+
+f32 kelvinlet_displacement_bound(const Kelvinlet& k, f32 alpha, f32 beta, const v3& kCentre, const f32 kRadius)
+{
+	const f32 kCentreDistance = v3::Distance(k.loadCentre, kCentre);
+	return kelvinlet_displacement_bound(k, alpha, beta, std::max(0.0f, kCentreDistance - kRadius), kCentreDistance + kRadius);
+}
+
+// Away from the wave fronts, with s one of r +- c * age, |s| = a and q = (epsilon / a)^2, each pseudo-potential
+// splits into a polynomial part and a remainder that is a series in q:
+//   W   = 2 a - 2 r sign(s) + e^4 / (4 a^3) + 3 r e^4 / (4 a^3 s) + O(q^3)
+//   dW  = -3 r e^4 / a^5 + O(q^3)
+//   d2W = -3 e^4 / a^5 + 15 r e^4 / (a^5 s) + O(q^3)
+// The polynomial parts cancel in every combination the kernels take, except that each front still on its
+// way leaves 4 * age * kConst in its U. That part is exact and is kept apart from the rest, which is small.
+template<typename T>
+struct AsymptoticTerms
+{
+	T D[2];	// k_ab times the difference of the remainders of W, for alpha then beta
+	T E[2];	// The same for dW
+	T G[2];	// The same for d2W
+	T P[2];	// What the polynomial parts leave
+};
+
+// Divisions are what the full form spends most of its time on, so these make do with three
+template<typename T>
+static void kelvinlet_asymptotic_terms(const T r, const T kInvR, const Kelvinlet& k, f32 alpha, f32 beta,
+	AsymptoticTerms<T>& t)
+{
+	const T e = k.epsilon;
+	const T e4 = e * e * e * e;
+	const T kConst = kInvR * kInvR * kInvR / (16.0f * kfPI);
+	const T at = T(alpha) * k.age;
+	const T bt = T(beta) * k.age;
+	const T s[4] = { r + at, r - at, r + bt, r - bt };
+
+	// The four reciprocals of s from the one of their product, and likewise for the speeds
+	const T kS01 = s[0] * s[1];
+	const T kS23 = s[2] * s[3];
+	const T kInvS0123 = T(1) / (kS01 * kS23);
+	const T kInvS[4] = { s[1] * kS23 * kInvS0123, s[0] * kS23 * kInvS0123, s[3] * kS01 * kInvS0123, s[2] * kS01 * kInvS0123 };
+	const T kInvAlphaBeta = T(1) / (T(alpha) * beta);
+	const T kInvSpeeds[2] = { beta * kInvAlphaBeta, alpha * kInvAlphaBeta };
+
+	for (u32 c = 0; c < 2; ++c)
+	{
+		T R[2], dW[2], d2W[2];
+		for (u32 i = 0; i < 2; ++i)
+		{
+			const T kInv = kInvS[2 * c + i];
+			const T kInv2 = kInv * kInv;
+			const T kInvA3 = std::fabs(kInv) * kInv2;
+			const T kInvA5 = kInvA3 * kInv2;
+			R[i] = T(0.25f) * e4 * kInvA3 * (1.0f + 3.0f * r * kInv);
+			dW[i] = -3.0f * r * e4 * kInvA5;
+			d2W[i] = -3.0f * e4 * kInvA5 * (1.0f - 5.0f * r * kInv);
+		}
+
+		const T kC = kConst * kInvSpeeds[c];
+		t.D[c] = kC * (R[0] - R[1]);
+		t.E[c] = kC * (dW[0] - dW[1]);
+		t.G[c] = kC * (d2W[0] - d2W[1]);
+		t.P[c] = (s[2 * c + 1] > 0.0f) ? 4.0f * k.age * kConst : T(0);
+	}
+}
+
+template<typename T>
+static v3 kelvinlet_displacement_asymptotic_t(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	const v3 rVec = vpos - k.loadCentre;
+	const T r = centre_distance(rVec, T());
+	const T kInvR = T(1) / r;
+	AsymptoticTerms<T> t;
+	kelvinlet_asymptotic_terms(r, kInvR, k, alpha, beta, t);
+
+	// U_a - U_b with the polynomial parts cancelled first, since they dwarf the rest before the fronts arrive
+	const T kDeltaU = (t.D[0] - t.D[1]) + (t.P[0] - t.P[1]);
+	const T B = (t.E[0] - t.E[1] - 3.0f * kDeltaU * kInvR) * kInvR;
+	if (k.type == 1)
+	{
+		// A = U_a + 2 U_b + r dU_b
+		const T A = kDeltaU + r * t.E[1];
+		return k.forceParams * static_cast<f32>(A) + rVec * static_cast<f32>(B * T(k.forceParams.Dot(rVec)));
+	}
+	if (k.type != 2 && k.type != 3)
+		return v3(0.0f);
+
+	// The remaining terms as kelvinlet_affine_terms puts them together
+	T dU[2], d2U[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		dU[c] = t.E[c] - 3.0f * (t.D[c] + t.P[c]) * kInvR;
+		d2U[c] = t.G[c] - 6.0f * t.E[c] * kInvR + 12.0f * t.G[c] * kInvR;
+	}
+	const T dA = dU[0] + 3.0f * dU[1] + r * d2U[1];
+	const T dB = (d2U[0] - d2U[1] - B) * kInvR;
+	if (k.type == 2)
+	{
+		const v3 Fr = k.forceParams * rVec;
+		return Fr * static_cast<f32>(dA * kInvR + B) + rVec * static_cast<f32>(dB * T(rVec.Dot(Fr)) * kInvR);
+	}
+	return rVec * static_cast<f32>((4.0f * B + dA * kInvR + r * dB) * T(k.forceParams.x));
+}
+
+v3 kelvinlet_displacement_asymptotic(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta)
+{
+	return kelvinlet_displacement_asymptotic_t<f32>(vpos, k, alpha, beta);
+}
+
+f32 kelvinlet_asymptotic_error_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f32 kMinDistance, const f32 kMaxDistance)
+{
+	if (k.type == 0 || k.age <= 0.0f || kMinDistance <= 0.0f || kMaxDistance < kMinDistance)
+		return -1.0f;
+
+	// The series' coefficients alternate in sign. For q <= 1/2 their sizes fall from the first one left out,
+	// which then bounds the rest: q^3 / 4 a for the first part of W's remainder and 5 r q^3 / 4 for the second.
+	// The powers of (1 + q) that dW and d2W are missing are within m q of 1 for (1 + q)^-m.
+	const f64 e = k.epsilon;
+	const f64 e6 = e * e * e * e * e * e;
+	const f64 kMinR = kMinDistance;
+	const f64 kMaxR = kMaxDistance;
+	const f64 kMinFront = kAsymptoticFrontEpsilons * e;
+	const f64 kConst = 1.0 / (16.0 * kfPI * kMinR * kMinR * kMinR);
+	const f64 kSpeeds[2] = { alpha, beta };
+	f64 errD[2], errE[2], errG[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		// Closest either front's s comes to zero over the points. r + c t never comes closer than r - c t.
+		const f64 ct = kSpeeds[c] * k.age;
+		const f64 kClosest = (ct < kMinR) ? kMinR - ct : (ct > kMaxR) ? ct - kMaxR : 0.0;
+		if (kClosest < kMinFront)
+			return -1.0f;
+		const f64 a[2] = { kMinR + ct, kClosest };
+
+		errD[c] = errE[c] = errG[c] = 0.0;
+		for (u32 i = 0; i < 2; ++i)
+		{
+			const f64 a5 = a[i] * a[i] * a[i] * a[i] * a[i];
+			const f64 a7 = a5 * a[i] * a[i];
+			errD[c] += e6 * (0.25 + 1.25 * kMaxR / a[i]) / a5;
+			errE[c] += 7.5 * kMaxR * e6 / a7;
+			errG[c] += e6 * (7.5 + 52.5 * kMaxR / a[i]) / a7;
+		}
+		const f64 kC = kConst / kSpeeds[c];
+		errD[c] *= kC;
+		errE[c] *= kC;
+		errG[c] *= kC;
+	}
+
+	// Carried through the combinations of kelvinlet_displacement_asymptotic, largest r where it multiplies
+	// and smallest where it divides, then bounded over direction as radial_profile_bound does
+	f64 errDU[2], errD2U[2];
+	for (u32 c = 0; c < 2; ++c)
+	{
+		errDU[c] = errE[c] + 3.0 * errD[c] / kMinR;
+		errD2U[c] = errG[c] * (1.0 + 12.0 / kMinR) + 6.0 * errE[c] / kMinR;
+	}
+	const f64 kErrB = (errDU[0] + errDU[1]) / kMinR;
+
+	f64 bound;
+	if (k.type == 1)
+	{
+		const f64 kErrA = errD[0] + errD[1] + kMaxR * errE[1];
+		bound = kErrA + kErrB * kMaxR * kMaxR;
+	}
+	else
+	{
+		const f64 kErrDA = errDU[0] + 3.0 * errDU[1] + kMaxR * errD2U[1];
+		const f64 kErrDB = (errD2U[0] + errD2U[1] + kErrB) / kMinR;
+		if (k.type == 2)
+			bound = (kErrDA / kMinR + kErrB) * kMaxR + kErrDB * kMaxR * kMaxR;
+		else
+			bound = (4.0 * kErrB + kErrDA / kMinR + kMaxR * kErrDB) * kMaxR;
+	}
+	return static_cast<f32>(bound * force_size(k));
+}
+
+// Adds one Kelvinlet's displacements of kCount vertices and their tangent plane points
+template<v3 (*Displacement)(const v3&, const Kelvinlet&, f32, f32)>
+static void accumulate_kelvinlet(const Kelvinlet& k, const KelvinletEvalParams& params, const v3* pPositions,
+	const MeshTangentFrame* pFrames, const u32 kCount, KDisplacement* pOut)
+{
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		const v3& vpos = pPositions[i];
+		const v3 kTangent(pFrames[i].tangent.x, pFrames[i].tangent.y, pFrames[i].tangent.z);
+		const v3 kBitangent = pFrames[i].normal.Cross(kTangent);
+		KDisplacement& d = pOut[i];
+		d.displacement += Displacement(vpos, k, params.alpha, params.beta);
+		d.auxDisplacement1 += Displacement(vpos + kTangent * kTangentPointOffset, k, params.alpha, params.beta);
+		d.auxDisplacement2 += Displacement(vpos + kBitangent * kTangentPointOffset, k, params.alpha, params.beta);
+	}
+}
+
+f32 evaluate_kelvinlet_displacements(const KelvinletEvalParams& params, const v3* pPositions,
+	const MeshTangentFrame* pFrames, const u32 kCount, const MeshBounds& bounds, const f32 kTolerance,
+	KDisplacement* pOut, KelvinletAsymptoticStats& rStats)
+{
+	// Kelvinlet by Kelvinlet over the block, which still adds each vertex's displacements in the same order
+	for (u32 i = 0; i < kCount; ++i)
+		pOut[i] = KDisplacement();
+
+	// The tangent plane points can lie just outside the bounds
+	const v3 kMin = bounds.aabbMin - v3(kTangentPointOffset);
+	const v3 kMax = bounds.aabbMax + v3(kTangentPointOffset);
+	f32 errorBound = 0.0f;
+	for (u32 j = 0; j < params.numKelvinlets; ++j)
+	{
+		const Kelvinlet& k = params.pKelvinlets[j];
+		if (k.type == 0)
+			continue;
+
+		// Nearest and furthest points of the box from the load centre
+		const v3& c = k.loadCentre;
+		const v3 kNearest(std::min(std::max(c.x, kMin.x), kMax.x), std::min(std::max(c.y, kMin.y), kMax.y),
+			std::min(std::max(c.z, kMin.z), kMax.z));
+		const v3 kFurthest(std::fabs(c.x - kMin.x) > std::fabs(c.x - kMax.x) ? kMin.x : kMax.x,
+			std::fabs(c.y - kMin.y) > std::fabs(c.y - kMax.y) ? kMin.y : kMax.y,
+			std::fabs(c.z - kMin.z) > std::fabs(c.z - kMax.z) ? kMin.z : kMax.z);
+		const f32 kBound = kelvinlet_asymptotic_error_bound(k, params.alpha, params.beta,
+			v3::Distance(c, kNearest), v3::Distance(c, kFurthest));
+		if (kBound >= 0.0f && kBound <= kTolerance)
+		{
+			accumulate_kelvinlet<kelvinlet_displacement_asymptotic>(k, params, pPositions, pFrames, kCount, pOut);
+			errorBound += kBound;
+			rStats.asymptoticPairs += kCount;
+		}
+		else
+		{
+			accumulate_kelvinlet<kelvinlet_displacement>(k, params, pPositions, pFrames, kCount, pOut);
+			rStats.directPairs += kCount;
+		}
+	}
+	return errorBound;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "Kelvinlet.h"
+#include "KDisplacement.h"
+#include "Mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// CPU port of the Kelvinlet displacement functions in KelvinletShader.fx.
+// Any change to the maths there needs to be mirrored here and vice versa.
+
+// Everything an evaluation needs besides the vertex data.
+// Vertices are evaluated in object space, so the Kelvinlets are taken into the instance's object space
+// once when they are packed rather than every vertex being taken into world space.
+struct KelvinletEvalParams
+{
+	const Kelvinlet* pKelvinlets = nullptr;
+	u32 numKelvinlets = 0;
+	const Kelvinlet* pFieldKelvinlets = nullptr;	// Scene field Kelvinlets reaching the instance, packed after its own
+	u32 numFieldKelvinlets = 0;
+	f32 alpha = 2.0f;		// Material parameter : pressure wave speed
+	f32 beta = 1.3f;		// Material parameter : shear wave speed
+	m4x4 matWorldToObject;	// Inverse model matrix of the instance being evaluated
+};
+
+// Beyond alpha * age + kKelvinletReachEpsilons * epsilon from its centre a Kelvinlet displaces by less
+// than ~1e-4 of its peak, so anything further away can leave it out
+constexpr f32 kKelvinletReachEpsilons = 4.0f;
+// Closest any of a Kelvinlet's wave fronts may come to points evaluated through its asymptotic form
+constexpr f32 kAsymptoticFrontEpsilons = 2.0f;
+
+// Totals over the evaluations made through evaluate_kelvinlet_displacements with bounds
+struct KelvinletAsymptoticStats
+{
+	u64 asymptoticPairs = 0;	// Kelvinlet and vertex pairs evaluated through the asymptotic form
+	u64 directPairs = 0;		// Pairs evaluated through the full form
+	f32 maxErrorBound = 0.0f;	// Largest bound on the error the asymptotic forms left in one vertex's displacement
+};
+
+v3 kelvinlet_impulse(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+v3 kelvinlet_pinch(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+v3 kelvinlet_scale(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+
+// Displacement of a single point due to one Kelvinlet of any type
+v3 kelvinlet_displacement(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+// As kelvinlet_displacement with the radial terms in double precision, which holds up close to the load
+// centre where the float terms cancel. Slower, and no longer a match for the shader.
+v3 kelvinlet_displacement_precise(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+
+// Leading order expansion of kelvinlet_displacement in epsilon / (r -+ c * age), for points well clear of
+// the Kelvinlet's wave fronts (see kelvinlet_asymptotic_error_bound). Takes no square roots past the
+// distance from the load centre.
+v3 kelvinlet_displacement_asymptotic(const v3& vpos, const Kelvinlet& k, f32 alpha, f32 beta);
+
+// Upper bound on how far one Kelvinlet can displace the points between kMinDistance and kMaxDistance from its
+// load centre. Pinch and scale grow without bound towards the load centre, so theirs is FLT_MAX when the shell
+// reaches it.
+f32 kelvinlet_displacement_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f32 kMinDistance, const f32 kMaxDistance);
+// As above for the points within a sphere, in the Kelvinlet's space
+f32 kelvinlet_displacement_bound(const Kelvinlet& k, f32 alpha, f32 beta, const v3& kCentre, const f32 kRadius);
+
+// Upper bound on how far kelvinlet_displacement_asymptotic can be from kelvinlet_displacement for the points
+// between kMinDistance and kMaxDistance from the load centre, leaving rounding aside. Negative when a wave
+// front comes within kAsymptoticFrontEpsilons epsilons of those points, or they reach the load centre, as
+// the expansion doesn't hold there.
+f32 kelvinlet_asymptotic_error_bound(const Kelvinlet& k, f32 alpha, f32 beta, const f32 kMinDistance, const f32 kMaxDistance);
+
+// Evaluates the displacements of kCount object space vertices, matching CS_Kelvinlet.
+// The Kelvinlets must already be in the same space (see Kelvinlet::transformed).
+void evaluate_kelvinlet_displacements(const KelvinletEvalParams& params, const v3* pPositions,
+	const MeshTangentFrame* pFrames, const u32 kCount, KDisplacement* pOut);
+// As above for a block of vertices inside bounds. Each Kelvinlet whose asymptotic form is within kTolerance
+// of the full one everywhere in the bounds is evaluated through it. Returns the sum of those Kelvinlets'
+// error bounds, which bounds the error of every vertex in the block.
+f32 evaluate_kelvinlet_displacements(const KelvinletEvalParams& params, const v3* pPositions,
+	const MeshTangentFrame* pFrames, const u32 kCount, const MeshBounds& bounds, const f32 kTolerance,
+	KDisplacement* pOut, KelvinletAsymptoticStats& rStats);
@@ -0,0 +1,150 @@
+#include "KelvinletLattice.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// Central difference step for the gradients, in cells
+static constexpr f32 kGradientStepCells = 0.05f;
+
+bool KelvinletLattice::build(const KelvinletEvalParams& packed, const MeshBounds& bounds, const u32 kNumVertices,
+	const f32 kCellEpsilons)
+{
+	m_params = packed;
+	f32 minEpsilon = FLT_MAX;
+	u32 numLive = 0;
+	for (u32 k = 0; k < packed.numKelvinlets; ++k)
+	{
+		if (packed.pKelvinlets[k].type != 0)
+		{
+			minEpsilon = std::min(minEpsilon, packed.pKelvinlets[k].epsilon);
+			++numLive;
+		}
+	}
+	if (numLive == 0)
+		return false;
+
+	// One node of padding on each side keeps the tangent plane points inside. A coarser spacing would let
+	// the epsilon wide wave fronts fall between nodes, so meshes that need more nodes per axis are left to
+	// direct evaluation.
+	const v3 kExtent = bounds.aabbMax - bounds.aabbMin;
+	const f32 kLargest = std::max(kExtent.x, std::max(kExtent.y, kExtent.z));
+	m_cell = minEpsilon * kCellEpsilons;
+	if (m_cell <= 0.0f || kLargest / m_cell > static_cast<f32>(kMaxNodesPerAxis - 3))
+		return false;
+	m_dims[0] = static_cast<u32>(std::ceil(kExtent.x / m_cell)) + 3;
+	m_dims[1] = static_cast<u32>(std::ceil(kExtent.y / m_cell)) + 3;
+	m_dims[2] = static_cast<u32>(std::ceil(kExtent.z / m_cell)) + 3;
+	m_origin = bounds.aabbMin - v3(m_cell);
+
+	// Both sides in single Kelvinlet evaluations
+	const u64 kNodes = static_cast<u64>(m_dims[0]) * m_dims[1] * m_dims[2];
+	const u64 kLatticeCost = kNodes * kEvaluationsPerNode * numLive + static_cast<u64>(kNumVertices) * kInterpolationCost;
+	if (kLatticeCost >= static_cast<u64>(kNumVertices) * kEvaluationsPerVertex * numLive)
+		return false;
+	m_nodes.resize(static_cast<size_t>(kNodes));
+	return true;
+}
+
+v3 KelvinletLattice::field_at(const v3& pos) const
+{
+	// Nodes are few and one bad gradient spoils a whole cell, so they are sampled at full precision
+	v3 d(0.0f);
+	for (u32 k = 0; k < m_params.numKelvinlets; ++k)
+		d += kelvinlet_displacement_precise(pos, m_params.pKelvinlets[k], m_params.alpha, m_params.beta);
+	return d;
+}
+
+void KelvinletLattice::evaluate_nodes(const u32 kBegin, const u32 kEnd)
+{
+	const f32 kStep = m_cell * kGradientStepCells;
+	const v3 kAxes[3] = { v3(kStep, 0.0f, 0.0f), v3(0.0f, kStep, 0.0f), v3(0.0f, 0.0f, kStep) };
+	for (u32 n = kBegin; n < kEnd; ++n)
+	{
+		const u32 kX = n % m_dims[0];
+		const u32 kY = (n / m_dims[0]) % m_dims[1];
+		const u32 kZ = n / (m_dims[0] * m_dims[1]);
+		const v3 kPos = m_origin + v3(static_cast<f32>(kX), static_cast<f32>(kY), static_cast<f32>(kZ)) * m_cell;
+
+		LatticeNode& node = m_nodes[n];
+		node.displacement = field_at(kPos);
+		for (u32 a = 0; a < 3; ++a)
+			node.gradient[a] = (field_at(kPos + kAxes[a]) - field_at(kPos - kAxes[a])) * (0.5f / kStep);
+	}
+}
+
+void KelvinletLattice::interpolate(const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount,
+	KDisplacement* pOut) const
+{
+	const f32 kInvCell = 1.0f / m_cell;
+	const u32 kStrideY = m_dims[0];
+	const u32 kStrideZ = m_dims[0] * m_dims[1];
+	const u32 kCornerOffsets[8] = { 0, 1, kStrideY, kStrideY + 1, kStrideZ, kStrideZ + 1, kStrideZ + kStrideY, kStrideZ + kStrideY + 1 };
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		// Cell holding the vertex and its position within it
+		const v3 kGrid = (pPositions[i] - m_origin) * kInvCell;
+		const f32 kCoords[3] = { kGrid.x, kGrid.y, kGrid.z };
+		u32 cell[3];
+		f32 frac[3];
+		for (u32 a = 0; a < 3; ++a)
+		{
+			const f32 kFloor = std::floor(kCoords[a]);
+			cell[a] = static_cast<u32>(std::min(std::max(kFloor, 0.0f), static_cast<f32>(m_dims[a] - 2)));
+			frac[a] = std::min(std::max(kCoords[a] - static_cast<f32>(cell[a]), 0.0f), 1.0f);
+		}
+		const f32 kWy[2] = { 1.0f - frac[1], frac[1] };
+		const f32 kWz[2] = { 1.0f - frac[2], frac[2] };
+		const f32 kWx[2] = { 1.0f - frac[0], frac[0] };
+
+		// Blend the nodes' displacement and gradient as one block of floats. Each node's displacement is
+		// first moved half way along its gradient towards the vertex: trilinear blending alone undershoots
+		// curvature by as much as blending the nodes' full first order expansions overshoots it, so the
+		// average reproduces quadratic fields exactly.
+		static_assert(sizeof(LatticeNode) == 12 * sizeof(f32), "LatticeNode is read as 12 packed floats");
+		f32 blend[12] = {};
+		const LatticeNode* pBase = m_nodes.data() + cell[0] + cell[1] * kStrideY + cell[2] * kStrideZ;
+		for (u32 corner = 0; corner < 8; ++corner)
+		{
+			const u32 kBits[3] = { corner & 1, (corner >> 1) & 1, corner >> 2 };
+			const f32 kWeight = kWx[kBits[0]] * kWy[kBits[1]] * kWz[kBits[2]];
+			const f32* pNode = &pBase[kCornerOffsets[corner]].displacement.x;
+			f32 halfStep[3];
+			for (u32 a = 0; a < 3; ++a)
+				halfStep[a] = 0.5f * m_cell * (frac[a] - static_cast<f32>(kBits[a]));
+			for (u32 c = 0; c < 3; ++c)
+				blend[c] += (pNode[c] + pNode[3 + c] * halfStep[0] + pNode[6 + c] * halfStep[1] + pNode[9 + c] * halfStep[2]) * kWeight;
+			for (u32 c = 3; c < 12; ++c)
+				blend[c] += pNode[c] * kWeight;
+		}
+
+		// The tangent plane points move by the displacement plus the gradient along their offset
+		const v3 kTangent(pFrames[i].tangent.x, pFrames[i].tangent.y, pFrames[i].tangent.z);
+		const v3 kOffset1 = kTangent * kTangentPointOffset;
+		const v3 kOffset2 = pFrames[i].normal.Cross(kTangent) * kTangentPointOffset;
+		const v3 kDisplacement(blend[0], blend[1], blend[2]);
+		const v3 kGradX(blend[3], blend[4], blend[5]);
+		const v3 kGradY(blend[6], blend[7], blend[8]);
+		const v3 kGradZ(blend[9], blend[10], blend[11]);
+
+		KDisplacement& out = pOut[i];
+		out.displacement = kDisplacement;
+		out.auxDisplacement1 = kDisplacement + kGradX * kOffset1.x + kGradY * kOffset1.y + kGradZ * kOffset1.z;
+		out.auxDisplacement2 = kDisplacement + kGradX * kOffset2.x + kGradY * kOffset2.y + kGradZ * kOffset2.z;
+	}
+}
+
+f32 KelvinletLattice::measure_error(const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount,
+	const KDisplacement* pInterpolated, f32& rMaxDisplacement) const
+{
+	f32 maxError = 0.0f;
+	rMaxDisplacement = 0.0f;
+	const u32 kStride = std::max(1u, kCount / kErrorSamples);
+	for (u32 i = 0; i < kCount; i += kStride)
+	{
+		KDisplacement exact;
+		evaluate_kelvinlet_displacements(m_params, pPositions + i, pFrames + i, 1, &exact);
+		maxError = std::max(maxError, v3::Distance(exact.displacement, pInterpolated[i].displacement));
+		rMaxDisplacement = std::max(rMaxDisplacement, exact.displacement.Length());
+	}
+	return maxError;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "KelvinletKernels.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// KelvinletLattice
+//
+// Responsibility : Free-form deformation evaluation for dense meshes. The Kelvinlet field is sampled,
+//                  with its gradient, on a coarse lattice around the mesh whose spacing follows the
+//                  smallest live epsilon. Every vertex is then deformed by trilinear interpolation of
+//                  the lattice, corrected by the gradients so quadratic fields come out exact, and the
+//                  cost scales with the lattice rather than the vertex count. The tangent plane points
+//                  CS_Kelvinlet evaluates come from the interpolated gradient.
+
+// Totals over the evaluations made since the last reset
+struct KelvinletLatticeStats
+{
+	u32 latticeEvaluations = 0;	// Instances deformed through a lattice
+	u32 directEvaluations = 0;	// Instances too coarse or too wide for a lattice, evaluated per vertex
+	u64 nodes = 0;				// Lattice nodes evaluated
+	u64 vertices = 0;			// Vertices deformed through them
+	f32 maxError = 0.0f;		// Largest interpolation error found at the sampled vertices
+	f32 maxDisplacement = 0.0f;	// Largest exact displacement at the same vertices, for scale
+};
+
+class KelvinletLattice
+{
+public:
+	static constexpr f32 kDefaultCellEpsilons = 0.25f;	// Node spacing in units of the smallest live epsilon
+	static constexpr u32 kMaxNodesPerAxis = 64;		// Meshes needing more are evaluated directly
+	static constexpr u32 kEvaluationsPerNode = 7;	// The node and a central difference along each axis
+	static constexpr u32 kEvaluationsPerVertex = 3;	// The vertex and its two tangent plane points
+	static constexpr u32 kInterpolationCost = 3;	// Cost of interpolating a vertex, in single Kelvinlet evaluations
+	static constexpr u32 kErrorSamples = 64;		// Vertices evaluated exactly to measure the error
+
+	KelvinletLattice() {}
+	KelvinletLattice(const KelvinletLattice&) = delete;
+	KelvinletLattice& operator=(const KelvinletLattice&) = delete;
+
+	// Lays the lattice over the bounds for Kelvinlets already in object space, which must stay alive until
+	// the evaluation is done. Returns false when sampling and interpolating it would cost more than evaluating
+	// the kNumVertices vertices directly, when the bounds are too wide for kMaxNodesPerAxis nodes at the
+	// spacing, or when no Kelvinlet is live.
+	bool build(const KelvinletEvalParams& packed, const MeshBounds& bounds, const u32 kNumVertices,
+		const f32 kCellEpsilons = kDefaultCellEpsilons);
+
+	// Both take ranges so the caller can spread them across the job queue
+	void evaluate_nodes(const u32 kBegin, const u32 kEnd);
+	void interpolate(const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount, KDisplacement* pOut) const;
+
+	// Evaluates up to kErrorSamples evenly spread vertices exactly and returns the largest difference from
+	// their interpolated displacements, along with the largest exact displacement
+	f32 measure_error(const v3* pPositions, const MeshTangentFrame* pFrames, const u32 kCount,
+		const KDisplacement* pInterpolated, f32& rMaxDisplacement) const;
+
+	u32 num_nodes() const { return static_cast<u32>(m_nodes.size()); }
+
+private:
+	struct LatticeNode
+	{
+		v3 displacement;
+		v3 gradient[3];	// Derivative of the displacement along x, y and z
+	};
+
+	v3 field_at(const v3& pos) const;
+
+	KelvinletEvalParams m_params;
+	v3 m_origin;			// Position of node (0, 0, 0)
+	f32 m_cell = 0.0f;
+	u32 m_dims[3] = {};
+	std::vector<LatticeNode> m_nodes;	// x fastest, then y, then z
+};
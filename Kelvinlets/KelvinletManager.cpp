@@ -1,8 +1,19 @@
 #include "KelvinletManager.h"
+#include "KelvinletKernels.h"
+
+#include <algorithm>
+#include <cfloat>
 
 // Move constructor
 KelvinletManager::KelvinletManager(KelvinletManager&& kmOther) :
-	m_timeline(kmOther.m_timeline),
+	m_maxKelvinlets(kmOther.m_maxKelvinlets),
+	m_numUploaded(kmOther.m_numUploaded),
+	m_timeline(std::move(kmOther.m_timeline)),
+	m_evaluated(std::move(kmOther.m_evaluated)),
+	m_retirements(std::move(kmOther.m_retirements)),
+	m_numRetired(kmOther.m_numRetired),
+	m_alpha(kmOther.m_alpha),
+	m_beta(kmOther.m_beta),
 	m_pKelvinletBuffer(nullptr),
 	m_pKelvinletBufferSRV(nullptr)
 {
@@ -24,11 +35,15 @@ KelvinletManager& KelvinletManager::operator=(KelvinletManager&& kmOther)
 		release();
 		// Copy the other object into this one
 		m_maxKelvinlets = kmOther.m_maxKelvinlets;
+		m_numUploaded = kmOther.m_numUploaded;
 		m_alpha = kmOther.m_alpha;
 		m_beta = kmOther.m_beta;
 		m_pKelvinletBuffer = kmOther.m_pKelvinletBuffer;
 		m_pKelvinletBufferSRV = kmOther.m_pKelvinletBufferSRV;
 		m_timeline = std::move(kmOther.m_timeline);
+		m_evaluated = std::move(kmOther.m_evaluated);
+		m_retirements = std::move(kmOther.m_retirements);
+		m_numRetired = kmOther.m_numRetired;
 		// Prevent multiple attempts to release resources
 		kmOther.m_pKelvinletBuffer = nullptr;
 		kmOther.m_pKelvinletBufferSRV = nullptr;
@@ -46,20 +61,114 @@ void KelvinletManager::init(SystemsInterface& systems)
 {
 	m_timeline.init();
 
-	D3D11_SUBRESOURCE_DATA kData;
-	kData.pSysMem = m_timeline.get_kelvinlet_array();
-	kData.SysMemPitch = 0;
-	kData.SysMemSlicePitch = 0;
-
-	m_pKelvinletBuffer = create_dynamic_structured_buffer<Kelvinlet>(systems.pD3DDevice, m_maxKelvinlets, &kData);
-	m_pKelvinletBufferSRV = create_structured_buffer_SRV(systems.pD3DDevice, m_maxKelvinlets, m_pKelvinletBuffer);
+	// Filled by the first upload, which happens before the first dispatch
+	const u32 kCapacity = m_maxKelvinlets + kMaxFieldKelvinlets;
+	m_pKelvinletBuffer = create_dynamic_structured_buffer<Kelvinlet>(systems.pD3DDevice, kCapacity, nullptr);
+	m_pKelvinletBufferSRV = create_structured_buffer_SRV(systems.pD3DDevice, kCapacity, m_pKelvinletBuffer);
 }
 
 // Called every frame to update Kelvinlets
-void KelvinletManager::update(SystemsInterface& systems, float dt)
+void KelvinletManager::update(SystemsInterface& systems, float dt, const m4x4& matWorldToObject,
+	const Kelvinlet* pFieldKelvinlets, const u32 kNumFieldKelvinlets)
+{
+	advance_timeline(dt);
+	upload_kelvinlets(systems.pD3DContext, matWorldToObject, pFieldKelvinlets, kNumFieldKelvinlets);
+}
+
+void KelvinletManager::advance_timeline(float dt)
 {
 	m_timeline.update(dt);
-	update_dynamic_structured_buffer(systems.pD3DContext, m_pKelvinletBuffer, m_timeline.get_kelvinlet_array(), m_maxKelvinlets);
+	refresh_evaluated();
+}
+
+void KelvinletManager::refresh_evaluated()
+{
+	const Kelvinlet* pKelvinlets = m_timeline.get_kelvinlet_array();
+	m_numRetired = 0;
+	for (u32 k = 0; k < m_maxKelvinlets; ++k)
+	{
+		// Scrubbing back or stopping the timeline brings a retired Kelvinlet back
+		Retirement& retirement = m_retirements[k];
+		if (retirement.age >= 0.0f && (pKelvinlets[k].type == 0 || pKelvinlets[k].age < retirement.age))
+			retirement = Retirement();
+		if (pKelvinlets[k].age * kRetireCheckAgeRatio < retirement.nextCheckAge)
+			retirement.nextCheckAge = 0.0f;
+
+		m_evaluated[k] = pKelvinlets[k];
+		if (retirement.age >= 0.0f)
+		{
+			m_evaluated[k].type = 0;
+			++m_numRetired;
+		}
+	}
+}
+
+u32 KelvinletManager::retire_negligible(const MeshBounds& bounds, const m4x4& matWorldToObject, const f32 kTolerance)
+{
+	const Kelvinlet* pKelvinlets = m_timeline.get_kelvinlet_array();
+	const f32 kSlowSpeed = std::min(m_alpha, m_beta);
+	for (u32 k = 0; k < m_maxKelvinlets; ++k)
+	{
+		const Kelvinlet& kelvinlet = pKelvinlets[k];
+		Retirement& retirement = m_retirements[k];
+		if (kelvinlet.type == 0 || kelvinlet.age <= 0.0f || retirement.age >= 0.0f || kelvinlet.age < retirement.nextCheckAge)
+			continue;
+		retirement.nextCheckAge = kelvinlet.age * kRetireCheckAgeRatio;
+
+		// Distances from the load centre to the nearest and furthest points the bounding sphere can hold
+		const f32 kCentreDistance = v3::Distance(kelvinlet.transformed(matWorldToObject).loadCentre, bounds.sphereCentre);
+		const f32 kNearest = std::max(0.0f, kCentreDistance - bounds.sphereRadius);
+		const f32 kFurthest = kCentreDistance + bounds.sphereRadius;
+
+		// Only once both fronts have cleared the sphere does the displacement over it just decay, so the bound
+		// over it holds from now on. Until then a front can still carry a larger one in.
+		const f32 kSlowFront = kSlowSpeed * kelvinlet.age;
+		if (kSlowFront - kKelvinletReachEpsilons * kelvinlet.epsilon <= kFurthest)
+			continue;
+		if (kelvinlet_displacement_bound(kelvinlet, m_alpha, m_beta, kNearest, kFurthest) < kTolerance)
+			retirement.age = kelvinlet.age;
+	}
+	refresh_evaluated();
+	return m_numRetired;
+}
+
+void KelvinletManager::clear_retirements()
+{
+	for (Retirement& retirement : m_retirements)
+		retirement = Retirement();
+	refresh_evaluated();
+}
+
+void KelvinletManager::upload_kelvinlets(ID3D11DeviceContext* pContext, const m4x4& matWorldToObject,
+	const Kelvinlet* pFieldKelvinlets, const u32 kNumFieldKelvinlets)
+{
+	ASSERT(kNumFieldKelvinlets <= kMaxFieldKelvinlets);
+
+	// Transform straight into the mapped buffer rather than through a copy
+	D3D11_MAPPED_SUBRESOURCE mappedSubresource;
+	ZeroMemory(&mappedSubresource, sizeof(D3D11_MAPPED_SUBRESOURCE));
+
+	if (!FAILED(pContext->Map(m_pKelvinletBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubresource)))
+	{
+		const Kelvinlet* pKelvinlets = m_evaluated.data();
+		Kelvinlet* pMapped = static_cast<Kelvinlet*>(mappedSubresource.pData);
+		for (u32 k = 0; k < m_maxKelvinlets; ++k)
+			pMapped[k] = pKelvinlets[k].transformed(matWorldToObject);
+		for (u32 k = 0; k < kNumFieldKelvinlets; ++k)
+			pMapped[m_maxKelvinlets + k] = pFieldKelvinlets[k].transformed(matWorldToObject);
+		pContext->Unmap(m_pKelvinletBuffer, 0);
+		m_numUploaded = m_maxKelvinlets + kNumFieldKelvinlets;
+	}
+}
+
+MemoryUsage KelvinletManager::memory_usage() const
+{
+	MemoryUsage usage;
+	usage.cpuBytes = m_timeline.memory_bytes() + m_evaluated.capacity() * sizeof(Kelvinlet) +
+		m_retirements.capacity() * sizeof(Retirement);
+	if (m_pKelvinletBuffer)
+		usage.gpuBytes = static_cast<u64>(m_maxKelvinlets + kMaxFieldKelvinlets) * sizeof(Kelvinlet);
+	return usage;
 }
 
 void KelvinletManager::release()
@@ -81,6 +190,7 @@ void KelvinletManager::pause()
 void KelvinletManager::stop()
 {
 	m_timeline.stop();
+	refresh_evaluated();
 }
 
 void KelvinletManager::bind_kelvinlet_data_SRV_to_CS(ID3D11DeviceContext* pContext, u32 slot) const
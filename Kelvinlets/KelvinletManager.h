@@ -2,17 +2,28 @@
 
 #include "Manager.h"
 #include "KelvinletTimeline.h"
+#include "Mesh.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 // KelvinletManager : public Manager			
 //
 // Responsibility : Manages Kelvinlets for a mesh instance. It has a timeline which schedules Kelvinlets
 //                  and contains the material properties alpha (P-wave speed) and beta (S-wave speed).
+//                  Kelvinlets whose displacement of the instance has died away for good are retired:
+//                  they stay on the timeline but evaluation and the GPU upload leave them out.
 
 class KelvinletManager : public Manager<KelvinletManager>
 {
 public:
-	KelvinletManager(const u32 maxNum) : m_maxKelvinlets(maxNum), m_timeline(maxNum) {}
+	// Room in the GPU buffer for Kelvinlets from the scene's field
+	static constexpr u32 kMaxFieldKelvinlets = 16;
+
+	// A Kelvinlet isn't checked for retirement again until its age has grown by this factor, which is
+	// a small share of how quickly its displacement decays
+	static constexpr f32 kRetireCheckAgeRatio = 1.1f;
+
+	KelvinletManager(const u32 maxNum) :
+		m_maxKelvinlets(maxNum), m_timeline(maxNum), m_evaluated(maxNum), m_retirements(maxNum) {}
 	KelvinletManager(const KelvinletManager&) = delete;
 	KelvinletManager& operator=(const KelvinletManager&) = delete;
 	KelvinletManager(KelvinletManager&&);					// Move constructor
@@ -20,7 +31,21 @@ public:
 	~KelvinletManager();
 
 	void init(SystemsInterface&);
-	void update(SystemsInterface&, float);
+	void update(SystemsInterface&, float, const m4x4& matWorldToObject,
+		const Kelvinlet* pFieldKelvinlets = nullptr, const u32 kNumFieldKelvinlets = 0);
+	void advance_timeline(float dt);					// CPU side of update, safe off the main thread
+	// Retires the Kelvinlets that can no longer displace any point within the object space bounds by more
+	// than kTolerance, at their present age or any later one: both wave fronts have passed every point and
+	// what they leave behind is under kTolerance. A Kelvinlet comes back if its age goes back below the one
+	// it was retired at.
+	// Returns how many are retired.
+	u32 retire_negligible(const MeshBounds& bounds, const m4x4& matWorldToObject, const f32 kTolerance);
+	void clear_retirements();
+	// GPU side of update. The compute shader works in object space, so the Kelvinlets are taken
+	// into it here with the instance's inverse model matrix. World space Kelvinlets from the scene's
+	// field that reach the instance follow its own, up to kMaxFieldKelvinlets of them.
+	void upload_kelvinlets(ID3D11DeviceContext*, const m4x4& matWorldToObject,
+		const Kelvinlet* pFieldKelvinlets = nullptr, const u32 kNumFieldKelvinlets = 0);
 	void release();
 
 	void play();
@@ -32,13 +57,33 @@ public:
 	float* get_alpha_ptr() { return &m_alpha; }
 	float* get_beta_ptr() { return &m_beta; }
 	const u32 get_num_kelvinlets() const { return m_maxKelvinlets; }
+	// Kelvinlets in the GPU buffer after the last upload, field ones included
+	const u32 get_num_uploaded_kelvinlets() const { return m_numUploaded; }
 	KelvinletTimeline& get_timeline() { return m_timeline; }
+	const KelvinletTimeline& get_timeline() const { return m_timeline; }
+	// The timeline's Kelvinlets as evaluation sees them, with the retired ones null. Brought up to date by
+	// advance_timeline and retire_negligible.
+	const Kelvinlet* get_evaluated_kelvinlets() const { return m_evaluated.data(); }
+	u32 get_num_retired() const { return m_numRetired; }
 
 	void bind_kelvinlet_data_SRV_to_CS(ID3D11DeviceContext*, u32) const;
+	MemoryUsage memory_usage() const;
 
 private:
+	struct Retirement
+	{
+		f32 age = -1.0f;			// Age the Kelvinlet was retired at, negative while it is live
+		f32 nextCheckAge = 0.0f;
+	};
+
+	void refresh_evaluated();
+
 	u32 m_maxKelvinlets = 10;	// Maximum number allowed in the timeline
+	u32 m_numUploaded = 0;
 	KelvinletTimeline m_timeline;
+	std::vector<Kelvinlet> m_evaluated;
+	std::vector<Retirement> m_retirements;	// Per timeline slot
+	u32 m_numRetired = 0;
 	float m_alpha = 2.0f;
 	float m_beta = 1.3f;
 
@@ -9,11 +9,16 @@ class KelvinletTimeline
 public:
 	KelvinletTimeline(const u32 max_ks) : m_maxKelvinlets(max_ks), m_kelvinlets(max_ks)
 	{}
+	KelvinletTimeline(const KelvinletTimeline&) = default;
+	KelvinletTimeline& operator=(const KelvinletTimeline&) = default;
+	KelvinletTimeline(KelvinletTimeline&&) = default;
+	KelvinletTimeline& operator=(KelvinletTimeline&&) = default;
 	~KelvinletTimeline() 
 	{}
 
 	const u32 get_max_num_kelvinlets() const { return m_maxKelvinlets; }
 	const Kelvinlet* get_kelvinlet_array() const { return m_kelvinlets.data(); }
+	size_t memory_bytes() const { return m_kelvinlets.capacity() * sizeof(Kelvinlet); }
 	const float get_endpoint() const { return m_endPoint; }
 	float* get_play_speed_ptr() { return &m_playSpeed; }
 	float* get_timepoint_ptr() { return &m_timePoint; }
@@ -1,4 +1,5 @@
 #include "KelvinletsApp.h"
+#include "MeshStreamFile.h"
 
 // Helper function for dispatching compute shader threads
 s32 align(s32 num, s32 alignment)
@@ -24,6 +25,8 @@ void KelvinletsApp::on_init(SystemsInterface& systems)
 	init_shaders(systems);
 	// Load meshes from file or otherwise
 	m_meshManager.init(systems);
+	// Scene-level Kelvinlets, empty until some are added in the editor
+	m_kelvinletField.init();
 	// Load textures from file or otherwise
 	m_texture.init_from_dds(systems.pD3DDevice, "Assets/Textures/brick.dds");
 	// Create a mesh instance
@@ -46,6 +49,10 @@ void KelvinletsApp::on_init(SystemsInterface& systems)
 void KelvinletsApp::on_update(SystemsInterface& systems)
 {
 	m_timer.Start();
+	// Everything below up to the end of on_render is checked for heap allocations
+	m_frameHeapStart = heap_counts();
+	m_frameArena.reset();
+	m_steadyFrame = true;
 	
 	// Update per-frame data on the CPU
 	m4x4 matView = systems.pCamera->viewMatrix.Transpose();
@@ -78,99 +85,53 @@ void KelvinletsApp::on_update(SystemsInterface& systems)
 	ImGui::Begin("Kelvinlet Timeline");
 
 	ImGui::Text("Frame time: %f ms", m_frameTime);
+	if (large_page_size() != 0)
+		ImGui::Text("Large pages in use: %.1f MB", large_page_bytes_in_use() / (1024.0 * 1024.0));
+	else
+		ImGui::Text("Large pages unavailable");
+	ImGui::Text("Heap allocations last frame: %llu (%llu bytes)", m_frameHeap.allocations, m_frameHeap.bytes);
+	ImGui::Text("Frame arena: %zu / %zu KB", m_frameArena.high_water_mark() / 1024, m_frameArena.capacity() / 1024);
+	if (ImGui::TreeNode("Memory"))
+	{
+		show_memory_usage("Meshes", m_meshManager.memory_usage());
+		show_memory_usage("Kelvinlets", m_meshInstanceManager.kelvinlet_memory_usage());
+		show_memory_usage("Kelvinlet field", m_kelvinletField.memory_usage());
+		show_memory_usage("Displacements", m_meshInstanceManager.displacement_memory_usage());
+		ImGui::TreePop();
+	}
 	ImGui::Dummy({ 20.0f, 20.0f });
 	ImGui::RadioButton("Edit Mode", &m_editorMode, 0); ImGui::SameLine();
 	ImGui::RadioButton("Play Mode", &m_editorMode, 1);
 
-	static Kelvinlet k;
-	static float lc[3] = { 0.0f, 0.0f, 0.0f };
-	static float fp[3] = { 0.0f, 0.0f, 0.0f };
-
 	// EDIT MODE
 	if (m_editorMode == 0)
 	{
 		if (m_ticking)
 		{
 			m_meshInstanceManager.stop(systems.pD3DContext);
+			m_kelvinletField.stop();
 			m_ticking = false;
 		}
+		// Scene-level Kelvinlets are placed in world space and reach any instance near enough
+		if (ImGui::TreeNode("Scene field"))
+		{
+			edit_timeline_kelvinlets(m_kelvinletField.get_timeline());
+			ImGui::TreePop();
+		}
 		// List each active mesh instance as a dropdown menu \/ List all Kelvinlets as drop-down menus
 		// At the bottom, have an add Kelvinlet dropdown button, which will list parameters and have an add button
 		int instanceNum = 0;	
 		// Iterate over each mesh instance
-		std::string instanceName;
-		std::string kName;
 		for (auto mi_it = m_meshInstanceManager.begin(); mi_it != m_meshInstanceManager.end(); ++mi_it)
 		{
 			// List the mesh instance as a drop-down menu
-			instanceName = std::string("Instance##") + std::to_string(instanceNum);
-			if (ImGui::TreeNode(instanceName.c_str()))
+			if (ImGui::TreeNode(m_frameArena.format("Instance##%d", instanceNum)))
 			{
 				KelvinletManager& km = mi_it->get_kelvinlet_manager();
-				KelvinletTimeline& kt = km.get_timeline();
 				// Provide an interface to edit physical parameters
 				ImGui::SliderFloat("Alpha", km.get_alpha_ptr(), 0.2f, 10.0f);
 				ImGui::SliderFloat("Beta", km.get_beta_ptr(), 0.1f, 0.7f*km.get_alpha());
-				// Iterate over all of the mesh instance's Kelvinlets
-				int kNum = 0;
-				for (auto it = kt.begin(); it != kt.end(); ++it)
-				{
-					if (it->type == 0)
-						continue;
-					kName = std::string("Kelvinlet##") + std::to_string(kNum);
-					if (ImGui::TreeNode(kName.c_str()))
-					{
-						Kelvinlet& k = *it;
-						ImGui::Text("Load Centre: %f, %f, %f", k.loadCentre.x, k.loadCentre.y, k.loadCentre.z);
-						ImGui::Text("Force Params: %f, %f, %f", k.forceParams.x, k.forceParams.y, k.forceParams.z);
-						ImGui::Text("Regularization: %f", k.epsilon);
-						switch (k.type)
-						{
-						case 1:
-							ImGui::Text("Type: Impulse"); break;
-						case 2:
-							ImGui::Text("Type: Pinch"); break;
-						case 3:
-							ImGui::Text("Type: Scale"); break;
-						default:
-							ImGui::Text("Type: ?"); break;
-						}
-						ImGui::Text("Start Time: %f", k.startTime);
-						ImGui::Text("Lifespan: %f", k.lifespan);
-
-						if (ImGui::Button("Remove Kelvinlet"))
-						{
-							kt.remove_kelvinlet(k);
-							ImGui::TreePop();
-							continue;
-						}
-						ImGui::TreePop();
-					}
-					++kNum;
-				}	
-
-				if (ImGui::TreeNode("New Kelvinlet"))
-				{
-					ImGui::InputFloat3("Load Centre", lc);
-					ImGui::InputFloat3("Force Params", fp);
-					ImGui::SliderFloat("Regularization", &k.epsilon, 0.01f, 10.0f);
-					ImGui::RadioButton("Impulse", &k.type, 1); ImGui::SameLine();
-					ImGui::RadioButton("Pinch", &k.type, 2); ImGui::SameLine();
-					ImGui::RadioButton("Scale", &k.type, 3);
-					ImGui::InputFloat("Start Time", &k.startTime);
-					ImGui::InputFloat("Life Span", &k.lifespan);
-
-					if (ImGui::Button("Add"))
-					{
-						k.loadCentre = v3(lc[0], lc[1], lc[2]);
-						k.forceParams = v3(fp[0], fp[1], fp[2]);
-						kt.insert_kelvinlet(k);
-						ImGui::TreePop();
-						ImGui::TreePop();
-						continue;
-					}
-					ImGui::TreePop();
-				}
+				edit_timeline_kelvinlets(km.get_timeline());
 				ImGui::TreePop();
 			}
 			++instanceNum;	
@@ -184,22 +145,79 @@ void KelvinletsApp::on_update(SystemsInterface& systems)
 	
 		ImGui::RadioButton("Play", &pause, 0); ImGui::SameLine();
 		ImGui::RadioButton("Pause", &pause, 1); ImGui::SameLine();
-		if (ImGui::Button("Reset")) { m_meshInstanceManager.stop(systems.pD3DContext); }
+		if (ImGui::Button("Reset")) { m_meshInstanceManager.stop(systems.pD3DContext); m_kelvinletField.stop(); m_steadyFrame = false; }
 
 		m_ticking = !static_cast<bool>(pause);
 
+		ImGui::Checkbox("Evaluate on CPU", &m_evaluateOnCPU);
+		if (m_evaluateOnCPU)
+		{
+			ImGui::Checkbox("Evaluate dense meshes on a lattice", &m_latticeEvaluation);
+			if (m_latticeEvaluation)
+			{
+				ImGui::SliderFloat("Lattice spacing (epsilons)", &m_latticeCellEpsilons, 0.1f, 1.0f);
+				const KelvinletLatticeStats& ls = m_latticeStats;
+				ImGui::Text("Lattice: %u instances, %llu nodes for %llu vertices (%u evaluated directly)",
+					ls.latticeEvaluations, ls.nodes, ls.vertices, ls.directEvaluations);
+				ImGui::Text("Sampled interpolation error: %.2e (%.3f%% of largest displacement)", ls.maxError,
+					ls.maxDisplacement > 0.0f ? 100.0f * ls.maxError / ls.maxDisplacement : 0.0f);
+			}
+			ImGui::Checkbox("Use asymptotic forms far from wave fronts", &m_asymptoticEvaluation);
+			if (m_asymptoticEvaluation)
+			{
+				ImGui::SliderFloat("Asymptotic tolerance (bounding radii)", &m_asymptoticTolerance, 1e-7f, 1e-3f, "%.1e", 10.0f);
+				const KelvinletAsymptoticStats& as = m_asymptoticStats;
+				const u64 kPairs = as.asymptoticPairs + as.directPairs;
+				ImGui::Text("Asymptotic: %.1f%% of Kelvinlet evaluations, error bound %.2e",
+					kPairs > 0 ? 100.0 * as.asymptoticPairs / kPairs : 0.0, as.maxErrorBound);
+			}
+			ImGui::Checkbox("Evaluate distant instances on proxies", &m_proxyLOD);
+			ImGui::Text("Proxy levels: %u full, %u / %u / %u simplified", m_proxyLevelCounts[0], m_proxyLevelCounts[1],
+				m_proxyLevelCounts[2], m_proxyLevelCounts[3]);
+		}
+		ImGui::Checkbox("Share identical evaluations", &m_shareEvaluations);
+		ImGui::Text("Shared evaluations: %u of %u instances", m_sharedEvaluations, m_meshInstanceManager.num_instances());
+		ImGui::Checkbox("Skip out-of-view instances", &m_cullInstances);
+		ImGui::Text("Out of view: %u instances", m_culledInstances);
+		ImGui::Checkbox("Update distant instances less often", &m_updateRateLOD);
+		ImGui::Text("Lagging: %u instances, busiest update %.0f%% of average", m_laggingInstances, m_updateSlotSpread * 100.0f);
+		ImGui::Checkbox("Retire Kelvinlets that have died away", &m_retireKelvinlets);
+		if (m_retireKelvinlets)
+			ImGui::SliderFloat("Retire below (bounding radii)", &m_retireTolerance, 1e-6f, 1e-2f, "%.1e", 10.0f);
+		ImGui::Text("Retired: %u Kelvinlets", m_retiredKelvinlets);
+		if (ImGui::Checkbox("Hold evaluation to a time budget", &m_governQuality) && !m_governQuality)
+			m_qualityGovernor.reset();
+		if (m_governQuality)
+		{
+			ImGui::SliderFloat("Budget (ms)", m_qualityGovernor.get_budget_ptr(), 1.0f, 33.0f);
+			ImGui::Text("Quality level %u of %u, evaluation %.2f ms smoothed, %u changes", m_qualityGovernor.get_level(),
+				QualityGovernor::kNumLevels - 1, m_qualityGovernor.get_smoothed_ms(), m_qualityGovernor.get_num_changes());
+		}
+
+		if (ImGui::TreeNode("Scene field"))
+		{
+			KelvinletTimeline& kt = m_kelvinletField.get_timeline();
+			ImGui::SliderFloat("Playback Speed", kt.get_play_speed_ptr(), -1.0f, 1.0f);
+			ImGui::SliderFloat("Time", kt.get_timepoint_ptr(), 0.0f, kt.get_endpoint());
+			ImGui::Text("Instances reached: %u", m_kelvinletField.get_num_reached());
+			ImGui::TreePop();
+		}
+
 		int instanceNum = 0;
 		// Iterate over each mesh instance
-		std::string instanceName;
 		for (auto mi_it = m_meshInstanceManager.begin(); mi_it != m_meshInstanceManager.end(); ++mi_it)
 		{
 			// List the mesh instance as a drop-down menu
-			instanceName = std::string("Instance##") + std::to_string(instanceNum);
-			if (ImGui::TreeNode(instanceName.c_str()))
+			if (ImGui::TreeNode(m_frameArena.format("Instance##%d", instanceNum)))
 			{
 				KelvinletTimeline& kt = mi_it->get_kelvinlet_manager().get_timeline();
 				ImGui::SliderFloat("Playback Speed", kt.get_play_speed_ptr(), -1.0f, 1.0f);
 				ImGui::SliderFloat("Time", kt.get_timepoint_ptr(), 0.0f, kt.get_endpoint());
+				if (ImGui::Button("Bake to disk"))
+				{
+					bake_displacements_to_disk(*mi_it);
+					m_steadyFrame = false;
+				}
 
 				ImGui::TreePop();
 			}
@@ -209,13 +227,45 @@ void KelvinletsApp::on_update(SystemsInterface& systems)
 		if (m_ticking)
 		{
 			m_meshInstanceManager.play();
-			// Update each mesh instance
-			m_meshInstanceManager.update(systems, m_frameTime);
-			// Perform Kelvinlet calculations for animation
-			calculate_kelvinlet_displacements(systems);
+			m_kelvinletField.play();
+			// Advance each instance's timeline and calculate its displacements for animation
+			run_update_graph(systems);
 		}
 		else
+		{
 			m_meshInstanceManager.pause();
+			m_kelvinletField.pause();
+			// Timelines don't move while paused, but instances skipped while out of view or between their
+			// updates still need evaluating once the camera brings them back
+			if (needs_catch_up(*systems.pCamera))
+				run_update_graph(systems, true);
+		}
+
+		if (m_updateGraph.num_tasks() > 0 && ImGui::TreeNode("Update graph"))
+		{
+			ImGui::Text("Execute: %.3f ms, critical path: %.3f ms", m_updateGraph.get_execute_ms(), m_updateGraph.get_critical_path_ms());
+			for (u32 task : m_updateGraph.get_critical_path())
+				ImGui::BulletText("%s : %.3f ms", m_updateGraph.get_task_name(task), m_updateGraph.get_task_ms(task));
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Job queue"))
+		{
+			// Only run while paused so the update graph isn't sharing the pool
+			if (!m_ticking && ImGui::Button("Run benchmark"))
+			{
+				m_jobBenchmark = run_job_queue_benchmark();
+				m_steadyFrame = false;
+			}
+			if (m_jobBenchmark.numJobs > 0)
+			{
+				ImGui::Text("%u jobs, %u workers", m_jobBenchmark.numJobs, m_jobBenchmark.numWorkers);
+				ImGui::BulletText("Single worker queue : %.1f ns/job", m_jobBenchmark.legacyNsPerJob);
+				ImGui::BulletText("pushJob : %.1f ns/job", m_jobBenchmark.singleNsPerJob);
+				ImGui::BulletText("pushJobs : %.1f ns/job", m_jobBenchmark.batchedNsPerJob);
+			}
+			ImGui::TreePop();
+		}
 	}
 	ImGui::End();
 	
@@ -245,24 +295,32 @@ void KelvinletsApp::on_render(SystemsInterface& systems)
 	ID3D11SamplerState* samplers[] = { m_pLinearMipSamplerState };
 	systems.pD3DContext->PSSetSamplers(0, 1, samplers);
 
-	// Draw each mesh instance
-	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	// Draw each mesh group, binding its mesh once for all of its instances
+	const Texture* pBoundTexture = nullptr;
+	for (const MeshInstanceGroup& group : m_meshInstanceManager.get_groups())
 	{
-		// Bind the instance's mesh and texture to the device context
-		it->get_mesh().bind(systems.pD3DContext);
-		it->get_texture().bind(systems.pD3DContext, ShaderStage::kPixel, 0);
-		// Update per-instance data on CPU
-		extract_per_instance_data(*it);
-		// Update per-instance data on GPU
-		update_constant_buffer(systems.pD3DContext, m_pPerInstanceCB, m_perInstanceCBData);
-		// Bind per-instance data to Slot 1 of the VS/PS rendering pair
-		ID3D11Buffer* ppPerInstanceCB[] = { m_pPerInstanceCB };
-		systems.pD3DContext->VSSetConstantBuffers(1, 1, ppPerInstanceCB);
-		systems.pD3DContext->PSSetConstantBuffers(1, 1, ppPerInstanceCB);
-		// Bind displacement buffer SRV to shader slot t1 
-		it->get_displacement_manager().bind_displacements_SRV_to_VS(systems.pD3DContext, 1);
-		// Render the mesh instance 
-		it->render(systems);
+		group.pMesh->bind(systems.pD3DContext);
+		for (auto it = m_meshInstanceManager.begin() + group.first; it != m_meshInstanceManager.begin() + group.first + group.count; ++it)
+		{
+			// Bind the instance's texture to the device context if it differs from the last one
+			if (&it->get_texture() != pBoundTexture)
+			{
+				it->get_texture().bind(systems.pD3DContext, ShaderStage::kPixel, 0);
+				pBoundTexture = &it->get_texture();
+			}
+			// Update per-instance data on CPU
+			extract_per_instance_data(*it);
+			// Update per-instance data on GPU
+			update_constant_buffer(systems.pD3DContext, m_pPerInstanceCB, m_perInstanceCBData);
+			// Bind per-instance data to Slot 1 of the VS/PS rendering pair
+			ID3D11Buffer* ppPerInstanceCB[] = { m_pPerInstanceCB };
+			systems.pD3DContext->VSSetConstantBuffers(1, 1, ppPerInstanceCB);
+			systems.pD3DContext->PSSetConstantBuffers(1, 1, ppPerInstanceCB);
+			// Bind displacement buffer SRV to shader slot t1 
+			m_meshInstanceManager.get_displacement_source(*it).bind_displacements_SRV_to_VS(systems.pD3DContext, 1);
+			// Render the mesh instance 
+			it->render(systems);
+		}
 	}
 
 	// Unbind resources from the VS/PS rendering pair
@@ -281,6 +339,8 @@ void KelvinletsApp::on_render(SystemsInterface& systems)
 	m_frameTime = static_cast<float>(m_timer.ElapsedMicroseconds() * 0.001);
 	m_elapsedTime += m_frameTime;
 	m_timer.Reset();
+
+	check_frame_allocations();
 }
 
 void KelvinletsApp::on_release()
@@ -313,46 +373,359 @@ void KelvinletsApp::init_shaders(SystemsInterface& systems)
 		VertexFormatTraits<Vertex_Pos3fColour4ubNormal3fTangent3fTex2f>::size }, true);
 }
 
-void KelvinletsApp::calculate_kelvinlet_displacements(SystemsInterface& systems)
+void KelvinletsApp::build_update_graph()
+{
+	// Each instance advances its own timeline, then each mesh group is evaluated in one go so the
+	// mesh's streams are read once for all of its instances. One group's evaluation can overlap
+	// another's timeline updates and uploads. Tasks touching the device context stay on the main thread.
+	m_updateGraph.clear();
+	m_graphLayoutVersion = m_meshInstanceManager.get_layout_version();
+	m_graphOnCPU = m_evaluateOnCPU;
+
+	// The scene field advances once and then hands every instance the Kelvinlets that reach it,
+	// which both the evaluations and the Kelvinlet uploads read
+	u32 advanceField = m_updateGraph.add_task("Advance field", [this]() { m_kelvinletField.advance_timeline(m_frameTime); });
+	u32 fieldReach = m_updateGraph.add_task("Field reach", [this]() {
+		if (m_meshInstanceManager.num_instances() > 0)
+			m_kelvinletField.update_reach(&*m_meshInstanceManager.begin(), m_meshInstanceManager.num_instances()); });
+	m_updateGraph.add_dependency(advanceField, fieldReach);
+
+	const std::vector<MeshInstanceGroup>& groups = m_meshInstanceManager.get_groups();
+	char name[64];
+	for (u32 g = 0; g < groups.size(); ++g)
+	{
+		const MeshInstanceGroup kGroup = groups[g];
+		auto instance = [this](u32 i) -> MeshInstance& { return *(m_meshInstanceManager.begin() + i); };
+
+		u32 evaluate = 0;
+		if (m_graphOnCPU)
+		{
+			snprintf(name, sizeof(name), "Evaluate %s x%u", kGroup.pMesh->get_name().c_str(), kGroup.count);
+			evaluate = m_updateGraph.add_task(name, [this, kGroup, instance]() {
+				m_kelvinletEngine.evaluate_group(&instance(kGroup.first), kGroup.count, share_group_evaluations(kGroup)); });
+			m_updateGraph.add_dependency(fieldReach, evaluate);
+		}
+		else
+		{
+			snprintf(name, sizeof(name), "Dispatch %s x%u", kGroup.pMesh->get_name().c_str(), kGroup.count);
+			evaluate = m_updateGraph.add_task(name, [this, kGroup]() {
+				dispatch_kelvinlet_displacements(*m_pSystems, kGroup); }, true);
+		}
+
+		for (u32 i = kGroup.first; i < kGroup.first + kGroup.count; ++i)
+		{
+			snprintf(name, sizeof(name), "Advance timeline #%u", i);
+			u32 advance = m_updateGraph.add_task(name, [this, instance, i]() {
+				MeshInstance& mi = instance(i);
+				mi.get_kelvinlet_manager().advance_timeline(m_frameTime);
+				if (m_retireKelvinlets)
+					mi.retire_negligible_kelvinlets(m_retireTolerance);
+				else
+					mi.get_kelvinlet_manager().clear_retirements(); });
+
+			snprintf(name, sizeof(name), "Upload Kelvinlets #%u", i);
+			u32 stage = m_updateGraph.add_task(name, [this, instance, i]() {
+				const MeshInstance& mi = instance(i);
+				instance(i).get_kelvinlet_manager().upload_kelvinlets(m_pSystems->pD3DContext, mi.get_world_to_object(),
+					mi.get_field_kelvinlets(), mi.get_num_field_kelvinlets()); }, true);
+			m_updateGraph.add_dependency(advance, stage);
+			m_updateGraph.add_dependency(fieldReach, stage);
+
+			if (m_graphOnCPU)
+			{
+				snprintf(name, sizeof(name), "Upload displacements #%u", i);
+				u32 upload = m_updateGraph.add_task(name, [this, instance, i]() {
+					if (!instance(i).get_displacement_source().valid() && !instance(i).displacements_stale())
+						instance(i).get_displacement_manager().upload_displacements(m_pSystems->pD3DContext); }, true);
+
+				m_updateGraph.add_dependency(advance, evaluate);
+				m_updateGraph.add_dependency(evaluate, upload);
+			}
+			else
+			{
+				m_updateGraph.add_dependency(stage, evaluate);
+			}
+		}
+	}
+	m_updateGraph.compile();
+	m_steadyFrame = false;
+	m_displacementSources.resize(m_meshInstanceManager.num_instances());
+	m_evaluationNeeded.resize(m_meshInstanceManager.num_instances());
+
+	// Only the CPU path reads the displacements back from system memory. It gets every instance's copy up front,
+	// since an instance that has only ever shared another's results allocates it when it first diverges.
+	if (m_graphOnCPU)
+	{
+		for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+			it->get_displacement_manager().get_displacements();
+	}
+	else
+		m_meshInstanceManager.release_cpu_displacements();
+}
+
+u32* KelvinletsApp::share_group_evaluations(const MeshInstanceGroup& group)
+{
+	// Runs inside the update graph, and only touches this group's instances and entries
+	u32* pSources = m_displacementSources.data() + group.first;
+	MeshInstance* pInstances = &*(m_meshInstanceManager.begin() + group.first);
+	if (m_shareEvaluations)
+		KelvinletEngine::find_shared_evaluations(pInstances, group.count, pSources);
+	else
+	{
+		for (u32 i = 0; i < group.count; ++i)
+			pSources[i] = i;
+	}
+
+	// Out of view instances are skipped unless a visible one shares their results. The rest bounds are
+	// grown by how far the Kelvinlets can move a vertex, so deforming into view is never missed.
+	// Visible instances that aren't due this update are skipped the same way (see assign_update_rates).
+	u8* pNeeded = m_evaluationNeeded.data() + group.first;
+	for (u32 i = 0; i < group.count; ++i)
+		pNeeded[i] = 0;
+	for (u32 i = 0; i < group.count; ++i)
+	{
+		if (m_cullInstances && !instance_in_view(pInstances[i], *m_pSystems->pCamera))
+			continue;
+		pNeeded[i] |= kInstanceVisible;
+		if (!m_updateRateLOD || m_catchingUp || pInstances[i].update_due(m_updateIndex))
+			pNeeded[pSources[i]] |= kEvaluationNeeded;
+	}
+
+	for (u32 i = 0; i < group.count; ++i)
+	{
+		const bool kStale = !(pNeeded[pSources[i]] & kEvaluationNeeded);
+		pInstances[i].set_displacements_stale(kStale);
+		if (kStale)
+		{
+			pSources[i] = kSkippedEvaluation;
+			// A lagging instance is still drawn, so it keeps reading whichever buffer it read last
+			if (pNeeded[i] & kInstanceVisible)
+				continue;
+		}
+		pInstances[i].set_displacement_source((kStale || pSources[i] == i) ?
+			SlotHandle() : m_meshInstanceManager.get_handle(group.first + pSources[i]));
+	}
+	return pSources;
+}
+
+bool KelvinletsApp::instance_in_view(const MeshInstance& mi, const Camera& camera) const
+{
+	// Rest bounds first, so the displacement bound is only worked out for instances that might be culled
+	// Too small to see is as good as out of view when quality is being traded for time
+	if (m_quality.minVisibleSize > 0.0f && projected_size(mi, camera) < m_quality.minVisibleSize)
+		return false;
+
+	const MeshBounds& bounds = mi.get_mesh().get_bounds();
+	const v3 kCentre = v3::Transform(bounds.sphereCentre, mi.get_model_matrix());
+	if (camera.sphereInFrustum(kCentre, bounds.sphereRadius))
+		return true;
+	return camera.sphereInFrustum(kCentre, bounds.sphereRadius + KelvinletEngine::max_displacement(mi));
+}
+
+bool KelvinletsApp::needs_catch_up(const Camera& camera)
+{
+	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	{
+		if (it->displacements_stale() && instance_in_view(*it, camera))
+			return true;
+	}
+	return false;
+}
+
+float KelvinletsApp::projected_size(const MeshInstance& mi, const Camera& camera) const
+{
+	const MeshBounds& bounds = mi.get_mesh().get_bounds();
+	return camera.projectedSize(v3::Transform(bounds.sphereCentre, mi.get_model_matrix()), bounds.sphereRadius);
+}
+
+void KelvinletsApp::assign_update_rates(const Camera& camera)
+{
+	// The interval doubles each time the projected size drops below the next of these fractions of the viewport
+	static const float kIntervalSizes[] = { 0.25f, 0.1f, 0.04f };
+	static_assert(1u << (sizeof(kIntervalSizes) / sizeof(kIntervalSizes[0])) == kMaxUpdateInterval, "One size per halving of the update rate");
+
+	// The cycle of kMaxUpdateInterval updates is split into slots that each interval divides evenly. An instance
+	// keeps its phase while its interval holds, so its updates stay evenly spaced. One whose interval changed is
+	// placed where the slots it would land in have the least work, which spreads expensive instances across frames.
+	for (u32 s = 0; s < kMaxUpdateInterval; ++s)
+		m_updateSlotCost[s] = 0;
+	auto cost = [](const MeshInstance& mi) -> u64 {
+		return static_cast<u64>(mi.get_mesh().num_vertices()) *
+			(mi.get_kelvinlet_manager().get_num_kelvinlets() + mi.get_num_field_kelvinlets()); };
+	auto add_cost = [this](const u32 kInterval, const u32 kPhase, const u64 kCost) {
+		for (u32 s = kPhase; s < kMaxUpdateInterval; s += kInterval)
+			m_updateSlotCost[s] += kCost; };
+
+	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	{
+		const float kSize = projected_size(*it, camera) * m_quality.updateSizeScale;
+		u32 interval = 1;
+		for (float threshold : kIntervalSizes)
+			interval <<= (kSize < threshold) ? 1 : 0;
+
+		if (interval == it->get_update_interval() && it->get_update_phase() != kUnplacedPhase)
+			add_cost(interval, it->get_update_phase(), cost(*it));
+		else
+			it->set_update_rate(interval, kUnplacedPhase);
+	}
+
+	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	{
+		if (it->get_update_phase() != kUnplacedPhase)
+			continue;
+		const u32 kInterval = it->get_update_interval();
+		u32 bestPhase = 0;
+		u64 bestCost = ~0ull;
+		for (u32 phase = 0; phase < kInterval; ++phase)
+		{
+			u64 phaseCost = 0;
+			for (u32 s = phase; s < kMaxUpdateInterval; s += kInterval)
+				phaseCost += m_updateSlotCost[s];
+			if (phaseCost < bestCost)
+			{
+				bestCost = phaseCost;
+				bestPhase = phase;
+			}
+		}
+		it->set_update_rate(kInterval, bestPhase);
+		add_cost(kInterval, bestPhase, cost(*it));
+	}
+
+	u64 total = 0, busiest = 0;
+	for (u32 s = 0; s < kMaxUpdateInterval; ++s)
+	{
+		total += m_updateSlotCost[s];
+		busiest = std::max(busiest, m_updateSlotCost[s]);
+	}
+	m_updateSlotSpread = total > 0 ? static_cast<float>(busiest) * kMaxUpdateInterval / static_cast<float>(total) : 1.0f;
+}
+
+void KelvinletsApp::assign_proxy_levels(const Camera& camera)
+{
+	// One proxy level coarser each time the projected size drops below the next of these fractions of the viewport.
+	// Going back to a finer level takes kRefineMargin times the size, so an instance sitting on a threshold
+	// doesn't swap meshes, and pop its normals, every update.
+	static const float kLevelSizes[] = { 0.2f, 0.08f, 0.03f };
+	static_assert(sizeof(kLevelSizes) / sizeof(kLevelSizes[0]) == kMeshMaxProxyLevels, "One size per proxy level");
+	static constexpr float kRefineMargin = 1.25f;
+
+	for (u32 l = 0; l <= kMeshMaxProxyLevels; ++l)
+		m_proxyLevelCounts[l] = 0;
+	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	{
+		// Proxies are a CPU evaluation path, the compute shader always runs on the full mesh
+		u32 level = 0;
+		if (m_proxyLOD && m_graphOnCPU)
+		{
+			const float kSize = projected_size(*it, camera) * m_quality.proxySizeScale;
+			u32 finest = 0;
+			u32 coarsest = 0;
+			for (float threshold : kLevelSizes)
+			{
+				finest += (kSize < threshold) ? 1 : 0;
+				coarsest += (kSize < threshold * kRefineMargin) ? 1 : 0;
+			}
+			// Coarsened at once, refined only as far as the margin allows
+			level = std::min(std::max(it->get_proxy_level(), finest), coarsest);
+		}
+		it->set_proxy_level(level);
+		++m_proxyLevelCounts[it->get_effective_proxy_level()];
+	}
+}
+
+void KelvinletsApp::run_update_graph(SystemsInterface& systems, bool catchUp)
 {
 	if (m_editorMode == 0)
 		return;
 
+	// Rebuild only when the instances or evaluation path change, otherwise the same graph is re-run
+	if (m_meshInstanceManager.get_layout_version() != m_graphLayoutVersion || m_evaluateOnCPU != m_graphOnCPU ||
+		m_updateGraph.num_tasks() == 0)
+		build_update_graph();
+
+	m_pSystems = &systems;
+	m_catchingUp = catchUp;
+	m_quality = m_governQuality ? m_qualityGovernor.get_settings() : QualitySettings();
+	if (m_updateRateLOD && !catchUp)
+		assign_update_rates(*systems.pCamera);
+	assign_proxy_levels(*systems.pCamera);
+	m_kelvinletEngine.set_lattice_evaluation(m_latticeEvaluation, m_latticeCellEpsilons);
+	m_kelvinletEngine.set_asymptotic_evaluation(m_asymptoticEvaluation, m_asymptoticTolerance);
+	m_kelvinletEngine.set_max_kelvinlets(m_quality.maxKelvinlets);
+	m_kelvinletEngine.reset_lattice_stats();
+	m_kelvinletEngine.reset_asymptotic_stats();
+	m_updateGraph.execute(global_job_queue());
+	m_latticeStats = m_kelvinletEngine.get_lattice_stats();
+	m_asymptoticStats = m_kelvinletEngine.get_asymptotic_stats();
+	// Catch-up runs evaluate everything at once and aren't typical of an update
+	if (m_governQuality && !catchUp)
+		m_qualityGovernor.update(m_updateGraph.get_execute_ms());
+	if (!catchUp)
+		++m_updateIndex;
+
+	m_sharedEvaluations = 0;
+	m_culledInstances = 0;
+	m_laggingInstances = 0;
+	m_retiredKelvinlets = 0;
+	for (u32 i = 0; i < m_meshInstanceManager.num_instances(); ++i)
+	{
+		const MeshInstance& mi = *(m_meshInstanceManager.begin() + i);
+		m_retiredKelvinlets += mi.get_kelvinlet_manager().get_num_retired();
+		if (mi.get_displacement_source().valid() && !mi.displacements_stale())
+			++m_sharedEvaluations;
+		if (mi.displacements_stale() && (m_evaluationNeeded[i] & kInstanceVisible))
+			++m_laggingInstances;
+		else if (mi.displacements_stale())
+			++m_culledInstances;
+	}
+
+	if (!m_graphOnCPU)
+		unbind_kelvinlet_shader(systems);
+}
+
+void KelvinletsApp::dispatch_kelvinlet_displacements(SystemsInterface& systems, const MeshInstanceGroup& group)
+{
 	// Bind compute shader to device context
 	m_kelvinletShader.bind(systems.pD3DContext);
 
 	// Bind per-frame data to shader slot b0
 	ID3D11Buffer* ppPerFrameCB[] = { m_pPerFrameCB };
 	systems.pD3DContext->CSSetConstantBuffers(0, 1, ppPerFrameCB);
-
+	// Bind per-instance constant buffer to shader slot b1
 	ID3D11Buffer* ppPerInstanceCB[] = { m_pPerInstanceCB };
+	systems.pD3DContext->CSSetConstantBuffers(1, 1, ppPerInstanceCB);
+	// Bind the group's mesh position and tangent frame SRVs to shader slots t0 and t2, once for all its instances
+	group.pMesh->bind_eval_streams_SRV(systems.pD3DContext, 0, 2);
 
-	// Iterate over each mesh instance, calculating displacements due to their Kelvinlets
-	for (auto it = m_meshInstanceManager.begin(); it != m_meshInstanceManager.end(); ++it)
+	// Launch 1D thread groups, one thread per vertex
+	u32 numVertices = group.pMesh->num_vertices();
+	u32 numThreads = align(numVertices, 256);
+
+	// Instances that evaluate the same as an earlier one draw with its buffer instead
+	const u32* pSources = share_group_evaluations(group);
+	for (u32 i = group.first; i < group.first + group.count; ++i)
 	{
+		if (pSources[i - group.first] != i - group.first)
+			continue;
+		MeshInstance& mi = *(m_meshInstanceManager.begin() + i);
 		// Update per-instance data on the CPU
-		extract_per_instance_data(*it);
+		extract_per_instance_data(mi);
 		// Push per-instance data to the GPU
 		update_constant_buffer(systems.pD3DContext, m_pPerInstanceCB, m_perInstanceCBData);
-		// Bind per-instance constant buffer to shader slot b1
-		ppPerInstanceCB[0] = m_pPerInstanceCB;
-		systems.pD3DContext->CSSetConstantBuffers(1, 1, ppPerInstanceCB);
 		// Bind per-instance displacements buffer to shader slot u0
-		it->get_displacement_manager().bind_displacements_UAV_to_CS(systems.pD3DContext, 0);
-		// Bind the instance's mesh vertex data SRV to shader slot t0
-		it->get_mesh().bind_structured_VB_SRV(systems.pD3DContext, 0);
+		mi.get_displacement_manager().bind_displacements_UAV_to_CS(systems.pD3DContext, 0);
 		// Bind the instance's Kelvinlet data SRV to shader slot t1;
-		it->get_kelvinlet_manager().bind_kelvinlet_data_SRV_to_CS(systems.pD3DContext, 1);
-		
-		// Launch 1D thread groups, one thread per vertex
-		u32 numVertices = it->get_mesh().num_vertices();
-		u32 numThreads = align(numVertices, 256);
+		mi.get_kelvinlet_manager().bind_kelvinlet_data_SRV_to_CS(systems.pD3DContext, 1);
+
 		systems.pD3DContext->Dispatch(numThreads / 256, 1, 1);
 	}
+}
 
+void KelvinletsApp::unbind_kelvinlet_shader(SystemsInterface& systems)
+{
 	// Unbind SRVs from compute shader
-	ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr };
-	systems.pD3DContext->CSSetShaderResources(0, 2, nullSRVs);
+	ID3D11ShaderResourceView* nullSRVs[] = { nullptr, nullptr, nullptr };
+	systems.pD3DContext->CSSetShaderResources(0, 3, nullSRVs);
 	// Unbind UAVS from compute shader
 	ID3D11UnorderedAccessView* nullUAVs[] = { nullptr };
 	systems.pD3DContext->CSSetUnorderedAccessViews(0, 1, nullUAVs, NULL);
@@ -361,13 +734,117 @@ void KelvinletsApp::calculate_kelvinlet_displacements(SystemsInterface& systems)
 	systems.pD3DContext->CSSetConstantBuffers(0, 2, nullCBs);
 }
 
+void KelvinletsApp::edit_timeline_kelvinlets(KelvinletTimeline& kt)
+{
+	static Kelvinlet k;
+	static float lc[3] = { 0.0f, 0.0f, 0.0f };
+	static float fp[3] = { 0.0f, 0.0f, 0.0f };
+
+	// Iterate over all of the timeline's Kelvinlets
+	int kNum = 0;
+	for (auto it = kt.begin(); it != kt.end(); ++it)
+	{
+		if (it->type == 0)
+			continue;
+		if (ImGui::TreeNode(m_frameArena.format("Kelvinlet##%d", kNum)))
+		{
+			Kelvinlet& k = *it;
+			ImGui::Text("Load Centre: %f, %f, %f", k.loadCentre.x, k.loadCentre.y, k.loadCentre.z);
+			ImGui::Text("Force Params: %f, %f, %f", k.forceParams.x, k.forceParams.y, k.forceParams.z);
+			ImGui::Text("Regularization: %f", k.epsilon);
+			switch (k.type)
+			{
+			case 1:
+				ImGui::Text("Type: Impulse"); break;
+			case 2:
+				ImGui::Text("Type: Pinch"); break;
+			case 3:
+				ImGui::Text("Type: Scale"); break;
+			default:
+				ImGui::Text("Type: ?"); break;
+			}
+			ImGui::Text("Start Time: %f", k.startTime);
+			ImGui::Text("Lifespan: %f", k.lifespan);
+
+			if (ImGui::Button("Remove Kelvinlet"))
+				kt.remove_kelvinlet(k);
+			ImGui::TreePop();
+		}
+		++kNum;
+	}
+
+	if (ImGui::TreeNode("New Kelvinlet"))
+	{
+		ImGui::InputFloat3("Load Centre", lc);
+		ImGui::InputFloat3("Force Params", fp);
+		ImGui::SliderFloat("Regularization", &k.epsilon, 0.01f, 10.0f);
+		ImGui::RadioButton("Impulse", &k.type, 1); ImGui::SameLine();
+		ImGui::RadioButton("Pinch", &k.type, 2); ImGui::SameLine();
+		ImGui::RadioButton("Scale", &k.type, 3);
+		ImGui::InputFloat("Start Time", &k.startTime);
+		ImGui::InputFloat("Life Span", &k.lifespan);
+
+		if (ImGui::Button("Add"))
+		{
+			k.loadCentre = v3(lc[0], lc[1], lc[2]);
+			k.forceParams = v3(fp[0], fp[1], fp[2]);
+			kt.insert_kelvinlet(k);
+		}
+		ImGui::TreePop();
+	}
+}
+
+void KelvinletsApp::show_memory_usage(const char* pSubsystem, const MemoryUsage& usage)
+{
+	const f64 kMB = 1024.0 * 1024.0;
+	ImGui::BulletText("%s : %.2f MB CPU, %.2f MB GPU", pSubsystem, usage.cpuBytes / kMB, usage.gpuBytes / kMB);
+}
+
+void KelvinletsApp::check_frame_allocations()
+{
+	// Once playback has warmed up (graph built, scratch pools and arena grown) a ticking frame
+	// shouldn't touch the heap at all. Frames with one-off UI actions don't count.
+	m_frameHeap = heap_counts() - m_frameHeapStart;
+	if (!m_ticking || !m_steadyFrame)
+	{
+		m_steadyFrames = 0;
+		return;
+	}
+	if (++m_steadyFrames <= kWarmUpFrames || m_frameHeap.allocations == 0)
+		return;
+
+	debugF("KelvinletsApp : %llu heap allocations (%llu bytes) in a steady frame", m_frameHeap.allocations, m_frameHeap.bytes);
+#if defined(DEBUG) || defined(_DEBUG)
+	ASSERT(m_frameHeap.allocations == 0);
+#endif
+}
+
+void KelvinletsApp::bake_displacements_to_disk(MeshInstance& mi)
+{
+	// Round-trips the instance's mesh through a stream file so the out-of-core path can be exercised
+	// on meshes that do fit in memory
+	const std::string meshFile = mi.get_mesh_name() + ".kmesh";
+	const std::string displacementFile = mi.get_mesh_name() + ".kdsp";
+
+	if (!write_mesh_stream_file(mi.get_mesh(), meshFile.c_str()))
+		return;
+
+	Timer timer;
+	timer.Start();
+	if (m_kelvinletEngine.evaluate_out_of_core(meshFile.c_str(), displacementFile.c_str(), KelvinletEngine::make_eval_params(mi)))
+	{
+		timer.Stop();
+		debugF("Baked %u vertices to %s in %.2f ms", mi.get_mesh().num_vertices(), displacementFile.c_str(),
+			timer.ElapsedMicroseconds() * 0.001);
+	}
+}
+
 void KelvinletsApp::extract_per_instance_data(MeshInstance& mi)
 {
-	m4x4 matModel = m4x4::CreateTranslation(mi.get_position());
 	const KelvinletManager& km = mi.get_kelvinlet_manager();
-	m_perInstanceCBData.m_matModel = matModel.Transpose();
+	m_perInstanceCBData.m_matModel = mi.get_model_matrix().Transpose();
 	m_perInstanceCBData.numVertices = mi.get_mesh().num_vertices();
-	m_perInstanceCBData.numKelvinlets = km.get_num_kelvinlets();
+	m_perInstanceCBData.numKelvinlets = km.get_num_uploaded_kelvinlets();
 	m_perInstanceCBData.alpha = km.get_alpha();
 	m_perInstanceCBData.beta = km.get_beta();
 }
@@ -1,8 +1,16 @@
 #pragma once
 #include "Framework.h"
+#include "FrameArena.h"
+#include "HeapCounter.h"
+#include "JobQueueBenchmark.h"
+#include "KelvinletEngine.h"
+#include "KelvinletField.h"
 #include "MeshManager.h"
 #include "MeshInstanceManager.h"
+#include "MeshProcessing.h"
+#include "QualityGovernor.h"
 #include "ShaderSet.h"
+#include "TaskGraph.h"
 #include "Texture.h"
 
 #include <deque>
@@ -25,7 +33,7 @@ public:
 
 	struct PerInstanceCBData	// Used in both CS and VS/PS shaders
 	{
-		m4x4 m_matModel;		// Model matrix for mesh instance
+		m4x4 m_matModel;		// Model matrix for mesh instance, only read when rendering
 		u32 numVertices;		// Number of vertices in this instance's mesh
 		u32 numKelvinlets;	    // Number of kelvinlets attached to instance
 		f32 alpha;				// Material parameter : pressure wave speed
@@ -62,7 +70,20 @@ public:
 private:
 	void init_camera(SystemsInterface& systems);
 	void init_shaders(SystemsInterface& systems);
-	void calculate_kelvinlet_displacements(SystemsInterface& systems);
+	void build_update_graph();
+	void run_update_graph(SystemsInterface& systems, bool catchUp = false);
+	void dispatch_kelvinlet_displacements(SystemsInterface& systems, const MeshInstanceGroup&);
+	u32* share_group_evaluations(const MeshInstanceGroup&);
+	bool instance_in_view(const MeshInstance&, const Camera&) const;
+	bool needs_catch_up(const Camera&);
+	float projected_size(const MeshInstance&, const Camera&) const;
+	void assign_update_rates(const Camera&);
+	void assign_proxy_levels(const Camera&);
+	void unbind_kelvinlet_shader(SystemsInterface& systems);
+	void edit_timeline_kelvinlets(KelvinletTimeline&);
+	void show_memory_usage(const char* pSubsystem, const MemoryUsage&);
+	void check_frame_allocations();
+	void bake_displacements_to_disk(MeshInstance&);
 	void extract_per_instance_data(MeshInstance&);
 	
 private:
@@ -70,6 +91,40 @@ private:
 	MeshInstanceManager m_meshInstanceManager;
 	ShaderSet m_kelvinletShader;	// Compute shader for calculating Kelvinlet displacements
 	ShaderSet m_renderShader;		// VS/PS pair to render each mesh
+	KelvinletEngine m_kelvinletEngine;	// CPU evaluation path
+	KelvinletField m_kelvinletField{ KelvinletManager::kMaxFieldKelvinlets };	// Scene-level Kelvinlets shared by the instances they reach
+	TaskGraph m_updateGraph;			// Per-instance timeline, evaluation and upload stages
+	u32 m_graphLayoutVersion = 0;		// Instance layout the update graph was built for
+	bool m_graphOnCPU = false;			// Evaluation path the update graph was built for
+	SystemsInterface* m_pSystems = nullptr;
+	std::vector<u32> m_displacementSources;	// Per dense instance, index within its group of the instance it shares with
+	u32 m_sharedEvaluations = 0;		// Instances that reused another's displacements last update
+	std::vector<u8> m_evaluationNeeded;	// Per dense instance, kEvaluationNeeded and kInstanceVisible bits
+	u32 m_culledInstances = 0;			// Instances out of view whose evaluation was skipped last update
+	u32 m_laggingInstances = 0;			// Visible instances that kept older displacements last update
+	u32 m_retiredKelvinlets = 0;		// Instance Kelvinlets left out of evaluation after the last update
+	static constexpr u8 kEvaluationNeeded = 1;	// A visible instance due this update reads its displacements
+	static constexpr u8 kInstanceVisible = 2;
+	static constexpr u32 kSkippedEvaluation = ~0u;	// Source of an instance that is neither evaluated nor shared
+	static constexpr u32 kMaxUpdateInterval = 8;	// Updates between evaluations of the smallest instances on screen
+	static constexpr u32 kUnplacedPhase = ~0u;		// Phase of an instance whose interval has just changed
+	u32 m_updateIndex = 0;				// Update graph runs so far, decides which instances are due
+	bool m_catchingUp = false;			// Every visible instance is due, for runs made while paused
+	u64 m_updateSlotCost[kMaxUpdateInterval] = {};	// Estimated evaluation work of each update in the cycle
+	float m_updateSlotSpread = 1.0f;	// Busiest update's work relative to the average
+	KelvinletLatticeStats m_latticeStats;	// Lattice evaluations made by the last update
+	KelvinletAsymptoticStats m_asymptoticStats;	// Asymptotic evaluations made by the last update
+	u32 m_proxyLevelCounts[kMeshMaxProxyLevels + 1] = {};	// Instances evaluated at each proxy level last update
+	QualityGovernor m_qualityGovernor;	// Trades quality for evaluation time when m_governQuality is set
+	QualitySettings m_quality;			// Settings the current update runs with
+	JobQueueBenchmarkResult m_jobBenchmark;
+	FrameArena m_frameArena;			// Strings and scratch that only live for one frame
+
+	static constexpr u32 kWarmUpFrames = 60;	// Ticking frames allowed to allocate before the heap check starts
+	HeapCounts m_frameHeapStart;
+	HeapCounts m_frameHeap;				// Allocations made by the last frame's update and render
+	u32 m_steadyFrames = 0;				// Consecutive ticking frames without one-off work
+	bool m_steadyFrame = true;			// Cleared by anything this frame that is expected to allocate
 	Texture m_texture;
 	Timer m_timer;
 
@@ -84,6 +139,18 @@ private:
 	int m_editorMode = 0;		// 0 = EDIT, 1 = PLAY
 	bool m_ticking = false;
 	bool m_correctNormals = true;
+	bool m_evaluateOnCPU = false;
+	bool m_latticeEvaluation = false;
+	float m_latticeCellEpsilons = KelvinletLattice::kDefaultCellEpsilons;
+	bool m_asymptoticEvaluation = true;
+	float m_asymptoticTolerance = KelvinletEngine::kDefaultAsymptoticTolerance;
+	bool m_shareEvaluations = true;
+	bool m_cullInstances = true;
+	bool m_updateRateLOD = true;
+	bool m_proxyLOD = true;
+	bool m_governQuality = true;
+	bool m_retireKelvinlets = true;
+	float m_retireTolerance = 1e-4f;	// Displacement a Kelvinlet is retired below, in bounding radii
 
 	float m_elapsedTime = 0.0f;	// Total running time in seconds
 	float m_frameTime;
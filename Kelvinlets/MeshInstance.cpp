@@ -2,12 +2,20 @@
 
 // Move constructor
 MeshInstance::MeshInstance(MeshInstance&& other) :
-	m_id(other.m_id),
 	m_position(other.m_position),
+	m_matModel(other.m_matModel),
+	m_matWorldToObject(other.m_matWorldToObject),
 	m_pMesh(nullptr),
 	m_pTexture(nullptr),
 	m_kelvinletManager(std::move(other.m_kelvinletManager)),
-	m_kDisplacementManager(std::move(other.m_kDisplacementManager))
+	m_kDisplacementManager(std::move(other.m_kDisplacementManager)),
+	m_displacementSource(other.m_displacementSource),
+	m_pFieldKelvinlets(other.m_pFieldKelvinlets),
+	m_numFieldKelvinlets(other.m_numFieldKelvinlets),
+	m_displacementsStale(other.m_displacementsStale),
+	m_updateInterval(other.m_updateInterval),
+	m_updatePhase(other.m_updatePhase),
+	m_proxyLevel(other.m_proxyLevel)
 {
 	m_pMesh = other.m_pMesh;
 	m_pTexture = other.m_pTexture;
@@ -19,12 +27,20 @@ MeshInstance& MeshInstance::operator=(MeshInstance&& other)
 {
 	if (this != &other)
 	{
-		m_id = other.m_id;
 		m_position = other.m_position;
+		m_matModel = other.m_matModel;
+		m_matWorldToObject = other.m_matWorldToObject;
 		m_pMesh = other.m_pMesh;
 		m_pTexture = other.m_pTexture;
 		m_kelvinletManager = std::move(other.m_kelvinletManager);
 		m_kDisplacementManager = std::move(other.m_kDisplacementManager);
+		m_displacementSource = other.m_displacementSource;
+		m_pFieldKelvinlets = other.m_pFieldKelvinlets;
+		m_numFieldKelvinlets = other.m_numFieldKelvinlets;
+		m_displacementsStale = other.m_displacementsStale;
+		m_updateInterval = other.m_updateInterval;
+		m_updatePhase = other.m_updatePhase;
+		m_proxyLevel = other.m_proxyLevel;
 	}
 	
 	return *this;
@@ -35,6 +51,13 @@ MeshInstance::~MeshInstance()
 	release();
 }
 
+void MeshInstance::set_position(const v3& pos)
+{
+	m_position = pos;
+	m_matModel = m4x4::CreateTranslation(pos);
+	m_matWorldToObject = m4x4::CreateTranslation(-pos);
+}
+
 void MeshInstance::set_mesh(SystemsInterface& systems, Mesh& rMesh)
 {
 	// Set the new mesh
@@ -52,7 +75,7 @@ void MeshInstance::init(SystemsInterface& systems)
 void MeshInstance::update(SystemsInterface& systems, float dt)
 {
 	m_kDisplacementManager.update(systems);
-	m_kelvinletManager.update(systems, dt);
+	m_kelvinletManager.update(systems, dt, m_matWorldToObject, m_pFieldKelvinlets, m_numFieldKelvinlets);
 }
 
 void MeshInstance::render(SystemsInterface& systems)
@@ -81,4 +104,14 @@ void MeshInstance::stop(ID3D11DeviceContext* pContext)
 const std::string& MeshInstance::get_mesh_name() const
 {
 	return m_pMesh->get_name();
-}
\ No newline at end of file
+}
+u32 MeshInstance::retire_negligible_kelvinlets(const f32 kTolerance)
+{
+	const MeshBounds& bounds = m_pMesh->get_bounds();
+	return m_kelvinletManager.retire_negligible(bounds, m_matWorldToObject, kTolerance * bounds.sphereRadius);
+}
+
+u32 MeshInstance::get_effective_proxy_level() const
+{
+	return m_pMesh ? std::min(m_proxyLevel, m_pMesh->num_proxy_levels()) : 0;
+}
@@ -3,27 +3,28 @@
 #include "KelvinletManager.h"
 #include "KDisplacementManager.h"
 #include "Mesh.h"
+#include "SlotMap.h"
 
 class Texture;
 
 class MeshInstance
 {
 public:
-	MeshInstance(size_t id, v3 pos, Mesh& rMesh, Texture& rTexture, u32 numKelvinlets) :
-		m_id(id),
+	MeshInstance(v3 pos, Mesh& rMesh, Texture& rTexture, u32 numKelvinlets) :
 		m_position(pos),
 		m_pMesh(&rMesh),
 		m_pTexture(&rTexture),
 		m_kelvinletManager(numKelvinlets),
 		m_kDisplacementManager(rMesh.num_vertices())
-	{}
+	{
+		set_position(pos);
+	}
 	MeshInstance(const MeshInstance&) = delete;
 	MeshInstance& operator=(const MeshInstance&) = delete;
 	MeshInstance(MeshInstance&&);	// Move constructor
 	MeshInstance& operator=(MeshInstance&&);	// Move assignment
 	~MeshInstance();
 
-	const size_t get_id() const { return m_id; }
 	const Mesh& get_mesh() const { return *m_pMesh; }
 	const Texture& get_texture() const { return *m_pTexture; }
 	
@@ -39,7 +40,12 @@ public:
 	void pause();
 	void stop(ID3D11DeviceContext*);
 
-	v3& get_position() { return m_position; }
+	// The model matrix and its inverse are kept with the position, so they are built once per move
+	// rather than by everything that needs them every frame
+	void set_position(const v3& pos);
+	const v3& get_position() const { return m_position; }
+	const m4x4& get_model_matrix() const { return m_matModel; }
+	const m4x4& get_world_to_object() const { return m_matWorldToObject; }
 	const std::string& get_mesh_name() const;
 
 	KelvinletManager& get_kelvinlet_manager() { return m_kelvinletManager; }
@@ -47,11 +53,52 @@ public:
 	KDisplacementManager& get_displacement_manager() { return m_kDisplacementManager; }
 	const KDisplacementManager& get_displacement_manager() const { return m_kDisplacementManager; }
 
+	// Instance whose displacements this one reuses because they evaluated the same, or an invalid
+	// handle when it has its own. Reset on every evaluation, so diverging gives it its own results again.
+	void set_displacement_source(SlotHandle source) { m_displacementSource = source; }
+	SlotHandle get_displacement_source() const { return m_displacementSource; }
+
+	// World space Kelvinlets from the scene's KelvinletField that reach this instance, evaluated along with
+	// its own. Owned by the field and refreshed by its update_reach.
+	void set_field_kelvinlets(const Kelvinlet* pKelvinlets, const u32 kCount) { m_pFieldKelvinlets = pKelvinlets; m_numFieldKelvinlets = kCount; }
+	const Kelvinlet* get_field_kelvinlets() const { return m_pFieldKelvinlets; }
+	u32 get_num_field_kelvinlets() const { return m_numFieldKelvinlets; }
+
+	// Set while evaluation is skipped because the instance is out of view. Kelvinlets are evaluated
+	// from their ages alone, so one evaluation when it comes back into view catches it up.
+	void set_displacements_stale(bool stale) { m_displacementsStale = stale; }
+	bool displacements_stale() const { return m_displacementsStale; }
+
+	// Evaluated every kInterval updates, on those where the update index modulo the interval is kPhase.
+	// An interval of 0 means none has been chosen yet.
+	void set_update_rate(const u32 kInterval, const u32 kPhase) { m_updateInterval = kInterval; m_updatePhase = kPhase; }
+	u32 get_update_interval() const { return m_updateInterval; }
+	u32 get_update_phase() const { return m_updatePhase; }
+	bool update_due(const u32 kUpdate) const { return m_updateInterval <= 1 || kUpdate % m_updateInterval == m_updatePhase; }
+
+	// Retires the instance's Kelvinlets that can't displace it by more than kTolerance times its bounding
+	// radius any longer (see KelvinletManager::retire_negligible)
+	u32 retire_negligible_kelvinlets(const f32 kTolerance);
+
+	// Which of the mesh's proxies CPU evaluation runs on (see Mesh::get_proxies), 0 for the mesh itself.
+	// Levels past the mesh's coarsest proxy use the coarsest.
+	void set_proxy_level(const u32 kLevel) { m_proxyLevel = kLevel; }
+	u32 get_proxy_level() const { return m_proxyLevel; }
+	u32 get_effective_proxy_level() const;
+
 private:
-	size_t m_id;	
 	v3 m_position;
+	m4x4 m_matModel;
+	m4x4 m_matWorldToObject;
 	Mesh* m_pMesh = nullptr;
 	Texture* m_pTexture = nullptr;
 	KelvinletManager m_kelvinletManager;
 	KDisplacementManager m_kDisplacementManager;
+	SlotHandle m_displacementSource;
+	const Kelvinlet* m_pFieldKelvinlets = nullptr;
+	u32 m_numFieldKelvinlets = 0;
+	bool m_displacementsStale = false;
+	u32 m_updateInterval = 0;
+	u32 m_updatePhase = 0;
+	u32 m_proxyLevel = 0;
 };
\ No newline at end of file
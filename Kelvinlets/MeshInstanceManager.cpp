@@ -1,20 +1,5 @@
 #include "MeshInstanceManager.h"
 
-//=================================================================================================
-// Custom comparator for ordering by mesh names lexically - useful for sorting mesh instances
-//=================================================================================================
-
-struct MeshInstanceNameCompare
-{
-	bool operator()(const MeshInstance& lhs, const MeshInstance& rhs) const
-	{
-		return (lhs.get_mesh_name() < rhs.get_mesh_name());
-	}
-};
-
-// Counter that increments, giving each mesh instance a unique ID
-size_t MeshInstanceManager::m_id = 0;
-
 MeshInstanceManager::~MeshInstanceManager()
 {
 	release();
@@ -53,42 +38,140 @@ void MeshInstanceManager::stop(ID3D11DeviceContext* pContext)
 		it->stop(pContext);
 }
 
-void MeshInstanceManager::add_mesh_instance(SystemsInterface& systems, v3 pos, Mesh& rMesh, Texture& rTexture, u32 numKs)
+MeshInstanceHandle MeshInstanceManager::add_mesh_instance(SystemsInterface& systems, v3 pos, Mesh& rMesh, Texture& rTexture, u32 numKs)
+{
+	MeshInstanceHandle handle = spawn(systems, pos, rMesh, rTexture, numKs);
+	++m_layoutVersion;
+	return handle;
+}
+
+MeshInstanceHandle MeshInstanceManager::spawn(SystemsInterface& systems, v3 pos, Mesh& rMesh, Texture& rTexture, u32 numKs)
+{
+	MeshInstanceHandle handle = m_meshInstances.emplace(pos, rMesh, rTexture, numKs);
+	m_meshInstances.get(handle)->init(systems);
+	insert_into_group(m_meshInstances.size() - 1);
+	return handle;
+}
+
+void MeshInstanceManager::add_mesh_instances(SystemsInterface& systems, const v3* pPositions, const u32 kCount, Mesh& rMesh,
+	Texture& rTexture, u32 numKs, MeshInstanceHandle* pHandlesOut)
+{
+	m_meshInstances.reserve(m_meshInstances.size() + kCount);
+	for (u32 i = 0; i < kCount; ++i)
+	{
+		MeshInstanceHandle handle = spawn(systems, pPositions[i], rMesh, rTexture, numKs);
+		if (pHandlesOut)
+			pHandlesOut[i] = handle;
+	}
+	++m_layoutVersion;
+}
+
+bool MeshInstanceManager::remove_mesh_instance(MeshInstanceHandle handle)
+{
+	const MeshInstance* pInstance = m_meshInstances.get(handle);
+	if (!pInstance)
+		return false;
+
+	// Moved to the end first, so erasing it doesn't move another instance out of its group
+	remove_from_group(static_cast<u32>(pInstance - &m_meshInstances[0]));
+	m_meshInstances.erase(handle);
+	++m_layoutVersion;
+	return true;
+}
+
+const KDisplacementManager& MeshInstanceManager::get_displacement_source(const MeshInstance& mi) const
 {
-	m_id += 1;	// Increment the ID counter
-	MeshInstance m(m_id, pos, rMesh, rTexture, numKs);
-	m.init(systems);
-	m_meshInstances.push_back(std::move(m));
+	// A source that has since been removed leaves the instance with its own, older, results
+	const MeshInstance* pSource = mi.get_displacement_source().valid() ? m_meshInstances.get(mi.get_displacement_source()) : nullptr;
+	return pSource ? pSource->get_displacement_manager() : mi.get_displacement_manager();
 }
 
-void MeshInstanceManager::remove_mesh_instance(size_t x)
+void MeshInstanceManager::release_cpu_displacements()
 {
-	// Ensure that this is a valid ID
-	ASSERT(x >= 0 && x <= m_id);
-	m_meshInstances.erase(begin() + x);
+	for (auto it = m_meshInstances.begin(); it != m_meshInstances.end(); ++it)
+		it->get_displacement_manager().release_cpu_displacements();
+}
+
+MemoryUsage MeshInstanceManager::kelvinlet_memory_usage() const
+{
+	MemoryUsage usage;
+	for (auto it = m_meshInstances.cbegin(); it != m_meshInstances.cend(); ++it)
+		usage += it->get_kelvinlet_manager().memory_usage();
+	return usage;
+}
+
+MemoryUsage MeshInstanceManager::displacement_memory_usage() const
+{
+	MemoryUsage usage;
+	for (auto it = m_meshInstances.cbegin(); it != m_meshInstances.cend(); ++it)
+		usage += it->get_displacement_manager().memory_usage();
+	return usage;
 }
 
-std::vector<MeshInstance>::iterator MeshInstanceManager::begin()
+SlotMap<MeshInstance>::iterator MeshInstanceManager::begin()
 {
 	return m_meshInstances.begin();
 }
 
-std::vector<MeshInstance>::const_iterator MeshInstanceManager::cbegin() const
+SlotMap<MeshInstance>::const_iterator MeshInstanceManager::cbegin() const
 {
 	return m_meshInstances.cbegin();
 }
 
-std::vector<MeshInstance>::iterator MeshInstanceManager::end()
+SlotMap<MeshInstance>::iterator MeshInstanceManager::end()
 {
 	return m_meshInstances.end();
 }
 
-std::vector<MeshInstance>::const_iterator MeshInstanceManager::cend() const
+SlotMap<MeshInstance>::const_iterator MeshInstanceManager::cend() const
 {
 	return m_meshInstances.cend();
 }
 
-void MeshInstanceManager::sort_instances_by_mesh()
+// Each new instance starts at the end of the dense array. Rather than sort, every group after its mesh's
+// has its first instance moved to its end, which moves the gap down to where the mesh's group ends.
+void MeshInstanceManager::insert_into_group(const u32 kDense)
+{
+	const Mesh* pMesh = &m_meshInstances[kDense].get_mesh();
+	u32 g = 0;
+	while (g < m_groups.size() && m_groups[g].pMesh != pMesh)
+		++g;
+	if (g == m_groups.size())
+	{
+		MeshInstanceGroup group;
+		group.pMesh = pMesh;
+		group.first = kDense;
+		m_groups.push_back(group);
+	}
+
+	u32 gap = kDense;
+	for (u32 h = static_cast<u32>(m_groups.size()) - 1; h > g; --h)
+	{
+		m_meshInstances.swap(gap, m_groups[h].first);
+		gap = m_groups[h].first++;
+	}
+	++m_groups[g].count;
+}
+
+// The reverse of insert_into_group: the instance goes to the end of its group, then each later group's
+// last instance is moved to its start, which carries the instance to the end of the dense array
+void MeshInstanceManager::remove_from_group(const u32 kDense)
 {
-	std::sort(m_meshInstances.begin(), m_meshInstances.end(), MeshInstanceNameCompare());
-}
\ No newline at end of file
+	const Mesh* pMesh = &m_meshInstances[kDense].get_mesh();
+	u32 g = 0;
+	while (m_groups[g].pMesh != pMesh)
+		++g;
+
+	u32 moving = kDense;
+	for (u32 h = g; h < m_groups.size(); ++h)
+	{
+		const u32 kLast = m_groups[h].first + m_groups[h].count - 1;
+		m_meshInstances.swap(moving, kLast);
+		moving = kLast;
+		if (h > g)
+			--m_groups[h].first;
+	}
+
+	if (--m_groups[g].count == 0)
+		m_groups.erase(m_groups.begin() + g);
+}
@@ -2,8 +2,18 @@
 
 #include "Manager.h"
 #include "MeshInstance.h"
+#include "SlotMap.h"
 
-#include <vector>
+// Stays valid while its instance exists, however the others are added, removed or reordered
+using MeshInstanceHandle = SlotHandle;
+
+// A run of instances sharing one mesh, at dense positions [first, first + count)
+struct MeshInstanceGroup
+{
+	const Mesh* pMesh = nullptr;
+	u32 first = 0;
+	u32 count = 0;
+};
 
 class MeshInstanceManager : public Manager<MeshInstanceManager>
 {
@@ -19,18 +29,41 @@ public:
 	void pause();
 	void stop(ID3D11DeviceContext*);
 
-	void add_mesh_instance(SystemsInterface& systems, v3, Mesh&, Texture&, u32);
-	void remove_mesh_instance(size_t x);
+	MeshInstanceHandle add_mesh_instance(SystemsInterface& systems, v3, Mesh&, Texture&, u32);
+	// Spawns kCount instances of one mesh, growing the storage at most once
+	void add_mesh_instances(SystemsInterface& systems, const v3* pPositions, const u32 kCount, Mesh&, Texture&, u32,
+		MeshInstanceHandle* pHandlesOut = nullptr);
+	bool remove_mesh_instance(MeshInstanceHandle handle);
+
+	MeshInstance* get_mesh_instance(MeshInstanceHandle handle) { return m_meshInstances.get(handle); }
+	MeshInstanceHandle get_handle(const u32 kIndex) const { return m_meshInstances.handle_at(kIndex); }
+	u32 num_instances() const { return m_meshInstances.size(); }
+
+	// The displacements an instance is drawn with: its own, or those of the instance it shares with
+	const KDisplacementManager& get_displacement_source(const MeshInstance&) const;
+
+	// Instances are kept grouped by mesh so each mesh's instances are adjacent
+	const std::vector<MeshInstanceGroup>& get_groups() const { return m_groups; }
+	// Changes whenever instances are added, removed or regrouped, invalidating dense positions and groups
+	u32 get_layout_version() const { return m_layoutVersion; }
+	void release_cpu_displacements();
+
+	MemoryUsage kelvinlet_memory_usage() const;
+	MemoryUsage displacement_memory_usage() const;
 
-	std::vector<MeshInstance>::iterator begin();
-	std::vector<MeshInstance>::const_iterator cbegin() const;
-	std::vector<MeshInstance>::iterator end();
-	std::vector<MeshInstance>::const_iterator cend() const;
+	// Iteration walks the densely packed instances
+	SlotMap<MeshInstance>::iterator begin();
+	SlotMap<MeshInstance>::const_iterator cbegin() const;
+	SlotMap<MeshInstance>::iterator end();
+	SlotMap<MeshInstance>::const_iterator cend() const;
 
 private:
-	void sort_instances_by_mesh();
+	MeshInstanceHandle spawn(SystemsInterface& systems, v3, Mesh&, Texture&, u32);
+	void insert_into_group(const u32 kDense);
+	void remove_from_group(const u32 kDense);
 
 private:
-	std::vector<MeshInstance> m_meshInstances;
-	static size_t m_id;
+	SlotMap<MeshInstance> m_meshInstances;
+	std::vector<MeshInstanceGroup> m_groups;
+	u32 m_layoutVersion = 0;
 };
\ No newline at end of file
@@ -7,22 +7,27 @@ MeshManager::~MeshManager()
 
 void MeshManager::init(SystemsInterface& systems)
 {
-	// Load a meshes from file
+	// Load a meshes from file, each with proxies for evaluating Kelvinlets at a distance
+	const u32 kImportFlags = kMeshImportDefault | kMeshImportProxyChain;
 	Mesh sphere;
-	create_mesh_from_obj(systems.pD3DDevice, sphere, "Assets/Models/Sphere.obj", NULL, 10.0f, "Sphere");
+	create_mesh_from_obj(systems.pD3DDevice, sphere, "Assets/Models/Sphere.obj", NULL, 10.0f, "Sphere", kImportFlags);
 	m_meshes.insert({ sphere.get_name(), std::move(sphere) });
 
 	Mesh cube;
-	create_mesh_from_obj(systems.pD3DDevice, cube, "Assets/Models/Cube.obj", NULL, 10.0f, "Cube");
+	create_mesh_from_obj(systems.pD3DDevice, cube, "Assets/Models/Cube.obj", NULL, 10.0f, "Cube", kImportFlags);
 	m_meshes.insert({ cube.get_name(), std::move(cube) });
 
 	Mesh lp_sphere;
-	create_mesh_from_obj(systems.pD3DDevice, lp_sphere, "Assets/Models/LP_Sphere.obj", NULL, 0.1f, "LP_Sphere");
+	create_mesh_from_obj(systems.pD3DDevice, lp_sphere, "Assets/Models/LP_Sphere.obj", NULL, 0.1f, "LP_Sphere", kImportFlags);
 	m_meshes.insert({ lp_sphere.get_name(), std::move(lp_sphere) });
 
 	Mesh c_shape;
-	create_mesh_from_obj(systems.pD3DDevice, c_shape, "Assets/Models/C_Shape.obj", NULL, 0.05f, "C_Shape");
+	create_mesh_from_obj(systems.pD3DDevice, c_shape, "Assets/Models/C_Shape.obj", NULL, 0.05f, "C_Shape", kImportFlags);
 	m_meshes.insert({ c_shape.get_name(), std::move(c_shape) });
+
+	// The interleaved vertices live on in the vertex buffers and nothing reads them back
+	for (auto it = m_meshes.begin(); it != m_meshes.end(); ++it)
+		it->second.release_cpu_data(kMeshCpuVertices);
 }
 
 MeshManager::MeshMap::iterator MeshManager::begin()
@@ -45,6 +50,14 @@ MeshManager::MeshMap::const_iterator MeshManager::cend() const
 	return m_meshes.cend();
 }
 
+MemoryUsage MeshManager::memory_usage() const
+{
+	MemoryUsage usage;
+	for (auto it = m_meshes.cbegin(); it != m_meshes.cend(); ++it)
+		usage += it->second.memory_usage();
+	return usage;
+}
+
 Mesh& MeshManager::get_mesh(const std::string& name)
 {
 	MeshMap::iterator it = m_meshes.find(name);
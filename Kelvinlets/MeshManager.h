@@ -25,6 +25,8 @@ public:
 	Mesh& get_mesh(const std::string&);
 	const Mesh& get_mesh(const std::string&) const;
 
+	MemoryUsage memory_usage() const;
+
 private:
 	MeshMap m_meshes;
 	Mesh m_placeholder;		// Placeholder mesh to return
@@ -0,0 +1,94 @@
+#include "MeshStreamFile.h"
+
+#include <fstream>
+
+bool write_mesh_stream_file(const Mesh& mesh, const char* pFilename)
+{
+	if (!mesh.has_eval_streams())
+	{
+		errorF("write_mesh_stream_file : %s has released its CPU evaluation streams", mesh.get_name().c_str());
+		return false;
+	}
+
+	std::ofstream hFile(pFilename, std::ios::binary);
+	if (!hFile.good())
+	{
+		errorF("write_mesh_stream_file : could not open %s", pFilename);
+		return false;
+	}
+
+	MeshStreamFileHeader header = { kMeshStreamFileMagic, kStreamFileVersion, mesh.num_vertices(), 0 };
+	hFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	hFile.write(reinterpret_cast<const char*>(mesh.get_positions().data()), sizeof(v3) * mesh.num_vertices());
+	hFile.write(reinterpret_cast<const char*>(mesh.get_tangent_frames().data()), sizeof(MeshTangentFrame) * mesh.num_vertices());
+	return hFile.good();
+}
+
+bool MeshStreamReader::open(const char* pFilename)
+{
+	if (!m_file.open_read(pFilename))
+		return false;
+
+	if (m_file.size() < sizeof(MeshStreamFileHeader))
+	{
+		errorF("MeshStreamReader : %s is too small", pFilename);
+		close();
+		return false;
+	}
+
+	MappedView headerView = m_file.map_view(0, sizeof(MeshStreamFileHeader));
+	if (!headerView.pData)
+	{
+		close();
+		return false;
+	}
+	MeshStreamFileHeader header = *reinterpret_cast<const MeshStreamFileHeader*>(headerView.pData);
+	MappedFile::unmap_view(headerView);
+
+	const u64 kExpectedSize = sizeof(MeshStreamFileHeader) + static_cast<u64>(header.numVertices) * (sizeof(v3) + sizeof(MeshTangentFrame));
+	if (header.magic != kMeshStreamFileMagic || header.version != kStreamFileVersion || m_file.size() < kExpectedSize)
+	{
+		errorF("MeshStreamReader : %s is not a valid mesh stream file", pFilename);
+		close();
+		return false;
+	}
+
+	m_numVertices = header.numVertices;
+	return true;
+}
+
+void MeshStreamReader::close()
+{
+	m_file.close();
+	m_numVertices = 0;
+}
+
+MeshStreamChunk MeshStreamReader::map_chunk(u32 first, u32 count, bool prefetch) const
+{
+	ASSERT(first + count <= m_numVertices);
+
+	const u64 kPositionsOffset = sizeof(MeshStreamFileHeader);
+	const u64 kFramesOffset = kPositionsOffset + static_cast<u64>(m_numVertices) * sizeof(v3);
+
+	MeshStreamChunk chunk;
+	chunk.firstVertex = first;
+	chunk.numVertices = count;
+	chunk.positionView = m_file.map_view(kPositionsOffset + static_cast<u64>(first) * sizeof(v3), static_cast<u64>(count) * sizeof(v3));
+	chunk.frameView = m_file.map_view(kFramesOffset + static_cast<u64>(first) * sizeof(MeshTangentFrame), static_cast<u64>(count) * sizeof(MeshTangentFrame));
+	chunk.pPositions = reinterpret_cast<const v3*>(chunk.positionView.pData);
+	chunk.pFrames = reinterpret_cast<const MeshTangentFrame*>(chunk.frameView.pData);
+
+	if (prefetch)
+	{
+		MappedFile::prefetch_view(chunk.positionView);
+		MappedFile::prefetch_view(chunk.frameView);
+	}
+	return chunk;
+}
+
+void MeshStreamReader::unmap_chunk(MeshStreamChunk& rChunk) const
+{
+	MappedFile::unmap_view(rChunk.positionView);
+	MappedFile::unmap_view(rChunk.frameView);
+	rChunk = MeshStreamChunk();
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "KDisplacement.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Mesh stream files hold a mesh's evaluation streams on disk so that meshes larger than memory
+// can be evaluated a chunk at a time.
+//
+// Layout : MeshStreamFileHeader | positions (v3 x N) | tangent frames (MeshTangentFrame x N)
+//
+// Displacement files hold the result of one evaluation.
+//
+// Layout : DisplacementFileHeader | displacements (KDisplacement x N)
+
+constexpr u32 kMeshStreamFileMagic = 0x48534D4B;		// 'KMSH'
+constexpr u32 kDisplacementFileMagic = 0x5053444B;		// 'KDSP'
+constexpr u32 kStreamFileVersion = 1;
+
+struct MeshStreamFileHeader
+{
+	u32 magic;
+	u32 version;
+	u32 numVertices;
+	u32 reserved;
+};
+
+struct DisplacementFileHeader
+{
+	u32 magic;
+	u32 version;
+	u32 numVertices;
+	u32 reserved;
+};
+
+// Writes a loaded mesh's evaluation streams to disk
+bool write_mesh_stream_file(const Mesh& mesh, const char* pFilename);
+
+// A run of vertices mapped from a mesh stream file
+struct MeshStreamChunk
+{
+	u32 firstVertex = 0;
+	u32 numVertices = 0;
+	const v3* pPositions = nullptr;
+	const MeshTangentFrame* pFrames = nullptr;
+	MappedView positionView;
+	MappedView frameView;
+};
+
+class MeshStreamReader
+{
+public:
+	bool open(const char* pFilename);
+	void close();
+
+	u32 num_vertices() const { return m_numVertices; }
+
+	// Maps vertices [first, first + count) and optionally starts paging them in
+	MeshStreamChunk map_chunk(u32 first, u32 count, bool prefetch) const;
+	void unmap_chunk(MeshStreamChunk& rChunk) const;
+
+private:
+	MappedFile m_file;
+	u32 m_numVertices = 0;
+};
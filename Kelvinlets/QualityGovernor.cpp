@@ -0,0 +1,73 @@
+#include "QualityGovernor.h"
+
+#include <algorithm>
+
+// Full quality first. Each step gives up a little more, the cheapest losses first: distant instances
+// update less often, then evaluate on coarser proxies, then the smallest are dropped and the weakest
+// Kelvinlets with them.
+static const QualitySettings kLadder[QualityGovernor::kNumLevels] =
+{
+	{ 1.0f, 1.0f, 0.0f, ~0u },
+	{ 0.7f, 1.0f, 0.0f, ~0u },
+	{ 0.7f, 0.7f, 0.0f, ~0u },
+	{ 0.5f, 0.5f, 0.01f, ~0u },
+	{ 0.35f, 0.35f, 0.02f, 8 },
+	{ 0.25f, 0.25f, 0.04f, 4 },
+};
+
+const QualitySettings& QualityGovernor::settings_for(const u32 kLevel)
+{
+	ASSERT(kLevel < kNumLevels);
+	return kLadder[kLevel];
+}
+
+void QualityGovernor::reset()
+{
+	m_level = 0;
+	m_primed = false;
+	m_smoothedMs = 0.0f;
+	m_overBudget = 0;
+	m_underBudget = 0;
+	m_raiseAfter = kRaiseAfter;
+	m_sinceRaise = ~0u;
+}
+
+void QualityGovernor::set_level(const u32 kLevel, const char* pReason)
+{
+	debugF("QualityGovernor : level %u -> %u, %s (%.2f ms smoothed against a %.2f ms budget)",
+		m_level, kLevel, pReason, m_smoothedMs, m_budgetMs);
+	m_level = kLevel;
+	++m_numChanges;
+
+	// Times measured at the old level say nothing about the new one
+	m_primed = false;
+	m_overBudget = 0;
+	m_underBudget = 0;
+}
+
+bool QualityGovernor::update(const f32 kEvaluationMs)
+{
+	// A raise that has held for the longest wait has settled, so later ones needn't wait as long
+	if (m_sinceRaise != ~0u && ++m_sinceRaise == kMaxRaiseAfter)
+		m_raiseAfter = kRaiseAfter;
+	m_smoothedMs = m_primed ? m_smoothedMs + (kEvaluationMs - m_smoothedMs) * kSmoothing : kEvaluationMs;
+	m_primed = true;
+
+	m_overBudget = (m_smoothedMs > m_budgetMs) ? m_overBudget + 1 : 0;
+	m_underBudget = (m_smoothedMs < m_budgetMs * kRaiseFraction) ? m_underBudget + 1 : 0;
+
+	if (m_overBudget >= kLowerAfter && m_level + 1 < kNumLevels)
+	{
+		if (m_sinceRaise <= m_raiseAfter)
+			m_raiseAfter = std::min(m_raiseAfter * 2, kMaxRaiseAfter);
+		set_level(m_level + 1, "over budget");
+		return true;
+	}
+	if (m_underBudget >= m_raiseAfter && m_level > 0)
+	{
+		set_level(m_level - 1, "under budget");
+		m_sinceRaise = 0;
+		return true;
+	}
+	return false;
+}
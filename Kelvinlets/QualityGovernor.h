@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CommonHeader.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// QualityGovernor
+//
+// Responsibility : Holds the measured evaluation time of each update to a budget by moving along a
+//                  ladder of quality levels, each coarser than the last in at least one of the knobs in
+//                  QualitySettings. Times are smoothed, and a level is only left once the budget has been
+//                  missed, or met with room to spare, for several updates in a row, so it doesn't flicker
+//                  between two levels. A raise that has to be taken back soon after doubles the wait
+//                  before the next one. Every change is logged along with the times that led to it.
+
+// What one quality level sets. The defaults are full quality.
+struct QualitySettings
+{
+	f32 updateSizeScale = 1.0f;	// Scales projected sizes before update rates are picked (see assign_update_rates)
+	f32 proxySizeScale = 1.0f;	// Scales projected sizes before proxy levels are picked
+	f32 minVisibleSize = 0.0f;	// Instances projecting smaller than this are skipped like those out of view
+	u32 maxKelvinlets = ~0u;	// Strongest Kelvinlets each CPU evaluation keeps
+};
+
+class QualityGovernor
+{
+public:
+	static constexpr f32 kDefaultBudgetMs = 8.0f;
+	static constexpr u32 kNumLevels = 6;
+	static constexpr f32 kSmoothing = 0.2f;			// Weight of each new time in the running average
+	static constexpr f32 kRaiseFraction = 0.6f;		// Quality only goes back up under this fraction of the budget
+	static constexpr u32 kLowerAfter = 5;			// Updates in a row over budget before quality drops
+	static constexpr u32 kRaiseAfter = 60;			// Updates in a row well under budget before it rises
+	static constexpr u32 kMaxRaiseAfter = 960;		// Longest that wait grows to after raises that didn't hold
+
+	QualityGovernor() {}
+	QualityGovernor(const QualityGovernor&) = delete;
+	QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+	// Back to full quality with no history, e.g. when governing is switched off
+	void reset();
+
+	// Feeds the evaluation time of one update. Returns true when it moved the level.
+	bool update(const f32 kEvaluationMs);
+
+	f32* get_budget_ptr() { return &m_budgetMs; }
+	f32 get_budget() const { return m_budgetMs; }
+	f32 get_smoothed_ms() const { return m_smoothedMs; }
+	u32 get_level() const { return m_level; }
+	u32 get_num_changes() const { return m_numChanges; }
+	const QualitySettings& get_settings() const { return settings_for(m_level); }
+
+	static const QualitySettings& settings_for(const u32 kLevel);
+
+private:
+	void set_level(const u32 kLevel, const char* pReason);
+
+	f32 m_budgetMs = kDefaultBudgetMs;
+	f32 m_smoothedMs = 0.0f;
+	bool m_primed = false;		// m_smoothedMs holds an average for the current level
+	u32 m_level = 0;
+	u32 m_overBudget = 0;		// Consecutive updates over budget
+	u32 m_underBudget = 0;		// Consecutive updates under kRaiseFraction of it
+	u32 m_raiseAfter = kRaiseAfter;
+	u32 m_sinceRaise = ~0u;		// Updates since quality last went up
+	u32 m_numChanges = 0;
+};